@@ -15,7 +15,10 @@ void parse_args(int argc, char* argv[],
                 I& dim,
                 I& sparsity,
                 I& iterations,
-                bool& quiet);
+                int& threads,
+                bool& quiet,
+                bool& tune,
+                bool& progress);
 
 int main(int argc, char* argv[])
 {
@@ -26,19 +29,21 @@ int main(int argc, char* argv[])
   I row_start, row_end;
 
   I dim = 100, sparsity = 10, iterations = 100;
-  bool quiet = false;
+  int threads = 1;
+  bool quiet = false, tune = false, progress = false;
 
   upcxx::init();
   if (upcxx::rank_me() == 0) do_print = true;
   else do_print = false;
 
-  parse_args(argc, argv, dim, sparsity, iterations, quiet);
+  parse_args(argc, argv, dim, sparsity, iterations, threads, quiet, tune, progress);
 
   if (!quiet && do_print) {
     std::cout << "Timing SLAPS MatVec." << std::endl;
     std::cout << " dim = " << dim << std::endl;
     std::cout << " sparsity = " << sparsity << std::endl;
     std::cout << " iterations = " << iterations << std::endl;
+    std::cout << " threads = " << threads << std::endl;
   }
 
   m.set_dimensions(dim, dim);
@@ -49,20 +54,38 @@ int main(int argc, char* argv[])
   I tot_nz = dim/sparsity + 1;
   m.get_local_rows(row_start, row_end);
 
+  double local_nnz = 0;
   for (I i = row_start; i < row_end; ++i) {
     /* start from a different spot each time */
     for (I j = (LARGE_PRIME*i) % sparsity; j < dim; j += sparsity) {
       m.set_value(i, j, 1);
+      local_nnz++;
     }
   }
+  double nnz = upcxx::allreduce(local_nnz, std::plus<double>()).wait();
 
   //m.setup(tot_nz/upcxx::rank_n() + 1, tot_nz - tot_nz/upcxx::rank_n() + 1);
   m.setup(tot_nz);
+  m.set_num_threads(threads);
+  m.set_progress_thread(progress);
 
   x.set_all(1);
 
   upcxx::barrier();
 
+  /* pick the prefetch parameters before timing */
+  if (tune) {
+    m.autotune();
+    while (m.is_tuning()) {
+      m.dot(x, y);
+    }
+    if (!quiet && do_print) {
+      std::cout << " tuned block size = " << m.get_block_size() << std::endl;
+      std::cout << " tuned nbufs = " << m.get_nbufs() << std::endl;
+    }
+    upcxx::barrier();
+  }
+
   auto tick = std::chrono::system_clock::now();
   for (I i = 0; i < iterations; ++i) {
     m.dot(x, y);
@@ -75,6 +98,13 @@ int main(int argc, char* argv[])
     if (!quiet) std::cout << "Time: ";
     auto td = std::chrono::duration_cast<std::chrono::microseconds>(tock-tick).count();
     std::cout << td / 1000000. << std::endl;
+
+    /* minimum memory traffic of one product: the matrix entries and row
+     * pointers, plus reading x and writing y once */
+    if (!quiet) {
+      double bytes = nnz * (sizeof(I) + sizeof(D)) + dim * (sizeof(I) + 2*sizeof(D));
+      std::cout << "Bandwidth: " << bytes * iterations / (td * 1000.) << " GB/s" << std::endl;
+    }
   }
 
   upcxx::finalize();
@@ -87,7 +117,10 @@ void parse_args(int argc, char* argv[],
                 I& dim,
                 I& sparsity,
                 I& iterations,
-                bool& quiet) {
+                int& threads,
+                bool& quiet,
+                bool& tune,
+                bool& progress) {
 
   bool recognized = true;
 
@@ -95,6 +128,12 @@ void parse_args(int argc, char* argv[],
     if (!strcmp(argv[i], "-q")) {
       quiet = true;
     }
+    else if (!strcmp(argv[i], "-tune")) {
+      tune = true;
+    }
+    else if (!strcmp(argv[i], "-pt")) {
+      progress = true;
+    }
     else if (i+1 < argc) {
       if (!strcmp(argv[i], "-d")) {
         dim = atoi(argv[i+1]);
@@ -108,6 +147,10 @@ void parse_args(int argc, char* argv[],
         iterations = atoi(argv[i+1]);
         i++;
       }
+      else if (!strcmp(argv[i], "-nt")) {
+        threads = atoi(argv[i+1]);
+        i++;
+      }
       else {
         recognized = false;
       }
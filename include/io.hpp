@@ -0,0 +1,1034 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <upcxx/upcxx.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sstream>
+#include <cstdint>
+#include <type_traits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "utils.hpp"
+#include "kernels.hpp"
+#include "vector.hpp"
+#include "matrix.hpp"
+
+/*
+ * Reading matrices from files.
+ *
+ * read_matrix_market loads a Matrix Market coordinate file into any of the
+ * matrix types. Every rank maps the file and parses its own share of the
+ * bytes: the entry lines are split by byte offset, and a line belongs to the
+ * rank whose range holds its first character. The entries then go to the
+ * ranks owning their rows with the usual stash, one batch per owner.
+ *
+ * For loading the same operators again and again, save_binary writes a
+ * matrix or vector in SLAPS's own binary format, and load_binary reads it
+ * back with nothing to parse: each rank reads exactly its own rows with
+ * pread, straight into place. A matrix file is a 64-byte header
+ * (_BinaryHeader), the row and column partitions it was saved with, and
+ * then the whole matrix in CSR form with global columns, sorted in each
+ * row: the row pointers as 64-bit integers, the columns, and the values. A
+ * vector file is the header, its partition and its values. The index and
+ * value types are recorded, and converted if they differ when loading.
+ *
+ * read_petsc_binary reads PETSc's binary matrix format (as written by
+ * MatView to a binary viewer) the same way, byte swapping on the way in.
+ *
+ * The CSRMat types get their rows with CSRMat::set_local_csr, so that
+ * setup() has no sorting left to do. The other matrix types get them
+ * through set_values(), as for read_matrix_market.
+ */
+
+/*
+ * read the Matrix Market file into m, which gets the file's dimensions and
+ * the given partitions. symmetric, skew-symmetric and Hermitian files are
+ * expanded to the full matrix; pattern files get 1 for each entry. the
+ * entries are on their way to their owners when this returns, having been
+ * sent with assemble_begin(), so only values in our own rows can still be
+ * added before setup(). collective
+ */
+template <typename I, typename D>
+void read_matrix_market(const std::string& filename, Mat<I,D>& m,
+                        const Partitioner<I>& rows = Partitioner<I>(),
+                        const Partitioner<I>& cols = Partitioner<I>());
+
+/*
+ * write m to filename in the SLAPS binary format. m must be set up, and of a
+ * type that keeps its CSR arrays (not SELLMat, SymCSRMat, DeltaCSRMat or
+ * MixedCSRMat). collective
+ */
+template <typename I, typename D>
+void save_binary(const std::string& filename, const CSRMat<I,D>& m);
+
+/*
+ * load a matrix saved with save_binary into m. without partitioners, m gets
+ * the partitions it was saved with, if it was saved on as many ranks, or
+ * else the even split. call setup() next, as after read_matrix_market.
+ * collective
+ */
+template <typename I, typename D>
+void load_binary(const std::string& filename, CSRMat<I,D>& m);
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, CSRMat<I,D>& m,
+                 const Partitioner<I>& rows, const Partitioner<I>& cols);
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, Mat<I,D>& m);
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, Mat<I,D>& m,
+                 const Partitioner<I>& rows, const Partitioner<I>& cols);
+
+/*
+ * write v to filename in the SLAPS binary format, each rank writing its own
+ * part. collective
+ */
+template <typename I, typename D>
+void save_binary(const std::string& filename, const Vec<I,D>& v);
+
+/*
+ * load a vector saved with save_binary into v. if v is already allocated it
+ * must have the saved size, and keeps its partition; otherwise it is
+ * allocated as for load_binary of a matrix. collective
+ */
+template <typename I, typename D>
+void load_binary(const std::string& filename, Vec<I,D>& v);
+
+/*
+ * load a matrix in PETSc's binary format into m, which gets the given
+ * partitions. the file must have 32-bit indices (PETSc's default); real and
+ * complex values are told apart by the file's size. call setup() next.
+ * collective
+ */
+template <typename I, typename D>
+void read_petsc_binary(const std::string& filename, CSRMat<I,D>& m,
+                       const Partitioner<I>& rows = Partitioner<I>(),
+                       const Partitioner<I>& cols = Partitioner<I>());
+
+template <typename I, typename D>
+void read_petsc_binary(const std::string& filename, Mat<I,D>& m,
+                       const Partitioner<I>& rows = Partitioner<I>(),
+                       const Partitioner<I>& cols = Partitioner<I>());
+
+/*########################*/
+/***** implementation *****/
+
+/* building values from the file's real and imaginary parts */
+template <typename D>
+struct _mm_value
+{
+  static const bool is_complex = false;
+  static D make(double re, double) { return D(re); }
+};
+
+template <typename T>
+struct _mm_value< std::complex<T> >
+{
+  static const bool is_complex = true;
+  static std::complex<T> make(double re, double im) { return std::complex<T>(T(re), T(im)); }
+};
+
+/* a read-only map of a whole file, unmapped when done */
+class _MappedFile
+{
+
+public:
+  explicit _MappedFile(const std::string& filename)
+  {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("cannot open " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("cannot stat " + filename);
+    }
+    _size = st.st_size;
+    if (_size > 0) {
+      void* p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("cannot map " + filename);
+      }
+      _data = static_cast<const char*>(p);
+      madvise(p, _size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+  }
+
+  ~_MappedFile()
+  {
+    if (_data) {
+      munmap(const_cast<char*>(_data), _size);
+    }
+  }
+
+  _MappedFile(const _MappedFile&) = delete;
+  _MappedFile& operator= (const _MappedFile&) = delete;
+
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const char* _data = nullptr;
+  size_t _size = 0;
+};
+
+/* skip spaces and tabs, but not newlines */
+inline const char* _mm_skip_blanks(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    ++p;
+  }
+  return p;
+}
+
+/* parse an unsigned integer at p, returning the end of it, or nullptr if there is none */
+template <typename I>
+const char* _mm_parse_index(const char* p, const char* end, I& out)
+{
+  p = _mm_skip_blanks(p, end);
+  if (p == end || *p < '0' || *p > '9') {
+    return nullptr;
+  }
+  unsigned long long v = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    v = 10*v + (*p - '0');
+    ++p;
+  }
+  out = I(v);
+  return p;
+}
+
+/*
+ * parse a real number at p. the digits are gathered into an integer and
+ * scaled by a power of ten, which is exact when both fit in a double
+ * (Clinger's fast path); anything longer goes to strtod
+ */
+inline const char* _mm_parse_real(const char* p, const char* end, double& out)
+{
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  p = _mm_skip_blanks(p, end);
+  const char* start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  unsigned long long mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (digits < 19) {
+      mantissa = 10*mantissa + (*p - '0');
+      if (mantissa) ++digits;
+    }
+    else {
+      ++exponent;
+    }
+    any = true;
+    ++p;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (digits < 19) {
+        mantissa = 10*mantissa + (*p - '0');
+        if (mantissa) ++digits;
+        --exponent;
+      }
+      any = true;
+      ++p;
+    }
+  }
+  if (!any) {
+    return nullptr;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool eneg = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      eneg = (*q == '-');
+      ++q;
+    }
+    if (q < end && *q >= '0' && *q <= '9') {
+      int e = 0;
+      while (q < end && *q >= '0' && *q <= '9') {
+        e = std::min(10*e + (*q - '0'), 100000);
+        ++q;
+      }
+      exponent += eneg ? -e : e;
+      p = q;
+    }
+  }
+
+  if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+    double v = double(mantissa);
+    v = (exponent < 0) ? v / powers[-exponent] : v * powers[exponent];
+    out = negative ? -v : v;
+    return p;
+  }
+
+  /* the slow way, from a copy, since the map isn't null-terminated */
+  std::string text(start, p);
+  out = std::strtod(text.c_str(), nullptr);
+  return p;
+}
+
+template <typename I, typename D>
+void read_matrix_market(const std::string& filename, Mat<I,D>& m,
+                        const Partitioner<I>& rows, const Partitioner<I>& cols)
+{
+  _MappedFile file(filename);
+  const char* begin = file.data();
+  const char* end = begin + file.size();
+
+  /* the banner and the size line, which every rank reads */
+  const char* p = begin;
+  const char* eol = std::find(p, end, '\n');
+  std::string banner(p, eol);
+  for (auto& c: banner) {
+    c = std::tolower(c);
+  }
+
+  std::istringstream words(banner);
+  std::string tag, object, format, field, symmetry;
+  words >> tag >> object >> format >> field >> symmetry;
+  if (tag != "%%matrixmarket" || object != "matrix") {
+    throw std::runtime_error(filename + " is not a Matrix Market matrix file");
+  }
+  if (format != "coordinate") {
+    throw std::runtime_error("only coordinate Matrix Market files are supported");
+  }
+  if (field != "real" && field != "integer" && field != "pattern" && field != "complex") {
+    throw std::runtime_error("unknown Matrix Market field " + field);
+  }
+  if (field == "complex" && !_mm_value<D>::is_complex) {
+    throw std::runtime_error("cannot read a complex Matrix Market file into a real matrix");
+  }
+  if (symmetry != "general" && symmetry != "symmetric" &&
+      symmetry != "skew-symmetric" && symmetry != "hermitian") {
+    throw std::runtime_error("unknown Matrix Market symmetry " + symmetry);
+  }
+
+  /* comments and blank lines, then the size line */
+  auto next_line = [end] (const char* at) {
+    at = std::find(at, end, '\n');
+    return (at < end) ? at + 1 : end;
+  };
+
+  p = next_line(p);
+  while (p < end) {
+    const char* s = _mm_skip_blanks(p, end);
+    if (s < end && *s != '%' && *s != '\n') {
+      break;
+    }
+    p = next_line(p);
+  }
+
+  I M, N, nnz;
+  const char* q = p;
+  if (!(q = _mm_parse_index(q, end, M)) || !(q = _mm_parse_index(q, end, N)) ||
+      !(q = _mm_parse_index(q, end, nnz))) {
+    throw std::runtime_error("bad size line in " + filename);
+  }
+  const char* data_start = next_line(q);
+
+  /* our byte range, moved to the starts of lines */
+  size_t nbytes = end - data_start;
+  int me = upcxx::rank_me(), nranks = upcxx::rank_n();
+  const char* range_start = data_start + nbytes * me / nranks;
+  const char* range_end = data_start + nbytes * (me + 1) / nranks;
+
+  auto line_start = [data_start, &next_line] (const char* at) {
+    return (at > data_start && at[-1] != '\n') ? next_line(at) : at;
+  };
+  range_start = line_start(range_start);
+  range_end = line_start(range_end);
+
+  bool symmetric = (symmetry != "general");
+  bool skew = (symmetry == "skew-symmetric"), hermitian = (symmetry == "hermitian");
+  bool pattern = (field == "pattern"), complex = (field == "complex");
+
+  /* the entries we parse, about our share of them */
+  std::vector<I> rs, cs;
+  std::vector<D> vs;
+  size_t guess = size_t(double(nnz) * (symmetric ? 2 : 1) / nranks * 1.05) + 16;
+  rs.reserve(guess);
+  cs.reserve(guess);
+  vs.reserve(guess);
+
+  long long bad_at = -1;
+  for (p = range_start; p < range_end; ) {
+    const char* line_end = std::find(p, end, '\n');
+    const char* s = _mm_skip_blanks(p, line_end);
+
+    /* blank lines and comments */
+    if (s == line_end || *s == '%') {
+      p = next_line(line_end);
+      continue;
+    }
+
+    I i, j;
+    double re = 1, im = 0;
+    const char* t = _mm_parse_index(s, line_end, i);
+    if (t) t = _mm_parse_index(t, line_end, j);
+    if (t && !pattern) t = _mm_parse_real(t, line_end, re);
+    if (t && complex) t = _mm_parse_real(t, line_end, im);
+    if (!t || i < 1 || i > M || j < 1 || j > N) {
+      bad_at = p - begin;
+      break;
+    }
+
+    D v = _mm_value<D>::make(re, im);
+    rs.push_back(i - 1);
+    cs.push_back(j - 1);
+    vs.push_back(v);
+    if (symmetric && i != j) {
+      rs.push_back(j - 1);
+      cs.push_back(i - 1);
+      vs.push_back(skew ? -v : (hermitian ? _conj(v) : v));
+    }
+
+    p = next_line(line_end);
+  }
+
+  /* agree on failure first, so that everyone throws together */
+  long long first_bad = upcxx::allreduce(bad_at < 0 ? (long long)file.size() : bad_at,
+                                         [] (long long a, long long b) { return std::min(a, b); }).wait();
+  if (first_bad < (long long)file.size()) {
+    std::ostringstream out;
+    out << "bad entry at byte " << first_bad << " of " << filename;
+    throw std::runtime_error(out.str());
+  }
+
+  m.set_dimensions(M, N, rows, cols);
+  m.set_values(rs.data(), cs.data(), vs.data(), I(rs.size()));
+  m.assemble_begin();
+}
+
+/*=====================*/
+/*** binary formats ***/
+
+/* the start of a SLAPS binary file */
+struct _BinaryHeader
+{
+  char magic[8];          /* "SLAPSMAT" or "SLAPSVEC" */
+  uint32_t version;
+  uint32_t byte_order;    /* _BINARY_BYTE_ORDER, as the writer saw it */
+  uint32_t index_bytes;   /* of the columns */
+  uint32_t value_bytes;
+  uint32_t is_complex;
+  uint32_t reserved;
+  int64_t rows, cols;     /* a vector has one column */
+  int64_t nnz;            /* for a vector, its size */
+  int64_t nparts;         /* the ranks it was saved from */
+};
+
+static_assert(sizeof(_BinaryHeader) == 64, "the binary header must be 64 bytes");
+
+#define _BINARY_VERSION 1
+#define _BINARY_BYTE_ORDER 0x01020304u
+
+/* the class id PETSc starts a matrix file with, and the size of its header */
+#define _PETSC_MAT_CLASSID 1211216
+#define _PETSC_MAT_HEADER 16
+
+/* a file read and written by offset. closed when done */
+class _BinaryFile
+{
+
+public:
+  _BinaryFile(const std::string& filename, int flags)
+  : _name(filename)
+  {
+    _fd = open(filename.c_str(), flags, 0644);
+    if (_fd < 0) {
+      throw std::runtime_error("cannot open " + filename);
+    }
+  }
+
+  ~_BinaryFile()
+  {
+    close(_fd);
+  }
+
+  _BinaryFile(const _BinaryFile&) = delete;
+  _BinaryFile& operator= (const _BinaryFile&) = delete;
+
+  size_t size() const
+  {
+    struct stat st;
+    if (fstat(_fd, &st) != 0) {
+      throw std::runtime_error("cannot stat " + _name);
+    }
+    return st.st_size;
+  }
+
+  /* read exactly bytes at offset, or throw */
+  void read(size_t offset, void* buf, size_t bytes) const
+  {
+    char* p = static_cast<char*>(buf);
+    while (bytes > 0) {
+      ssize_t n = pread(_fd, p, bytes, offset);
+      if (n <= 0) {
+        throw std::runtime_error((n == 0 ? "unexpected end of " : "cannot read ") + _name);
+      }
+      p += n;
+      offset += n;
+      bytes -= n;
+    }
+  }
+
+  void write(size_t offset, const void* buf, size_t bytes)
+  {
+    const char* p = static_cast<const char*>(buf);
+    while (bytes > 0) {
+      ssize_t n = pwrite(_fd, p, bytes, offset);
+      if (n <= 0) {
+        throw std::runtime_error("cannot write " + _name);
+      }
+      p += n;
+      offset += n;
+      bytes -= n;
+    }
+  }
+
+private:
+  std::string _name;
+  int _fd;
+};
+
+/* the scalars a value is made of, which are byte swapped one by one */
+template <typename T>
+struct _binary_part
+{
+  typedef T type;
+};
+
+template <typename T>
+struct _binary_part< std::complex<T> >
+{
+  typedef T type;
+};
+
+inline bool _big_endian_host()
+{
+  uint32_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 0;
+}
+
+/* converting what the file holds to what we store */
+template <typename I>
+struct _index_cast
+{
+  template <typename F>
+  I operator()(F f) const { return I(f); }
+};
+
+template <typename D>
+struct _value_cast
+{
+  template <typename F>
+  D operator()(const F& f) const { return _mm_value<D>::make(std::real(f), std::imag(f)); }
+};
+
+/*
+ * read n items of the file's type F at offset into out, converting each to
+ * T. if the types are the same and the bytes are in our order, it is read
+ * straight into out
+ */
+template <typename F, typename T, typename Convert>
+void _read_array(const _BinaryFile& file, size_t offset, size_t n, T* out, bool swap,
+                 Convert convert)
+{
+  if (std::is_same<F,T>::value && !swap) {
+    file.read(offset, out, n * sizeof(T));
+    return;
+  }
+
+  typedef typename _binary_part<F>::type part_t;
+  std::vector<F> buf(std::min(n, size_t(1) << 16));
+  for (size_t done = 0; done < n; ) {
+    size_t count = std::min(n - done, buf.size());
+    file.read(offset + done * sizeof(F), buf.data(), count * sizeof(F));
+    if (swap) {
+      char* p = reinterpret_cast<char*>(buf.data());
+      for (size_t k = 0; k < count * sizeof(F) / sizeof(part_t); ++k) {
+        std::reverse(p + k * sizeof(part_t), p + (k+1) * sizeof(part_t));
+      }
+    }
+    for (size_t k = 0; k < count; ++k) {
+      out[done + k] = convert(buf[k]);
+    }
+    done += count;
+  }
+}
+
+/* the same, for indices stored in bytes bytes */
+template <typename I>
+void _read_indices(const _BinaryFile& file, size_t offset, size_t n, unsigned bytes, I* out, bool swap)
+{
+  if (bytes == 4) {
+    _read_array<int32_t>(file, offset, n, out, swap, _index_cast<I>());
+  }
+  else if (bytes == 8) {
+    _read_array<int64_t>(file, offset, n, out, swap, _index_cast<I>());
+  }
+  else {
+    throw std::runtime_error("unsupported index size in binary file");
+  }
+}
+
+/* and for values stored in bytes bytes, complex or not */
+template <typename D>
+void _read_values(const _BinaryFile& file, size_t offset, size_t n, unsigned bytes,
+                  bool is_complex, D* out, bool swap)
+{
+  if (is_complex && !_mm_value<D>::is_complex) {
+    throw std::runtime_error("cannot read complex values into a real matrix or vector");
+  }
+
+  if (!is_complex && bytes == 4) {
+    _read_array<float>(file, offset, n, out, swap, _value_cast<D>());
+  }
+  else if (!is_complex && bytes == 8) {
+    _read_array<double>(file, offset, n, out, swap, _value_cast<D>());
+  }
+  else if (is_complex && bytes == 8) {
+    _read_array< std::complex<float> >(file, offset, n, out, swap, _value_cast<D>());
+  }
+  else if (is_complex && bytes == 16) {
+    _read_array< std::complex<double> >(file, offset, n, out, swap, _value_cast<D>());
+  }
+  else {
+    throw std::runtime_error("unsupported value size in binary file");
+  }
+}
+
+/* the header, checked, and the partitions after it */
+inline _BinaryHeader _read_binary_header(const _BinaryFile& file, const std::string& filename,
+                                         const char* magic)
+{
+  _BinaryHeader h;
+  file.read(0, &h, sizeof(h));
+  if (std::memcmp(h.magic, magic, 8) != 0) {
+    throw std::runtime_error(filename + " is not a SLAPS binary file of the right kind");
+  }
+  if (h.byte_order != _BINARY_BYTE_ORDER) {
+    throw std::runtime_error(filename + " was written with the other byte order");
+  }
+  if (h.version != _BINARY_VERSION) {
+    throw std::runtime_error(filename + " has an unknown binary format version");
+  }
+  return h;
+}
+
+/*
+ * check that the file is as long as its header says, before anything past
+ * the header is read. every rank sees the same header and size, so they all
+ * throw here together, rather than some of them failing a read later while
+ * the others wait in a collective
+ */
+inline void _check_binary_size(const _BinaryFile& file, const _BinaryHeader& h,
+                               const std::string& filename, bool matrix)
+{
+  /* bound everything by the file size first, so the sizes below can't overflow */
+  size_t file_size = file.size();
+  bool ok = h.rows >= 0 && h.cols >= 0 && h.nnz >= 0 && h.nparts > 0 &&
+            size_t(h.rows) <= file_size && size_t(h.nnz) <= file_size &&
+            size_t(h.nparts) <= file_size && h.value_bytes > 0 && h.value_bytes <= 16 &&
+            (!matrix || h.index_bytes == 4 || h.index_bytes == 8);
+
+  if (ok) {
+    size_t expected;
+    if (matrix) {
+      expected = sizeof(h) + (2 * (h.nparts + 1) + h.rows + 1) * sizeof(int64_t) +
+                 h.nnz * (h.index_bytes + h.value_bytes);
+    }
+    else {
+      expected = sizeof(h) + (h.nparts + 1) * sizeof(int64_t) + h.rows * h.value_bytes;
+    }
+    ok = (expected == file_size);
+  }
+
+  if (!ok) {
+    throw std::runtime_error(filename + " is truncated or does not match its header");
+  }
+}
+
+/* the saved partition k (0 for rows, 1 for columns), if it was saved on as many ranks */
+template <typename I>
+Partitioner<I> _saved_partitioner(const _BinaryFile& file, const _BinaryHeader& h, int k)
+{
+  if (h.nparts != upcxx::rank_n()) {
+    return Partitioner<I>();
+  }
+  std::vector<int64_t> saved(h.nparts + 1);
+  file.read(sizeof(h) + k * saved.size() * sizeof(int64_t), saved.data(),
+            saved.size() * sizeof(int64_t));
+  return Partitioner<I>::offsets(std::vector<I>(saved.begin(), saved.end()));
+}
+
+/* give our rows, with global columns, to a matrix that takes them as they are */
+template <typename I, typename D>
+void _take_rows(CSRMat<I,D>& m, const std::vector<I>& row_ptr, const std::vector<I>& cols,
+                const std::vector<D>& vals)
+{
+  m.set_local_csr(row_ptr.data(), cols.data(), vals.data());
+}
+
+/* or to any other, through set_values() */
+template <typename I, typename D>
+void _take_rows(Mat<I,D>& m, const std::vector<I>& row_ptr, const std::vector<I>& cols,
+                const std::vector<D>& vals)
+{
+  I rstart, rend;
+  m.get_local_rows(rstart, rend);
+  std::vector<I> rows(cols.size());
+  for (I i = 0; i < rend - rstart; ++i) {
+    std::fill(rows.begin() + row_ptr[i], rows.begin() + row_ptr[i+1], rstart + i);
+  }
+  m.set_values(rows.data(), cols.data(), vals.data(), I(rows.size()));
+  m.assemble_begin();
+}
+
+/* check the columns everywhere before any rank takes its rows, so that everyone throws together */
+template <typename I>
+void _check_binary_rows(const std::vector<I>& row_ptr, const std::vector<I>& cols, I N,
+                        const std::string& filename)
+{
+  bool bad = (row_ptr.back() != I(cols.size()));
+  for (size_t k = 1; k < row_ptr.size(); ++k) {
+    bad = bad || (row_ptr[k] < row_ptr[k-1]);
+  }
+  for (size_t j = 0; j < cols.size() && !bad; ++j) {
+    /* negative columns wrap around to large ones */
+    bad = (size_t(cols[j]) >= size_t(N));
+  }
+  if (upcxx::allreduce(int(bad), [] (int a, int b) { return std::max(a, b); }).wait()) {
+    throw std::runtime_error("bad row pointers or columns in " + filename);
+  }
+}
+
+template <typename I, typename D, typename MatT>
+void _load_binary(const std::string& filename, MatT& m, const Partitioner<I>* rows,
+                  const Partitioner<I>* cols)
+{
+  _BinaryFile file(filename, O_RDONLY);
+  _BinaryHeader h = _read_binary_header(file, filename, "SLAPSMAT");
+  _check_binary_size(file, h, filename, true);
+
+  I M = h.rows, N = h.cols;
+  if (rows) {
+    m.set_dimensions(M, N, *rows, *cols);
+  }
+  else {
+    m.set_dimensions(M, N, _saved_partitioner<I>(file, h, 0), _saved_partitioner<I>(file, h, 1));
+  }
+
+  size_t ptr_offset = sizeof(h) + 2 * (h.nparts + 1) * sizeof(int64_t);
+  size_t cols_offset = ptr_offset + (h.rows + 1) * sizeof(int64_t);
+  size_t vals_offset = cols_offset + h.nnz * h.index_bytes;
+
+  /* our row pointers, which say which columns and values are ours */
+  I rstart, rend;
+  m.get_local_rows(rstart, rend);
+  std::vector<int64_t> saved_ptr(rend - rstart + 1);
+  file.read(ptr_offset + rstart * sizeof(int64_t), saved_ptr.data(), saved_ptr.size() * sizeof(int64_t));
+
+  /* the row pointers must stay inside the file on every rank before anyone reads by them */
+  bool bad = (saved_ptr.front() < 0 || saved_ptr.back() > h.nnz);
+  for (size_t i = 1; i < saved_ptr.size(); ++i) {
+    bad = bad || (saved_ptr[i] < saved_ptr[i-1]);
+  }
+  if (upcxx::allreduce(int(bad), [] (int a, int b) { return std::max(a, b); }).wait()) {
+    throw std::runtime_error("bad row pointers in " + filename);
+  }
+
+  int64_t first = saved_ptr.front();
+  std::vector<I> row_ptr(saved_ptr.size());
+  for (size_t i = 0; i < saved_ptr.size(); ++i) {
+    row_ptr[i] = I(saved_ptr[i] - first);
+  }
+
+  size_t nnz = saved_ptr.back() - first;
+  std::vector<I> col_idx(nnz);
+  std::vector<D> vals(nnz);
+  _read_indices(file, cols_offset + first * h.index_bytes, nnz, h.index_bytes, col_idx.data(), false);
+  _read_values(file, vals_offset + first * h.value_bytes, nnz, h.value_bytes, h.is_complex != 0,
+               vals.data(), false);
+
+  _check_binary_rows(row_ptr, col_idx, N, filename);
+  _take_rows(m, row_ptr, col_idx, vals);
+}
+
+template <typename I, typename D>
+void save_binary(const std::string& filename, const CSRMat<I,D>& m)
+{
+  std::vector<I> row_ptr, cols;
+  std::vector<D> vals;
+  m.get_local_csr(row_ptr, cols, vals);
+
+  I M, N;
+  m.get_dimensions(M, N);
+  I rstart, rend;
+  m.get_local_rows(rstart, rend);
+
+  long long total;
+  long long base = _exclusive_sum(cols.size(), total);
+
+  int nranks = upcxx::rank_n();
+  size_t ptr_offset = sizeof(_BinaryHeader) + 2 * (nranks + 1) * sizeof(int64_t);
+  size_t cols_offset = ptr_offset + (size_t(M) + 1) * sizeof(int64_t);
+  size_t vals_offset = cols_offset + total * sizeof(I);
+
+  /* rank 0 starts the file with the header and partitions, and then everyone adds their rows */
+  bool created = true;
+  if (upcxx::rank_me() == 0) {
+    try {
+      _BinaryFile file(filename, O_WRONLY | O_CREAT | O_TRUNC);
+
+      _BinaryHeader h = {};
+      std::memcpy(h.magic, "SLAPSMAT", 8);
+      h.version = _BINARY_VERSION;
+      h.byte_order = _BINARY_BYTE_ORDER;
+      h.index_bytes = sizeof(I);
+      h.value_bytes = sizeof(D);
+      h.is_complex = _mm_value<D>::is_complex;
+      h.rows = M;
+      h.cols = N;
+      h.nnz = total;
+      h.nparts = nranks;
+      file.write(0, &h, sizeof(h));
+
+      std::vector<int64_t> parts(m.get_row_partitions().begin(), m.get_row_partitions().end());
+      parts.insert(parts.end(), m.get_col_partitions().begin(), m.get_col_partitions().end());
+      file.write(sizeof(h), parts.data(), parts.size() * sizeof(int64_t));
+    }
+    catch (const std::runtime_error&) {
+      created = false;
+    }
+  }
+  if (!upcxx::broadcast(created, 0).wait()) {
+    throw std::runtime_error("cannot create " + filename);
+  }
+
+  {
+    _BinaryFile file(filename, O_WRONLY);
+
+    /* the last rank also writes the end of the last row */
+    std::vector<int64_t> saved_ptr(row_ptr.size());
+    for (size_t i = 0; i < row_ptr.size(); ++i) {
+      saved_ptr[i] = base + row_ptr[i];
+    }
+    size_t nptr = (upcxx::rank_me() == nranks - 1) ? saved_ptr.size() : saved_ptr.size() - 1;
+    file.write(ptr_offset + rstart * sizeof(int64_t), saved_ptr.data(), nptr * sizeof(int64_t));
+    file.write(cols_offset + base * sizeof(I), cols.data(), cols.size() * sizeof(I));
+    file.write(vals_offset + base * sizeof(D), vals.data(), vals.size() * sizeof(D));
+  }
+
+  upcxx::barrier();
+}
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, CSRMat<I,D>& m)
+{
+  _load_binary<I,D>(filename, m, nullptr, nullptr);
+}
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, CSRMat<I,D>& m,
+                 const Partitioner<I>& rows, const Partitioner<I>& cols)
+{
+  _load_binary<I,D>(filename, m, &rows, &cols);
+}
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, Mat<I,D>& m)
+{
+  _load_binary<I,D>(filename, m, nullptr, nullptr);
+}
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, Mat<I,D>& m,
+                 const Partitioner<I>& rows, const Partitioner<I>& cols)
+{
+  _load_binary<I,D>(filename, m, &rows, &cols);
+}
+
+template <typename I, typename D>
+void save_binary(const std::string& filename, const Vec<I,D>& v)
+{
+  int nranks = upcxx::rank_n();
+  size_t vals_offset = sizeof(_BinaryHeader) + (nranks + 1) * sizeof(int64_t);
+
+  bool created = true;
+  if (upcxx::rank_me() == 0) {
+    try {
+      _BinaryFile file(filename, O_WRONLY | O_CREAT | O_TRUNC);
+
+      _BinaryHeader h = {};
+      std::memcpy(h.magic, "SLAPSVEC", 8);
+      h.version = _BINARY_VERSION;
+      h.byte_order = _BINARY_BYTE_ORDER;
+      h.index_bytes = sizeof(I);
+      h.value_bytes = sizeof(D);
+      h.is_complex = _mm_value<D>::is_complex;
+      h.rows = v.get_size();
+      h.cols = 1;
+      h.nnz = v.get_size();
+      h.nparts = nranks;
+      file.write(0, &h, sizeof(h));
+
+      std::vector<int64_t> parts(v.get_partitions().begin(), v.get_partitions().end());
+      file.write(sizeof(h), parts.data(), parts.size() * sizeof(int64_t));
+    }
+    catch (const std::runtime_error&) {
+      created = false;
+    }
+  }
+  if (!upcxx::broadcast(created, 0).wait()) {
+    throw std::runtime_error("cannot create " + filename);
+  }
+
+  {
+    _BinaryFile file(filename, O_WRONLY);
+    file.write(vals_offset + v.get_local_start() * sizeof(D), v.get_local_array_read(),
+               v.get_local_size() * sizeof(D));
+  }
+
+  upcxx::barrier();
+}
+
+template <typename I, typename D>
+void load_binary(const std::string& filename, Vec<I,D>& v)
+{
+  _BinaryFile file(filename, O_RDONLY);
+  _BinaryHeader h = _read_binary_header(file, filename, "SLAPSVEC");
+  _check_binary_size(file, h, filename, false);
+
+  if (v.allocated()) {
+    if (v.get_size() != I(h.rows)) {
+      throw std::invalid_argument("vector size does not match " + filename);
+    }
+  }
+  else {
+    v.allocate_elements(h.rows, _saved_partitioner<I>(file, h, 0));
+  }
+
+  size_t vals_offset = sizeof(h) + (h.nparts + 1) * sizeof(int64_t);
+  _read_values(file, vals_offset + v.get_local_start() * h.value_bytes, v.get_local_size(),
+               h.value_bytes, h.is_complex != 0, v.get_local_array(), false);
+
+  /* so that nobody reads our part before it is there */
+  upcxx::barrier();
+}
+
+template <typename I, typename D, typename MatT>
+void _read_petsc_binary(const std::string& filename, MatT& m, const Partitioner<I>& rows,
+                        const Partitioner<I>& cols)
+{
+  _BinaryFile file(filename, O_RDONLY);
+  bool swap = !_big_endian_host();
+
+  int32_t header[4];
+  _read_array<int32_t>(file, 0, 4, header, swap, _index_cast<int32_t>());
+  if (header[0] != _PETSC_MAT_CLASSID) {
+    throw std::runtime_error(filename + " is not a PETSc binary matrix file");
+  }
+
+  /* everyone reads the same header, so these throw on all ranks together */
+  if (header[1] < 0 || header[2] < 0 || header[3] < 0) {
+    throw std::runtime_error(filename + " has negative dimensions or nonzeros");
+  }
+
+  I M = header[1], N = header[2];
+  size_t nz = header[3];
+  size_t cols_offset = _PETSC_MAT_HEADER + size_t(M) * sizeof(int32_t);
+  size_t vals_offset = cols_offset + nz * sizeof(int32_t);
+
+  /* PETSc doesn't say whether its scalars are complex, but the size does */
+  size_t value_bytes = (nz && file.size() > vals_offset) ? (file.size() - vals_offset) / nz : sizeof(double);
+  if (value_bytes * nz + vals_offset != file.size() || (value_bytes != 8 && value_bytes != 16)) {
+    throw std::runtime_error(filename + " is not a PETSc matrix with 32-bit indices");
+  }
+
+  m.set_dimensions(M, N, rows, cols);
+
+  /* our row lengths, and where our rows start from everyone's */
+  I rstart, rend;
+  m.get_local_rows(rstart, rend);
+  std::vector<I> row_ptr(rend - rstart + 1, 0);
+  std::vector<int32_t> lengths(rend - rstart);
+  _read_array<int32_t>(file, _PETSC_MAT_HEADER + rstart * sizeof(int32_t), lengths.size(),
+                       lengths.data(), swap, _index_cast<int32_t>());
+
+  /* a negative length anywhere must stop everyone before any rank sizes its buffers */
+  bool bad = false;
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    bad = bad || (lengths[i] < 0);
+    row_ptr[i+1] = I(lengths[i]);
+  }
+  if (upcxx::allreduce(int(bad), [] (int a, int b) { return std::max(a, b); }).wait()) {
+    throw std::runtime_error("negative row lengths in " + filename);
+  }
+
+  for (size_t i = 1; i < row_ptr.size(); ++i) {
+    row_ptr[i] += row_ptr[i-1];
+  }
+
+  long long total;
+  long long first = _exclusive_sum(row_ptr.back(), total);
+  if (size_t(total) != nz) {
+    throw std::runtime_error("row lengths do not add up in " + filename);
+  }
+
+  size_t nnz = row_ptr.back();
+  std::vector<I> col_idx(nnz);
+  std::vector<D> vals(nnz);
+  _read_indices(file, cols_offset + first * sizeof(int32_t), nnz, 4, col_idx.data(), swap);
+  _read_values(file, vals_offset + first * value_bytes, nnz, value_bytes, value_bytes == 16,
+               vals.data(), swap);
+
+  _check_binary_rows(row_ptr, col_idx, N, filename);
+  _take_rows(m, row_ptr, col_idx, vals);
+}
+
+template <typename I, typename D>
+void read_petsc_binary(const std::string& filename, CSRMat<I,D>& m,
+                       const Partitioner<I>& rows, const Partitioner<I>& cols)
+{
+  _read_petsc_binary<I,D>(filename, m, rows, cols);
+}
+
+template <typename I, typename D>
+void read_petsc_binary(const std::string& filename, Mat<I,D>& m,
+                       const Partitioner<I>& rows, const Partitioner<I>& cols)
+{
+  _read_petsc_binary<I,D>(filename, m, rows, cols);
+}
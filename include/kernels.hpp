@@ -0,0 +1,1300 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include "threads.hpp"
+
+/*
+ * Compute kernels for the local (in-memory) part of the matrix products.
+ *
+ * _csr_plusdot does y += A*x for a CSR matrix whose column indices point
+ * straight into x. For float, double and their complex versions, it has
+ * explicit AVX2 and AVX-512 versions that gather x through the column
+ * indices; which one runs is picked at runtime from what the host CPU
+ * supports. Other types, and builds on other platforms (or with
+ * SLAPS_NO_SIMD defined), use the plain scalar loop.
+ *
+ * _sell_plusdot does the same for a matrix in SELL-C-sigma format (see
+ * SELLMat), where the vector instructions work across C rows at once instead
+ * of along a single row.
+ *
+ * _csr_plusdot_multi applies a CSR matrix to k vectors at once, stored
+ * row-major (see MultiVec), so each matrix entry is loaded once and used k
+ * times.
+ *
+ * The _threaded versions split the work over the threads of a ThreadPool
+ * (or just call the plain kernel if there is none).
+ *
+ * _bcsr_plusdot does the product for a block CSR matrix with R x C dense
+ * blocks (see BCSRMat). The block sizes are template parameters, so the
+ * per-block micro-kernel is completely unrolled at compile time.
+ *
+ * _sym_csr_plusdot does the product for a Hermitian matrix stored as its
+ * upper triangle (see SymCSRMat), using each stored entry for both triangles.
+ *
+ * _mixed_csr_plusdot does the product with the matrix values stored in a
+ * narrower type S (float, or bfloat16, defined here), converting each one
+ * as it is used and summing in the vectors' type (see MixedCSRMat).
+ *
+ * _delta_csr_plusdot does the product for a CSR matrix whose columns are
+ * stored as 16-bit gaps (see DeltaCSRMat), which cuts the index traffic to
+ * a quarter of 64-bit indices for rows whose columns are close together.
+ *
+ * _csr_plusdot_transpose and the _transpose versions of the other formats'
+ * kernels do y += A^T*x, where x is indexed by row and y by column. They
+ * scatter into y, so they stay scalar.
+ */
+
+#if !defined(SLAPS_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SLAPS_X86_SIMD
+#include <immintrin.h>
+#define SLAPS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SLAPS_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+/* the instruction sets the kernels can use, from least to most capable */
+enum simd_level_t {
+  SIMD_SCALAR = 0,
+  SIMD_AVX2 = 1,
+  SIMD_AVX512 = 2
+};
+
+/* the best SIMD level the host CPU supports */
+inline simd_level_t get_host_simd_level()
+{
+#ifdef SLAPS_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SIMD_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SIMD_AVX2;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+/* the level the kernels are currently using. starts out as the host's level */
+inline simd_level_t& _simd_level()
+{
+  static simd_level_t level = get_host_simd_level();
+  return level;
+}
+
+inline simd_level_t get_simd_level()
+{
+  return _simd_level();
+}
+
+/* set the SIMD level for the kernels to use (e.g. to compare against scalar) */
+inline void set_simd_level(simd_level_t level)
+{
+  if (level > get_host_simd_level()) {
+    throw std::invalid_argument("requested SIMD level is not supported by this CPU");
+  }
+  _simd_level() = level;
+}
+
+/*==================*/
+/*** scalar kernel ***/
+
+template <typename I, typename D>
+static void _csr_plusdot_scalar(I nrows, const I* row_ptr, const I* cols, const D* vals,
+                                const D* x_array, D* y_array)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D sum = 0;
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      sum += vals[j] * x_array[cols[j]];
+    }
+    y_array[i] += sum;
+  }
+}
+
+/*
+ * y[rows[k]] += (A*x)[k] for a SELL matrix of nrows rows in chunks of C. the
+ * entries of chunk c are stored column-major in [chunk_ptr[c], chunk_ptr[c+1])
+ * of cols and vals, so entry j of the chunk's r'th row is at
+ * chunk_ptr[c] + j*C + r. rows maps each row of the chunks to its row in y.
+ * padding entries have the column _sell_pad<I>(), and are skipped without
+ * reading x, so that an inf or NaN in x stays in the rows that use it.
+ */
+template <typename I>
+constexpr I _sell_pad()
+{
+  return std::numeric_limits<I>::max();
+}
+
+template <typename I, typename D>
+static void _sell_plusdot_scalar(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                 const D* vals, const D* x_array, D* y_array)
+{
+  std::vector<D> sums(C);
+  I nchunks = (nrows + C - 1) / C;
+  for (I c = 0; c < nchunks; ++c) {
+    std::fill(sums.begin(), sums.end(), D(0));
+    for (I j = chunk_ptr[c]; j < chunk_ptr[c+1]; j += C) {
+      for (I r = 0; r < C; ++r) {
+        if (cols[j+r] != _sell_pad<I>()) {
+          sums[r] += vals[j+r] * x_array[cols[j+r]];
+        }
+      }
+    }
+    I n = std::min(C, nrows - c*C);
+    for (I r = 0; r < n; ++r) {
+      y_array[rows[c*C + r]] += sums[r];
+    }
+  }
+}
+
+/*================*/
+/*** x86 kernels ***/
+
+/*
+ * _simd_csr<D> holds the SIMD kernels for values of type D. the generic
+ * version has none, and just falls back to the scalar loop.
+ */
+template <typename D>
+struct _simd_csr
+{
+  static const bool available = false;
+
+  template <typename I>
+  static void avx2(I nrows, const I* row_ptr, const I* cols, const D* vals, const D* x, D* y)
+  {
+    _csr_plusdot_scalar(nrows, row_ptr, cols, vals, x, y);
+  }
+
+  template <typename I>
+  static void avx512(I nrows, const I* row_ptr, const I* cols, const D* vals, const D* x, D* y)
+  {
+    _csr_plusdot_scalar(nrows, row_ptr, cols, vals, x, y);
+  }
+};
+
+/*
+ * _simd_sell<D> holds the SIMD SELL kernels, which handle W rows of a chunk
+ * per vector. they need C to be a multiple of W.
+ */
+template <typename D>
+struct _simd_sell
+{
+  static const bool available = false;
+  static const int avx2_width = 0;
+  static const int avx512_width = 0;
+
+  template <typename I>
+  static void avx2(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                   const D* vals, const D* x, D* y)
+  {
+    _sell_plusdot_scalar(nrows, C, chunk_ptr, rows, cols, vals, x, y);
+  }
+
+  template <typename I>
+  static void avx512(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                     const D* vals, const D* x, D* y)
+  {
+    _sell_plusdot_scalar(nrows, C, chunk_ptr, rows, cols, vals, x, y);
+  }
+};
+
+#ifdef SLAPS_X86_SIMD
+
+/*
+ * load column indices as 64-bit integers for the gathers. 32-bit indices are
+ * sign- or zero-extended according to I, so unsigned indices above 2^31 work.
+ */
+template <typename I>
+SLAPS_TARGET_AVX2 static inline __m256i _load_idx4(const I* p)
+{
+  if (sizeof(I) == 8) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  }
+  __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return std::is_signed<I>::value ? _mm256_cvtepi32_epi64(idx) : _mm256_cvtepu32_epi64(idx);
+}
+
+template <typename I>
+SLAPS_TARGET_AVX512 static inline __m512i _load_idx8(const I* p)
+{
+  if (sizeof(I) == 8) {
+    return _mm512_loadu_si512(reinterpret_cast<const void*>(p));
+  }
+  __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+  return std::is_signed<I>::value ? _mm512_cvtepi32_epi64(idx) : _mm512_cvtepu32_epi64(idx);
+}
+
+/*
+ * which of the indices loaded by _load_idx4 or _load_idx8 are not SELL padding,
+ * as a mask for the gathers. _sell_pad<I>() loads as its own value cast to
+ * 64 bits, whatever the size and sign of I
+ */
+template <typename I>
+SLAPS_TARGET_AVX2 static inline __m256i _sell_mask4(__m256i idx)
+{
+  __m256i pad = _mm256_cmpeq_epi64(idx, _mm256_set1_epi64x((long long)_sell_pad<I>()));
+  return _mm256_xor_si256(pad, _mm256_set1_epi64x(-1));
+}
+
+template <typename I>
+SLAPS_TARGET_AVX512 static inline __mmask8 _sell_mask8(__m512i idx)
+{
+  return _mm512_cmpneq_epi64_mask(idx, _mm512_set1_epi64((long long)_sell_pad<I>()));
+}
+
+/* the low 32 bits of each of four 64-bit mask lanes, for the float gathers */
+SLAPS_TARGET_AVX2 static inline __m128 _narrow_mask4(__m256i mask)
+{
+  __m256i lo = _mm256_permutevar8x32_epi32(mask, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+  return _mm_castsi128_ps(_mm256_castsi256_si128(lo));
+}
+
+SLAPS_TARGET_AVX2 static inline double _hsum_pd(__m256d v)
+{
+  __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+SLAPS_TARGET_AVX2 static inline float _hsum_ps(__m256 v)
+{
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+template <>
+struct _simd_csr<double>
+{
+  static const bool available = true;
+
+  template <typename I>
+  SLAPS_TARGET_AVX2 static void avx2(I nrows, const I* row_ptr, const I* cols,
+                                     const double* vals, const double* x, double* y)
+  {
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m256d acc = _mm256_setzero_pd();
+      for (; j + 4 <= end; j += 4) {
+        __m256d xv = _mm256_i64gather_pd(x, _load_idx4(cols + j), 8);
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(vals + j), xv, acc);
+      }
+      double sum = _hsum_pd(acc);
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+
+  template <typename I>
+  SLAPS_TARGET_AVX512 static void avx512(I nrows, const I* row_ptr, const I* cols,
+                                         const double* vals, const double* x, double* y)
+  {
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m512d acc = _mm512_setzero_pd();
+      for (; j + 8 <= end; j += 8) {
+        __m512d xv = _mm512_i64gather_pd(_load_idx8(cols + j), x, 8);
+        acc = _mm512_fmadd_pd(_mm512_loadu_pd(vals + j), xv, acc);
+      }
+      double sum = _mm512_reduce_add_pd(acc);
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+};
+
+template <>
+struct _simd_csr<float>
+{
+  static const bool available = true;
+
+  template <typename I>
+  SLAPS_TARGET_AVX2 static void avx2(I nrows, const I* row_ptr, const I* cols,
+                                     const float* vals, const float* x, float* y)
+  {
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m256 acc = _mm256_setzero_ps();
+      for (; j + 8 <= end; j += 8) {
+        __m128 lo = _mm256_i64gather_ps(x, _load_idx4(cols + j), 4);
+        __m128 hi = _mm256_i64gather_ps(x, _load_idx4(cols + j + 4), 4);
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(vals + j), _mm256_set_m128(hi, lo), acc);
+      }
+      float sum = _hsum_ps(acc);
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+
+  template <typename I>
+  SLAPS_TARGET_AVX512 static void avx512(I nrows, const I* row_ptr, const I* cols,
+                                         const float* vals, const float* x, float* y)
+  {
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m512 acc = _mm512_setzero_ps();
+      for (; j + 16 <= end; j += 16) {
+        __m256 lo = _mm512_i64gather_ps(_load_idx8(cols + j), x, 4);
+        __m256 hi = _mm512_i64gather_ps(_load_idx8(cols + j + 8), x, 4);
+        __m512 xv = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)),
+                                                        _mm256_castps_pd(hi), 1));
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(vals + j), xv, acc);
+      }
+      float sum = _mm512_reduce_add_ps(acc);
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+};
+
+/*
+ * the complex kernels work on the interleaved (real, imaginary) pairs. with
+ * a = vals[j] and b = x[col], the real parts of a are broadcast against b, and
+ * the imaginary parts against b with its halves swapped; fmaddsub then
+ * gives (a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re) in each pair.
+ */
+template <>
+struct _simd_csr< std::complex<double> >
+{
+  typedef std::complex<double> C;
+
+  static const bool available = true;
+
+  template <typename I>
+  SLAPS_TARGET_AVX2 static void avx2(I nrows, const I* row_ptr, const I* cols,
+                                     const C* vals, const C* x, C* y)
+  {
+    const double* vd = reinterpret_cast<const double*>(vals);
+    const double* xd = reinterpret_cast<const double*>(x);
+
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m256d acc = _mm256_setzero_pd();
+      for (; j + 2 <= end; j += 2) {
+        /* each complex value is one 128-bit load */
+        __m256d xv = _mm256_set_m128d(_mm_loadu_pd(xd + 2*cols[j+1]), _mm_loadu_pd(xd + 2*cols[j]));
+        __m256d v = _mm256_loadu_pd(vd + 2*j);
+        __m256d re = _mm256_movedup_pd(v);
+        __m256d im = _mm256_permute_pd(v, 0xF);
+        __m256d xs = _mm256_permute_pd(xv, 0x5);
+        acc = _mm256_add_pd(acc, _mm256_fmaddsub_pd(re, xv, _mm256_mul_pd(im, xs)));
+      }
+      __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+      C sum(_mm_cvtsd_f64(s), _mm_cvtsd_f64(_mm_unpackhi_pd(s, s)));
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+
+  template <typename I>
+  SLAPS_TARGET_AVX512 static void avx512(I nrows, const I* row_ptr, const I* cols,
+                                         const C* vals, const C* x, C* y)
+  {
+    const double* vd = reinterpret_cast<const double*>(vals);
+    const double* xd = reinterpret_cast<const double*>(x);
+
+    /* turn 4 column indices into the 8 indices of their real and imaginary parts */
+    const __m512i dup = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+    const __m512i parts = _mm512_set_epi64(1, 0, 1, 0, 1, 0, 1, 0);
+
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m512d acc = _mm512_setzero_pd();
+      for (; j + 4 <= end; j += 4) {
+        __m512i idx = _mm512_permutexvar_epi64(dup, _mm512_castsi256_si512(_load_idx4(cols + j)));
+        idx = _mm512_add_epi64(_mm512_slli_epi64(idx, 1), parts);
+        __m512d xv = _mm512_i64gather_pd(idx, xd, 8);
+        __m512d v = _mm512_loadu_pd(vd + 2*j);
+        __m512d re = _mm512_movedup_pd(v);
+        __m512d im = _mm512_permute_pd(v, 0xFF);
+        __m512d xs = _mm512_permute_pd(xv, 0x55);
+        acc = _mm512_add_pd(acc, _mm512_fmaddsub_pd(re, xv, _mm512_mul_pd(im, xs)));
+      }
+      C sum(_mm512_mask_reduce_add_pd(0x55, acc), _mm512_mask_reduce_add_pd(0xAA, acc));
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+};
+
+template <>
+struct _simd_csr< std::complex<float> >
+{
+  typedef std::complex<float> C;
+
+  static const bool available = true;
+
+  template <typename I>
+  SLAPS_TARGET_AVX2 static void avx2(I nrows, const I* row_ptr, const I* cols,
+                                     const C* vals, const C* x, C* y)
+  {
+    const float* vf = reinterpret_cast<const float*>(vals);
+
+    /* a complex float is 64 bits, so gather them as doubles */
+    const double* xd = reinterpret_cast<const double*>(x);
+
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m256 acc = _mm256_setzero_ps();
+      for (; j + 4 <= end; j += 4) {
+        __m256 xv = _mm256_castpd_ps(_mm256_i64gather_pd(xd, _load_idx4(cols + j), 8));
+        __m256 v = _mm256_loadu_ps(vf + 2*j);
+        __m256 re = _mm256_moveldup_ps(v);
+        __m256 im = _mm256_movehdup_ps(v);
+        __m256 xs = _mm256_permute_ps(xv, 0xB1);
+        acc = _mm256_add_ps(acc, _mm256_fmaddsub_ps(re, xv, _mm256_mul_ps(im, xs)));
+      }
+      __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+      s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+      C sum(_mm_cvtss_f32(s), _mm_cvtss_f32(_mm_shuffle_ps(s, s, 1)));
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+
+  template <typename I>
+  SLAPS_TARGET_AVX512 static void avx512(I nrows, const I* row_ptr, const I* cols,
+                                         const C* vals, const C* x, C* y)
+  {
+    const float* vf = reinterpret_cast<const float*>(vals);
+    const double* xd = reinterpret_cast<const double*>(x);
+
+    for (I i = 0; i < nrows; ++i) {
+      I j = row_ptr[i], end = row_ptr[i+1];
+      __m512 acc = _mm512_setzero_ps();
+      for (; j + 8 <= end; j += 8) {
+        __m512 xv = _mm512_castpd_ps(_mm512_i64gather_pd(_load_idx8(cols + j), xd, 8));
+        __m512 v = _mm512_loadu_ps(vf + 2*j);
+        __m512 re = _mm512_moveldup_ps(v);
+        __m512 im = _mm512_movehdup_ps(v);
+        __m512 xs = _mm512_permute_ps(xv, 0xB1);
+        acc = _mm512_add_ps(acc, _mm512_fmaddsub_ps(re, xv, _mm512_mul_ps(im, xs)));
+      }
+      C sum(_mm512_mask_reduce_add_ps(0x5555, acc), _mm512_mask_reduce_add_ps(0xAAAA, acc));
+      for (; j < end; ++j) {
+        sum += vals[j] * x[cols[j]];
+      }
+      y[i] += sum;
+    }
+  }
+};
+
+template <>
+struct _simd_sell<double>
+{
+  static const bool available = true;
+  static const int avx2_width = 4;
+  static const int avx512_width = 8;
+
+  template <typename I>
+  SLAPS_TARGET_AVX2 static void avx2(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                     const double* vals, const double* x, double* y)
+  {
+    double sums[4];
+    I nchunks = (nrows + C - 1) / C;
+    for (I c = 0; c < nchunks; ++c) {
+      I n = std::min(C, nrows - c*C);
+      for (I g = 0; g < n; g += 4) {
+        __m256d acc = _mm256_setzero_pd();
+        for (I j = chunk_ptr[c] + g; j < chunk_ptr[c+1]; j += C) {
+          __m256i idx = _load_idx4(cols + j);
+          __m256d xv = _mm256_mask_i64gather_pd(_mm256_setzero_pd(), x, idx,
+                                                _mm256_castsi256_pd(_sell_mask4<I>(idx)), 8);
+          acc = _mm256_fmadd_pd(_mm256_loadu_pd(vals + j), xv, acc);
+        }
+        _mm256_storeu_pd(sums, acc);
+        for (I r = g; r < std::min(g + 4, n); ++r) {
+          y[rows[c*C + r]] += sums[r - g];
+        }
+      }
+    }
+  }
+
+  template <typename I>
+  SLAPS_TARGET_AVX512 static void avx512(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                         const double* vals, const double* x, double* y)
+  {
+    double sums[8];
+    I nchunks = (nrows + C - 1) / C;
+    for (I c = 0; c < nchunks; ++c) {
+      I n = std::min(C, nrows - c*C);
+      for (I g = 0; g < n; g += 8) {
+        __m512d acc = _mm512_setzero_pd();
+        for (I j = chunk_ptr[c] + g; j < chunk_ptr[c+1]; j += C) {
+          __m512i idx = _load_idx8(cols + j);
+          __m512d xv = _mm512_mask_i64gather_pd(_mm512_setzero_pd(), _sell_mask8<I>(idx), idx, x, 8);
+          acc = _mm512_fmadd_pd(_mm512_loadu_pd(vals + j), xv, acc);
+        }
+        _mm512_storeu_pd(sums, acc);
+        for (I r = g; r < std::min(g + 8, n); ++r) {
+          y[rows[c*C + r]] += sums[r - g];
+        }
+      }
+    }
+  }
+};
+
+template <>
+struct _simd_sell<float>
+{
+  static const bool available = true;
+  static const int avx2_width = 8;
+  static const int avx512_width = 16;
+
+  template <typename I>
+  SLAPS_TARGET_AVX2 static void avx2(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                     const float* vals, const float* x, float* y)
+  {
+    float sums[8];
+    I nchunks = (nrows + C - 1) / C;
+    for (I c = 0; c < nchunks; ++c) {
+      I n = std::min(C, nrows - c*C);
+      for (I g = 0; g < n; g += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (I j = chunk_ptr[c] + g; j < chunk_ptr[c+1]; j += C) {
+          __m256i idx_lo = _load_idx4(cols + j), idx_hi = _load_idx4(cols + j + 4);
+          __m128 lo = _mm256_mask_i64gather_ps(_mm_setzero_ps(), x, idx_lo,
+                                               _narrow_mask4(_sell_mask4<I>(idx_lo)), 4);
+          __m128 hi = _mm256_mask_i64gather_ps(_mm_setzero_ps(), x, idx_hi,
+                                               _narrow_mask4(_sell_mask4<I>(idx_hi)), 4);
+          acc = _mm256_fmadd_ps(_mm256_loadu_ps(vals + j), _mm256_set_m128(hi, lo), acc);
+        }
+        _mm256_storeu_ps(sums, acc);
+        for (I r = g; r < std::min(g + 8, n); ++r) {
+          y[rows[c*C + r]] += sums[r - g];
+        }
+      }
+    }
+  }
+
+  template <typename I>
+  SLAPS_TARGET_AVX512 static void avx512(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                         const float* vals, const float* x, float* y)
+  {
+    float sums[16];
+    I nchunks = (nrows + C - 1) / C;
+    for (I c = 0; c < nchunks; ++c) {
+      I n = std::min(C, nrows - c*C);
+      for (I g = 0; g < n; g += 16) {
+        __m512 acc = _mm512_setzero_ps();
+        for (I j = chunk_ptr[c] + g; j < chunk_ptr[c+1]; j += C) {
+          __m512i idx_lo = _load_idx8(cols + j), idx_hi = _load_idx8(cols + j + 8);
+          __m256 lo = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), _sell_mask8<I>(idx_lo), idx_lo, x, 4);
+          __m256 hi = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), _sell_mask8<I>(idx_hi), idx_hi, x, 4);
+          __m512 xv = _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)),
+                                                          _mm256_castps_pd(hi), 1));
+          acc = _mm512_fmadd_ps(_mm512_loadu_ps(vals + j), xv, acc);
+        }
+        _mm512_storeu_ps(sums, acc);
+        for (I r = g; r < std::min(g + 16, n); ++r) {
+          y[rows[c*C + r]] += sums[r - g];
+        }
+      }
+    }
+  }
+};
+
+#endif
+
+/*=================*/
+/*** dispatching ***/
+
+/* y += A*x for a CSR matrix with nrows rows, whose columns index directly into x */
+template <typename I, typename D>
+static void _csr_plusdot(I nrows, const I* row_ptr, const I* cols, const D* vals,
+                         const D* x_array, D* y_array)
+{
+#ifdef SLAPS_X86_SIMD
+  /* the gathers take 32 or 64 bit indices */
+  if (_simd_csr<D>::available && std::is_integral<I>::value && (sizeof(I) == 4 || sizeof(I) == 8)) {
+    switch (get_simd_level()) {
+      case SIMD_AVX512:
+        _simd_csr<D>::avx512(nrows, row_ptr, cols, vals, x_array, y_array);
+        return;
+      case SIMD_AVX2:
+        _simd_csr<D>::avx2(nrows, row_ptr, cols, vals, x_array, y_array);
+        return;
+      default:
+        break;
+    }
+  }
+#endif
+
+  _csr_plusdot_scalar(nrows, row_ptr, cols, vals, x_array, y_array);
+}
+
+/* y[rows[k]] += (A*x)[k] for a SELL matrix, see _sell_plusdot_scalar */
+template <typename I, typename D>
+static void _sell_plusdot(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                          const D* vals, const D* x_array, D* y_array)
+{
+#ifdef SLAPS_X86_SIMD
+  if (_simd_sell<D>::available && std::is_integral<I>::value && (sizeof(I) == 4 || sizeof(I) == 8)) {
+    simd_level_t level = get_simd_level();
+    if (level >= SIMD_AVX512 && C % _simd_sell<D>::avx512_width == 0) {
+      _simd_sell<D>::avx512(nrows, C, chunk_ptr, rows, cols, vals, x_array, y_array);
+      return;
+    }
+    if (level >= SIMD_AVX2 && C % _simd_sell<D>::avx2_width == 0) {
+      _simd_sell<D>::avx2(nrows, C, chunk_ptr, rows, cols, vals, x_array, y_array);
+      return;
+    }
+  }
+#endif
+
+  _sell_plusdot_scalar(nrows, C, chunk_ptr, rows, cols, vals, x_array, y_array);
+}
+
+/*=======================*/
+/*** threaded versions ***/
+
+/*
+ * _csr_plusdot, split over the threads by merge path (see threads.hpp). a
+ * thread that stops partway through a row leaves its partial sum in a carry,
+ * which is added once all the threads are done
+ */
+template <typename I, typename D>
+static void _csr_plusdot_threaded(ThreadPool* pool, I nrows, const I* row_ptr, const I* cols,
+                                  const D* vals, const D* x_array, D* y_array)
+{
+  if (pool == nullptr || pool->get_num_threads() == 1 || nrows == 0) {
+    _csr_plusdot(nrows, row_ptr, cols, vals, x_array, y_array);
+    return;
+  }
+
+  int nthreads = pool->get_num_threads();
+  unsigned long long path = nrows + (row_ptr[nrows] - row_ptr[0]);
+
+  std::vector<I> carry_row(nthreads);
+  std::vector<D> carry_val(nthreads);
+
+  pool->run([&] (int t) {
+    I row, nz, end_row, end_nz;
+    _merge_path_search(I(path * t / nthreads), nrows, row_ptr, row, nz);
+    _merge_path_search(I(path * (t+1) / nthreads), nrows, row_ptr, end_row, end_nz);
+
+    if (row < end_row) {
+      /* the rest of the row we start in the middle of */
+      D sum = 0;
+      for (I j = nz; j < row_ptr[row+1]; ++j) {
+        sum += vals[j] * x_array[cols[j]];
+      }
+      y_array[row] += sum;
+
+      /* then the rows that are all ours */
+      _csr_plusdot(I(end_row - row - 1), row_ptr + row + 1, cols, vals, x_array, y_array + row + 1);
+
+      nz = row_ptr[end_row];
+    }
+
+    /* the start of the row we end in the middle of */
+    D sum = 0;
+    for (I j = nz; j < end_nz; ++j) {
+      sum += vals[j] * x_array[cols[j]];
+    }
+    carry_row[t] = end_row;
+    carry_val[t] = sum;
+  });
+
+  for (int t = 0; t < nthreads; ++t) {
+    if (carry_row[t] < nrows) {
+      y_array[carry_row[t]] += carry_val[t];
+    }
+  }
+}
+
+/* _sell_plusdot, with whole chunks split over the threads by their number of entries */
+template <typename I, typename D>
+static void _sell_plusdot_threaded(ThreadPool* pool, I nrows, I C, const I* chunk_ptr, const I* rows,
+                                   const I* cols, const D* vals, const D* x_array, D* y_array)
+{
+  if (pool == nullptr || pool->get_num_threads() == 1) {
+    _sell_plusdot(nrows, C, chunk_ptr, rows, cols, vals, x_array, y_array);
+    return;
+  }
+
+  I nchunks = (nrows + C - 1) / C;
+
+  /* chunks write to different rows of y, so the threads never collide */
+  pool->run([&] (int t) {
+    I start, end;
+    _balanced_range(chunk_ptr, nchunks, t, pool->get_num_threads(), start, end);
+    if (start < end) {
+      _sell_plusdot(std::min(nrows, end*C) - start*C, C, chunk_ptr + start, rows + start*C,
+                    cols, vals, x_array, y_array);
+    }
+  });
+}
+
+/*====================*/
+/*** multi-vectors ***/
+
+/* y += A*x for K vectors, with K known at compile time so the sums stay in registers */
+template <int K, typename I, typename D>
+static void _csr_plusdot_multi_fixed(I nrows, const I* row_ptr, const I* cols, const D* vals,
+                                     const D* x_array, D* y_array)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D sums[K];
+    for (int t = 0; t < K; ++t) {
+      sums[t] = y_array[i*K + t];
+    }
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      const D v = vals[j];
+      const D* xj = x_array + cols[j]*K;
+      for (int t = 0; t < K; ++t) {
+        sums[t] += v * xj[t];
+      }
+    }
+    for (int t = 0; t < K; ++t) {
+      y_array[i*K + t] = sums[t];
+    }
+  }
+}
+
+/*
+ * y += A*x for a CSR matrix applied to k vectors, stored row-major: entry t
+ * of row r is at [r*k + t] in both x and y
+ */
+template <typename I, typename D>
+static void _csr_plusdot_multi(I nrows, const I* row_ptr, const I* cols, const D* vals,
+                               const D* x_array, D* y_array, int k)
+{
+  switch (k) {
+    case 1:
+      _csr_plusdot(nrows, row_ptr, cols, vals, x_array, y_array);
+      return;
+    case 2:
+      _csr_plusdot_multi_fixed<2>(nrows, row_ptr, cols, vals, x_array, y_array);
+      return;
+    case 4:
+      _csr_plusdot_multi_fixed<4>(nrows, row_ptr, cols, vals, x_array, y_array);
+      return;
+    case 8:
+      _csr_plusdot_multi_fixed<8>(nrows, row_ptr, cols, vals, x_array, y_array);
+      return;
+    default:
+      break;
+  }
+
+  for (I i = 0; i < nrows; ++i) {
+    D* yi = y_array + i*k;
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      const D v = vals[j];
+      const D* xj = x_array + cols[j]*k;
+      for (int t = 0; t < k; ++t) {
+        yi[t] += v * xj[t];
+      }
+    }
+  }
+}
+
+/* y += A*x for a SELL matrix applied to k row-major vectors (see _csr_plusdot_multi) */
+template <typename I, typename D>
+static void _sell_plusdot_multi(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                const D* vals, const D* x_array, D* y_array, int k)
+{
+  if (k == 1) {
+    _sell_plusdot(nrows, C, chunk_ptr, rows, cols, vals, x_array, y_array);
+    return;
+  }
+
+  I nchunks = (nrows + C - 1) / C;
+  for (I c = 0; c < nchunks; ++c) {
+    I n = std::min(C, nrows - c*C);
+    for (I r = 0; r < n; ++r) {
+      D* yr = y_array + rows[c*C + r]*k;
+      for (I j = chunk_ptr[c] + r; j < chunk_ptr[c+1]; j += C) {
+        if (cols[j] == _sell_pad<I>()) {
+          continue;
+        }
+        const D v = vals[j];
+        const D* xj = x_array + cols[j]*k;
+        for (int t = 0; t < k; ++t) {
+          yr[t] += v * xj[t];
+        }
+      }
+    }
+  }
+}
+
+/*===============*/
+/*** block CSR ***/
+
+/*
+ * sums[r] += (B*x)[r] for one row-major R x C block B. _bcsr_block<R,C,K>
+ * does the last K entries of the block and recurses, so the whole block
+ * unrolls into straight-line code.
+ */
+template <int R, int C, int K>
+struct _bcsr_block
+{
+  template <typename D>
+  static inline void apply(const D* vals, const D* x, D* sums)
+  {
+    const int k = R*C - K;
+    sums[k / C] += vals[k] * x[k % C];
+    _bcsr_block<R, C, K-1>::apply(vals, x, sums);
+  }
+};
+
+template <int R, int C>
+struct _bcsr_block<R, C, 0>
+{
+  template <typename D>
+  static inline void apply(const D*, const D*, D*) {}
+};
+
+/*
+ * y += A*x for a block CSR matrix of nrows rows, with R x C blocks stored
+ * row-major one after another in vals. block row b covers rows [b*R, b*R+R)
+ * (the last one may be cut off by nrows), and its blocks are
+ * [brow_ptr[b], brow_ptr[b+1]). block k multiplies the C values of x
+ * starting at x_array + cols[k].
+ */
+template <int R, int C, typename I, typename D>
+static void _bcsr_plusdot(I nrows, const I* brow_ptr, const I* cols, const D* vals,
+                          const D* x_array, D* y_array)
+{
+  I nbrows = (nrows + R - 1) / R;
+  for (I b = 0; b < nbrows; ++b) {
+    D sums[R];
+    std::fill(sums, sums + R, D(0));
+    for (I k = brow_ptr[b]; k < brow_ptr[b+1]; ++k) {
+      _bcsr_block<R, C, R*C>::apply(vals + k*R*C, x_array + cols[k], sums);
+    }
+    I n = std::min(I(R), nrows - b*R);
+    for (I r = 0; r < n; ++r) {
+      y_array[b*R + r] += sums[r];
+    }
+  }
+}
+
+/* y += A*x for a block CSR matrix applied to k row-major vectors (see _csr_plusdot_multi) */
+template <int R, int C, typename I, typename D>
+static void _bcsr_plusdot_multi(I nrows, const I* brow_ptr, const I* cols, const D* vals,
+                                const D* x_array, D* y_array, int k)
+{
+  if (k == 1) {
+    _bcsr_plusdot<R, C>(nrows, brow_ptr, cols, vals, x_array, y_array);
+    return;
+  }
+
+  std::vector<D> sums(R*k);
+  I nbrows = (nrows + R - 1) / R;
+  for (I b = 0; b < nbrows; ++b) {
+    std::fill(sums.begin(), sums.end(), D(0));
+    for (I blk = brow_ptr[b]; blk < brow_ptr[b+1]; ++blk) {
+      const D* v = vals + blk*R*C;
+      const D* xb = x_array + cols[blk]*k;
+      for (int r = 0; r < R; ++r) {
+        for (int c = 0; c < C; ++c) {
+          for (int t = 0; t < k; ++t) {
+            sums[r*k + t] += v[r*C + c] * xb[c*k + t];
+          }
+        }
+      }
+    }
+    I n = std::min(I(R), nrows - b*R);
+    for (I r = 0; r < n; ++r) {
+      for (int t = 0; t < k; ++t) {
+        y_array[(b*R + r)*k + t] += sums[r*k + t];
+      }
+    }
+  }
+}
+
+/* _bcsr_plusdot, with whole block rows split over the threads by their number of blocks */
+template <int R, int C, typename I, typename D>
+static void _bcsr_plusdot_threaded(ThreadPool* pool, I nrows, const I* brow_ptr, const I* cols,
+                                   const D* vals, const D* x_array, D* y_array)
+{
+  if (pool == nullptr || pool->get_num_threads() == 1) {
+    _bcsr_plusdot<R, C>(nrows, brow_ptr, cols, vals, x_array, y_array);
+    return;
+  }
+
+  I nbrows = (nrows + R - 1) / R;
+
+  pool->run([&] (int t) {
+    I start, end;
+    _balanced_range(brow_ptr, nbrows, t, pool->get_num_threads(), start, end);
+    if (start < end) {
+      _bcsr_plusdot<R, C>(std::min(nrows, end*R) - start*R, brow_ptr + start, cols, vals,
+                          x_array, y_array + start*R);
+    }
+  });
+}
+
+/*=================*/
+/*** transposes ***/
+
+/* y += A^T * x for a CSR matrix: x is indexed by row, and y by column */
+template <typename I, typename D>
+static void _csr_plusdot_transpose(I nrows, const I* row_ptr, const I* cols, const D* vals,
+                                   const D* x_array, D* y_array)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D x_i = x_array[i];
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      y_array[cols[j]] += vals[j] * x_i;
+    }
+  }
+}
+
+/* the same for SELL, skipping the padding */
+template <typename I, typename D>
+static void _sell_plusdot_transpose(I nrows, I C, const I* chunk_ptr, const I* rows, const I* cols,
+                                    const D* vals, const D* x_array, D* y_array)
+{
+  I nchunks = (nrows + C - 1) / C;
+  for (I c = 0; c < nchunks; ++c) {
+    I height = std::min(C, nrows - c*C);
+    for (I j = chunk_ptr[c]; j < chunk_ptr[c+1]; j += C) {
+      for (I r = 0; r < height; ++r) {
+        if (cols[j + r] != _sell_pad<I>()) {
+          y_array[cols[j + r]] += vals[j + r] * x_array[rows[c*C + r]];
+        }
+      }
+    }
+  }
+}
+
+/* the same for block CSR. a partial last block row is skipped past its end */
+template <int R, int C, typename I, typename D>
+static void _bcsr_plusdot_transpose(I nrows, const I* brow_ptr, const I* cols, const D* vals,
+                                    const D* x_array, D* y_array)
+{
+  I nbrows = (nrows + R - 1) / R;
+  for (I b = 0; b < nbrows; ++b) {
+    I height = std::min(I(R), nrows - b*R);
+    const D* x_block = x_array + b*R;
+    for (I k = brow_ptr[b]; k < brow_ptr[b+1]; ++k) {
+      const D* block = vals + k*R*C;
+      D* y_block = y_array + cols[k];
+      for (I r = 0; r < height; ++r) {
+        for (int c = 0; c < C; ++c) {
+          y_block[c] += block[r*C + c] * x_block[r];
+        }
+      }
+    }
+  }
+}
+
+/*=================*/
+/*** symmetric ***/
+
+/* complex conjugate, which does nothing for real types */
+template <typename D>
+inline D _conj(const D& v)
+{
+  return v;
+}
+
+template <typename T>
+inline std::complex<T> _conj(const std::complex<T>& v)
+{
+  return std::conj(v);
+}
+
+/*
+ * the strictly upper triangular part of a Hermitian matrix in CSR, used for
+ * both triangles in one sweep: y_row[i] += A(i,j) * x_col[j], and
+ * y_col[j] += conj(A(i,j)) * x_row[i]. for the block on the diagonal, the
+ * row and column vectors are the same ones. with transpose, the conjugates
+ * go the other way round, since A^T = conj(A).
+ */
+template <typename I, typename D>
+static void _sym_csr_plusdot(I nrows, const I* row_ptr, const I* cols, const D* vals,
+                             const D* x_row, const D* x_col, D* y_row, D* y_col, bool transpose)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D x_i = x_row[i];
+    D sum = 0;
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      D a = transpose ? _conj(vals[j]) : vals[j];
+      sum += a * x_col[cols[j]];
+      y_col[cols[j]] += _conj(a) * x_i;
+    }
+    y_row[i] += sum;
+  }
+}
+
+/*=======================*/
+/*** delta-encoded CSR ***/
+
+/*
+ * the columns of each row (sorted, and local indices of type L, the width
+ * of a ghost or diagonal block index) are stored as 16-bit codes. the first
+ * is the signed distance from the row index, zigzag-encoded (0, -1, 1, -2,
+ * ... as 0, 1, 2, 3, ...), so a banded matrix needs no big jumps; the rest
+ * are the gaps from the previous column. a code that doesn't fit is stored
+ * as the escape code followed by the whole column, as sizeof(L)/2 16-bit
+ * words, low word first
+ */
+static const uint16_t _DELTA_ESCAPE = 0xFFFF;
+
+/* append the codes for the n sorted columns of row */
+template <typename L, typename I>
+static void _delta_encode(I row, I n, const I* cols, std::vector<uint16_t>& codes)
+{
+  static_assert(sizeof(L) % 2 == 0, "local index type must be a whole number of 16-bit words");
+
+  for (I j = 0; j < n; ++j) {
+    unsigned long long code;
+    if (j == 0) {
+      long long diff = (long long)(cols[j]) - (long long)(row);
+      code = diff >= 0 ? 2*(unsigned long long)(diff) : 2*(unsigned long long)(-diff) - 1;
+    }
+    else {
+      code = cols[j] - cols[j-1];
+    }
+
+    if (code < _DELTA_ESCAPE) {
+      codes.push_back(uint16_t(code));
+    }
+    else {
+      codes.push_back(_DELTA_ESCAPE);
+      L col = L(cols[j]);
+      for (size_t w = 0; w < sizeof(L)/2; ++w) {
+        codes.push_back(uint16_t(col >> (16*w)));
+      }
+    }
+  }
+}
+
+/* decode a column that followed the escape code, advancing codes */
+template <typename L>
+inline L _delta_full(const uint16_t*& codes)
+{
+  L full = 0;
+  for (size_t w = 0; w < sizeof(L)/2; ++w) {
+    full |= L(*codes++) << (16*w);
+  }
+  return full;
+}
+
+/* decode the first column of row, advancing codes */
+template <typename L>
+inline L _delta_first(const uint16_t*& codes, L row)
+{
+  uint16_t code = *codes++;
+  if (code == _DELTA_ESCAPE) {
+    return _delta_full<L>(codes);
+  }
+  L off = L(code >> 1);
+  return (code & 1) ? L(row - off - 1) : L(row + off);
+}
+
+/* decode the column after col, advancing codes */
+template <typename L>
+inline L _delta_next(const uint16_t*& codes, L col)
+{
+  uint16_t code = *codes++;
+  if (code == _DELTA_ESCAPE) {
+    return _delta_full<L>(codes);
+  }
+  return col + code;
+}
+
+/*
+ * y += A*x for a delta-encoded CSR matrix. the values of row i are
+ * vals[row_ptr[i]..row_ptr[i+1]), its codes start at codes[code_ptr[i]], and
+ * it was encoded as row first_row + i
+ */
+template <typename L, typename I, typename D>
+static void _delta_csr_plusdot(I nrows, const I* row_ptr, const I* code_ptr, const uint16_t* codes,
+                               const D* vals, const D* x_array, D* y_array, I first_row = 0)
+{
+  for (I i = 0; i < nrows; ++i) {
+    if (row_ptr[i] == row_ptr[i+1]) {
+      continue;
+    }
+    const uint16_t* c = codes + code_ptr[i];
+    L col = _delta_first(c, L(first_row + i));
+    D sum = vals[row_ptr[i]] * x_array[col];
+    for (I j = row_ptr[i] + 1; j < row_ptr[i+1]; ++j) {
+      col = _delta_next(c, col);
+      sum += vals[j] * x_array[col];
+    }
+    y_array[i] += sum;
+  }
+}
+
+/* the same, for k vectors stored row-major */
+template <typename L, typename I, typename D>
+static void _delta_csr_plusdot_multi(I nrows, const I* row_ptr, const I* code_ptr,
+                                     const uint16_t* codes, const D* vals, const D* x_array,
+                                     D* y_array, int k)
+{
+  for (I i = 0; i < nrows; ++i) {
+    const uint16_t* c = codes + code_ptr[i];
+    L col = 0;
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      col = (j == row_ptr[i]) ? _delta_first(c, L(i)) : _delta_next(c, col);
+      const D v = vals[j];
+      const D* xj = x_array + size_t(col)*k;
+      for (int t = 0; t < k; ++t) {
+        y_array[i*k + t] += v * xj[t];
+      }
+    }
+  }
+}
+
+/* split the rows between the threads by their number of nonzeros */
+template <typename L, typename I, typename D>
+static void _delta_csr_plusdot_threaded(ThreadPool* pool, I nrows, const I* row_ptr,
+                                        const I* code_ptr, const uint16_t* codes, const D* vals,
+                                        const D* x_array, D* y_array)
+{
+  if (pool == nullptr || pool->get_num_threads() == 1) {
+    _delta_csr_plusdot<L>(nrows, row_ptr, code_ptr, codes, vals, x_array, y_array);
+    return;
+  }
+
+  pool->run([&] (int t) {
+    I start, end;
+    _balanced_range(row_ptr, nrows, t, pool->get_num_threads(), start, end);
+    _delta_csr_plusdot<L>(end - start, row_ptr + start, code_ptr + start, codes, vals,
+                          x_array, y_array + start, start);
+  });
+}
+
+/* y += A^T*x for a delta-encoded CSR matrix */
+template <typename L, typename I, typename D>
+static void _delta_csr_plusdot_transpose(I nrows, const I* row_ptr, const I* code_ptr,
+                                         const uint16_t* codes, const D* vals,
+                                         const D* x_array, D* y_array)
+{
+  for (I i = 0; i < nrows; ++i) {
+    const uint16_t* c = codes + code_ptr[i];
+    L col = 0;
+    D x_i = x_array[i];
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      col = (j == row_ptr[i]) ? _delta_first(c, L(i)) : _delta_next(c, col);
+      y_array[col] += vals[j] * x_i;
+    }
+  }
+}
+
+/*=======================*/
+/*** mixed precision ***/
+
+/*
+ * bfloat16 is the top half of a float: the same range, with 8 bits of
+ * mantissa. this is the plain software version, for storage only: values
+ * are rounded to nearest even going in, and widened to float to be used
+ */
+struct bfloat16
+{
+  uint16_t bits = 0;
+
+  bfloat16() {}
+
+  bfloat16(float f)
+  {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7FFFFFFF) > 0x7F800000) {
+      /* keep NaNs NaN, whatever their low bits */
+      bits = uint16_t((u >> 16) | 0x40);
+    }
+    else {
+      u += 0x7FFF + ((u >> 16) & 1);
+      bits = uint16_t(u >> 16);
+    }
+  }
+
+  operator float() const
+  {
+    uint32_t u = uint32_t(bits) << 16;
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+};
+
+/* y += A*x for a CSR matrix with values stored as S, summed as D */
+template <typename I, typename S, typename D>
+static void _mixed_csr_plusdot(I nrows, const I* row_ptr, const I* cols, const S* vals,
+                               const D* x_array, D* y_array)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D sum = 0;
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      sum += D(vals[j]) * x_array[cols[j]];
+    }
+    y_array[i] += sum;
+  }
+}
+
+/* split the rows between the threads by their number of nonzeros */
+template <typename I, typename S, typename D>
+static void _mixed_csr_plusdot_threaded(ThreadPool* pool, I nrows, const I* row_ptr, const I* cols,
+                                        const S* vals, const D* x_array, D* y_array)
+{
+  if (pool == nullptr || pool->get_num_threads() == 1) {
+    _mixed_csr_plusdot(nrows, row_ptr, cols, vals, x_array, y_array);
+    return;
+  }
+
+  pool->run([&] (int t) {
+    I start, end;
+    _balanced_range(row_ptr, nrows, t, pool->get_num_threads(), start, end);
+    _mixed_csr_plusdot(end - start, row_ptr + start, cols, vals, x_array, y_array + start);
+  });
+}
+
+/* the same, for k vectors stored row-major */
+template <typename I, typename S, typename D>
+static void _mixed_csr_plusdot_multi(I nrows, const I* row_ptr, const I* cols, const S* vals,
+                                     const D* x_array, D* y_array, int k)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D* yi = y_array + i*k;
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      const D v = D(vals[j]);
+      const D* xj = x_array + cols[j]*k;
+      for (int t = 0; t < k; ++t) {
+        yi[t] += v * xj[t];
+      }
+    }
+  }
+}
+
+/* y += A^T*x for a CSR matrix with values stored as S */
+template <typename I, typename S, typename D>
+static void _mixed_csr_plusdot_transpose(I nrows, const I* row_ptr, const I* cols, const S* vals,
+                                         const D* x_array, D* y_array)
+{
+  for (I i = 0; i < nrows; ++i) {
+    D x_i = x_array[i];
+    for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+      y_array[cols[j]] += D(vals[j]) * x_i;
+    }
+  }
+}
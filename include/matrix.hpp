@@ -6,7 +6,16 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <limits>
 #include "vector.hpp"
+#include "multivector.hpp"
+#include "scatter.hpp"
+#include "kernels.hpp"
+#include "threads.hpp"
+#include "ordering.hpp"
 #include "utils.hpp"
 
 /*
@@ -17,12 +26,12 @@
  * The Mat elements are not stored in globally addressable memory.
  * This makes sense, due to the fact that Mat elements don't currently need to be
  * transferred between processes. It also saves room in shared memory.
- * Implementing SpMSpM may require it.
+ * SpGEMM (in spgemm.hpp), which needs other ranks' rows, puts just their
+ * values in shared memory itself, for as long as it needs them.
  */
 
-/* how many values to prefetch */
-#define DOT_BLOCK_SIZE 2048
-#define NBUFS 2
+/* how many rows of the local product to do between checks for arrived blocks */
+#define LOCAL_POLL_ROWS 1024
 
 template <typename I, typename D>
 class Mat
@@ -43,11 +52,23 @@ public:
   /* set dimensions of Mat. clears all values. */
   void set_dimensions(I M, I N);
 
+  /*
+   * the same, with the ranks' rows and the columns of their diagonal blocks
+   * chosen by the partitioners. x must be partitioned like the columns and y
+   * like the rows. a square matrix should get the same partitioner twice,
+   * since the symmetric formats and reordering need square diagonal blocks
+   */
+  void set_dimensions(I M, I N, const Partitioner<I>& rows, const Partitioner<I>& cols);
+
   /* get dimensions of the Mat */
   void get_dimensions(I& M, I& N) const;
 
   /* check that x and y are compatible with the matrix */
   void check_dimensions(const Vec<I,D>& x, const Vec<I,D>& y) const;
+  void check_dimensions(const MultiVec<I,D>& x, const MultiVec<I,D>& y) const;
+
+  /* the same, for the transpose products: x has a row's length, and y a column's */
+  void check_transpose_dimensions(const Vec<I,D>& x, const Vec<I,D>& y) const;
 
   /* get the range of rows stored locally */
   void get_local_rows(I& start, I& end) const;
@@ -58,22 +79,182 @@ public:
   /* get the range of rows stored locally */
   I get_local_rows_size() const;
 
+  /* the start of each rank's rows (or diagonal block columns), and then M (or N) */
+  const std::vector<I>& get_row_partitions() const;
+  const std::vector<I>& get_col_partitions() const;
+
   /*=========================================*/
   /*** value setting and memory allocation ***/
 
-  /* set a Mat element */
+  /*
+   * set a Mat element. setting the same element again adds to it. the row
+   * may belong to another rank, in which case the element is stashed until
+   * assembly sends it to its owner
+   */
   void set_value(I row, I col, D value);
 
+  /* set n Mat elements at once, element k being (rows[k], cols[k]) = vals[k] */
+  void set_values(const I* rows, const I* cols, const D* vals, I n);
+
+  /*
+   * send the stashed elements to the ranks that own their rows, one batch per
+   * rank. assemble_end() waits until all ranks' batches have arrived, so local
+   * work can go in between, as long as it sets no more off-process elements.
+   * collective: must be called on all ranks. setup() calls whichever of these
+   * has not been called yet
+   */
+  void assemble_begin();
+  void assemble_end();
+
+  /*================*/
+  /*** reordering ***/
+
+  /*
+   * renumber the rows and columns of a square matrix in setup(), with the
+   * reverse Cuthill-McKee ordering of the graph of A + A^T, so that the
+   * nonzeros gather near the diagonal and each rank's remote columns come
+   * from few, nearby ranks. values are still set in the original numbering;
+   * the products then take and give vectors in the new one, which
+   * Vec::permute() and Vec::unpermute() convert with get_permutation().
+   * must be set before setup(); off by default
+   */
+  void set_reordering(bool enable);
+  bool get_reordering() const;
+
+  /*
+   * the new index of each of this rank's original rows (the columns are split
+   * the same way), as Vec::permute() takes it. empty without reordering
+   */
+  const std::vector<I>& get_permutation() const;
+
+  /*==========================*/
+  /*** communication tuning ***/
+
+  /* set how many values of x to prefetch at a time */
+  void set_block_size(I block_size);
+  I get_block_size() const;
+
+  /* set how many blocks of prefetched values to keep in flight */
+  void set_nbufs(int nbufs);
+  int get_nbufs() const;
+
+  /*
+   * tune the block size and number of buffers for this matrix (for matrix
+   * types that use them; otherwise this does nothing). each of the
+   * following products uses a different candidate, timed over reps products;
+   * once all have been tried, the ranks agree on the one with the lowest
+   * time on the slowest rank and keep it.
+   * while tuning, all ranks must call dot()/plusdot() the same number of times.
+   */
+  void autotune(int reps = 1);
+
+  /* return true if autotune() has been called and is still trying candidates */
+  bool is_tuning() const;
+
+  /*===============*/
+  /*** threading ***/
+
+  /*
+   * set how many threads each rank uses for the compute loops of the
+   * products (default 1). only the calling thread communicates, so loops
+   * that interleave communication with compute stay on it. if set before
+   * setup(), setup() sorts the elements on these threads too
+   */
+  void set_num_threads(int nthreads);
+  int get_num_threads() const;
+
+  /*
+   * for the products that prefetch x (SingleCSRMat, BlockCSRMat and RCMat),
+   * move the compute to a helper thread, so that the calling thread, which
+   * holds the master persona, keeps calling upcxx::progress() and starting
+   * fetches while the local part is computed. the helper makes no UPC++
+   * calls. off by default
+   */
+  void set_progress_thread(bool enable);
+  bool get_progress_thread() const;
+
 protected:
   I _M, _N;
   I _local_rows;
 
   bool size_set = false;
 
+  /*
+   * prefetch parameters. mutable because tuning happens inside the
+   * (const) products.
+   */
+  mutable I _block_size = 2048;
+  mutable int _nbufs = 4;
+
+  /* set by subclasses whose products depend on the parameters, for autotune() */
+  bool _tune_block_size = false;
+  bool _tune_nbufs = false;
+
+  /* called around the products that depend on the prefetch parameters */
+  void _tune_start() const;
+  void _tune_stop() const;
+
+  /* the threads for the products, or nullptr if there is only one */
+  ThreadPool* _get_pool() const;
+
+  /* the calling thread and the compute helper, or nullptr if there is no progress thread */
+  ThreadPool* _get_progress_pool() const;
+
+  /*
+   * for the progress thread: the calling thread fetches x[col(j)] for j in
+   * [0, n), at most block_size at a time, while the helper calls before()
+   * and then consume(j, value) for each j in order
+   */
+  template <typename Col, typename Before, typename Consume>
+  void _progress_stream(Vec<I,D>& x, I n, Col col, Before before, Consume consume) const;
+
   /* vector storing COO (coordinate format) Mat elements, possibly out of order */
   std::vector< std::pair< std::pair<I,I>, D> > _elements;
 
+  /* finish the assembly, and reorder if asked to, for the start of setup() */
+  void _assemble();
+
+  /*
+   * set by the matrices that keep only the upper triangle of a symmetric
+   * matrix, so that reordering drops the lower one and keeps the elements above
+   * the new diagonal
+   */
+  bool _upper_triangle = false;
+
   std::vector<I> _row_partitions, _col_partitions;
+  OwnerLookup<I> _row_owner, _col_owner;
+
+private:
+  /* autotuning state: candidate (block size, nbufs) pairs and their timings */
+  mutable std::vector< std::pair<I,int> > _tune_candidates;
+  mutable std::vector<double> _tune_times;
+  mutable size_t _tune_idx = 0;
+  mutable int _tune_rep = 0;
+  int _tune_reps = 1;
+  mutable std::chrono::steady_clock::time_point _tune_tick;
+
+  /* shared, so that copies of a matrix reuse the same threads */
+  std::shared_ptr<ThreadPool> _pool;
+  std::shared_ptr<ThreadPool> _progress_pool;
+
+  /* add an element, stashing it if the row is not ours */
+  void _add_element(I row, I col, D value);
+
+  /* compute the permutation, renumber the elements and send them to their new owners */
+  void _reorder_elements();
+
+  bool _reorder = false, _reordered = false;
+  std::vector<I> _perm;
+
+  /* the elements for other ranks' rows, by owner */
+  std::vector< std::vector< std::pair< std::pair<I,I>, D> > > _stash;
+
+  enum assembly_t {UNASSEMBLED, ASSEMBLING, ASSEMBLED};
+  assembly_t _assembly = UNASSEMBLED;
+
+  /* lets the owners add the batches to their elements; lives only during assembly */
+  std::shared_ptr< upcxx::dist_object< Mat<I,D>* > > _assembly_obj;
+  upcxx::future<> _assembly_fut = upcxx::make_future();
 };
 
 /* child classes */
@@ -83,6 +264,13 @@ protected:
  *    -> NaiveCSRMat
  *    -> SingleCSRMat
  *    -> BlockCSRMat
+ *    -> GhostCSRMat
+ *    -> PushCSRMat
+ *    -> SELLMat
+ *    -> SymCSRMat
+ *    -> DeltaCSRMat
+ *    -> MixedCSRMat
+ *  - BCSRMat
  *  - RCMat
  */
 
@@ -102,23 +290,125 @@ public:
   /*=========================================*/
   /*** value setting and memory allocation ***/
 
+  /*
+   * allocate the CSR arrays from exact counts, so that set_value() writes
+   * our rows' elements straight into them, without a COO copy. dnnz[i] and
+   * onnz[i] count the elements set in local row i (by any rank, and counting
+   * repeats) in the diagonal block and outside it. setting more than that
+   * throws, and setting fewer just leaves the rows shorter
+   */
+  void preallocate(const I* dnnz, const I* onnz);
+
+  /* as for Mat, but straight into the CSR arrays once preallocated */
+  void set_value(I row, I col, D value);
+  void set_values(const I* rows, const I* cols, const D* vals, I n);
+
+  /*
+   * take all of our rows at once, in CSR form with global columns: local row
+   * i holds cols[k], vals[k] for k in [row_ptr[i], row_ptr[i+1]). rows that
+   * are sorted by column without repeats (as get_local_csr() gives them) are
+   * copied straight into storage, leaving setup() nothing to assemble or
+   * sort; any others are sorted and summed here. no other values may be set
+   */
+  void set_local_csr(const I* row_ptr, const I* cols, const D* vals);
+
+  /*
+   * our rows in the same form, sorted, once set up. throws for the matrix
+   * types that keep their elements some other way after setup()
+   */
+  void get_local_csr(std::vector<I>& row_ptr, std::vector<I>& cols, std::vector<D>& vals) const;
+
   /* set up CSR storage format */
-  /* optional arguments reserve memory for matrix elements:
+  /* collective: must be called on all ranks, since it finishes the assembly */
+  /* optional arguments give the expected nonzeros per row:
    *  - dnz : number of diagonal nonzeros per row
    *  - onz : number of off-diagonal nonzeros per row
+   * (storage is sized exactly from the set values, so these are only hints)
    */
   void setup(I dnz = 0, I onz = 0);
 
+  /*======================================*/
+  /*** matrix-transpose-vector products ***/
+
+  /*
+   * Mat-transpose-vector product y = A^T*x. contributions to remote entries
+   * of y are summed locally and sent in one message per owner.
+   * collective: must be called on all ranks
+   */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-transpose-vector sum product y = A^T*x + y */
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
 protected:
 
-  /* vector storing local (block diagonal) Mat elements */
-  std::vector< std::vector< std::pair<I, D>>> _local;
+  /* y += A_local * x_local, for the block diagonal part */
+  void _local_plusdot(const D* x_array, D* y_array) const;
+
+  /* the same, for k vectors stored row-major */
+  void _local_plusdot(const D* x_array, D* y_array, int k) const;
+
+  /*
+   * renumber _remote_cols to index into _ghost_cols, the sorted list of
+   * unique remote columns
+   */
+  void _compress_remote_cols();
+
+  /*
+   * Mat elements are stored in flat CSR arrays: the entries of local row i are
+   * at indices [row_ptr[i], row_ptr[i+1]) of the cols and vals arrays, sorted
+   * by column.
+   */
+
+  /* local (block diagonal) Mat elements. columns are relative to the diagonal block */
+  std::vector<I> _local_row_ptr;
+  std::vector<I> _local_cols;
+  std::vector<D> _local_vals;
+
+  /*
+   * remote (off-diagonal) Mat elements. columns are global indices, or once
+   * _compress_remote_cols() has been called, indices into _ghost_cols
+   */
+  std::vector<I> _remote_row_ptr;
+  std::vector<I> _remote_cols;
+  std::vector<D> _remote_vals;
+
+  /* sorted global indices of the remote columns */
+  std::vector<I> _ghost_cols;
+  bool _remote_compressed = false;
+
+  /*
+   * for the transpose products: the sums for each of _ghost_cols, and the
+   * scatter that adds them into their owners' y. set up by the first
+   * transpose product, so matrices that never use it pay nothing
+   */
+  void _setup_transpose() const;
+  mutable AddScatter<I,D> _add_scatter;
+  mutable std::vector<D> _add_vals;
 
-  /* vector storing remote (off-diagonal) Mat elements */
-  std::vector< std::vector< std::pair<I, D>>> _remote;
+  /* if the remote columns are not compressed, the index into _ghost_cols of each */
+  mutable std::vector<I> _transpose_slots;
 
   bool is_set_up = false;
 
+  /*
+   * whether the CSR arrays above still hold the whole matrix after setup().
+   * cleared by the matrix types that convert them to their own storage or
+   * keep only part of them, for get_local_csr()
+   */
+  bool _keeps_csr = true;
+
+private:
+  /* put an element of one of our rows into its preallocated place */
+  void _place(I row, I col, D value);
+
+  /* after preallocate(), the next free index in each row */
+  bool _preallocated = false;
+  std::vector<I> _local_fill, _remote_fill;
+
+  /* set_local_csr() has filled the CSR arrays */
+  bool _loaded = false;
+
 };
 
 template <typename I, typename D>
@@ -143,6 +433,10 @@ public:
   /* Mat-vector sum product y = A*x + y */
   void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
 
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
 };
 
 template <typename I, typename D>
@@ -153,10 +447,10 @@ public:
   /*==================================*/
   /*** constructors and destructors ***/
 
-  SingleCSRMat() {};
+  SingleCSRMat() { this->_tune_block_size = true; };
 
   /* construct a CSRMat with dimensions M, N */
-  SingleCSRMat(I M, I N) { this->set_dimensions(M, N); };
+  SingleCSRMat(I M, I N) { this->_tune_block_size = true; this->set_dimensions(M, N); };
 
   /*============================*/
   /*** matrix-vector products ***/
@@ -167,6 +461,10 @@ public:
   /* Mat-vector sum product y = A*x + y */
   void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
 
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
 };
 
 template <typename I, typename D>
@@ -177,10 +475,17 @@ public:
   /*==================================*/
   /*** constructors and destructors ***/
 
-  BlockCSRMat() {};
+  BlockCSRMat() { _init_tuning(); };
 
   /* construct a CSRMat with dimensions M, N */
-  BlockCSRMat(I M, I N) { this->set_dimensions(M, N); };
+  BlockCSRMat(I M, I N) { _init_tuning(); this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /* set up CSR storage format, and organize the remote entries by block */
+  /* collective: must be called on all ranks */
+  void setup(I dnz = 0, I onz = 0);
 
   /*============================*/
   /*** matrix-vector products ***/
@@ -191,34 +496,86 @@ public:
   /* Mat-vector sum product y = A*x + y */
   void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
 
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+private:
+
+  /* our products depend on both the block size and the number of buffers */
+  void _init_tuning() { this->_tune_block_size = true; this->_tune_nbufs = true; };
+
+  /* list the [start, end) ranges of x to fetch, in the order to request them */
+  void _get_blocks(std::vector< std::pair<I,I> >& blocks) const;
+
+  /* build the block layout and fetch buffers for the current parameters */
+  void _build_blocks() const;
+
+  /* y += A_remote * x for the columns in block b, whose rows of x (k values each) are in buf */
+  void _block_plusdot(I b, const D* buf, D* y_array, int k) const;
+
+  /* the product, for either a Vec (k = 1) or a MultiVec */
+  template <typename X>
+  void _plusdot(const X& x, const D* x_array, D* y_array, int k) const;
+
+  /* the same, with the compute on the progress thread's helper */
+  template <typename X>
+  void _progress_plusdot(const X& x, I local_size, const D* x_array, D* y_array, int k) const;
+
+  /* one chunk of the local product, starting at local_row. returns the number of rows done */
+  I _local_chunk(I local_row, I local_size, const D* x_array, D* y_array, int k) const;
+
+  /*
+   * The remote entries organized by block, pointing into the _remote arrays.
+   * only blocks that some local row uses are kept, each trimmed to the columns
+   * in use. block b is made of the segments [_blk_ptr[b], _blk_ptr[b+1]), and segment
+   * k is the entries [_seg_begin[k], _seg_end[k]) of local row _seg_row[k].
+   * these, and the buffers below, depend on the block size and number of
+   * buffers, so they are rebuilt if the parameters change (e.g. by tuning).
+   */
+  mutable std::vector< std::pair<I,I> > _blocks;
+  mutable std::vector<I> _blk_ptr;
+  mutable std::vector<I> _seg_row, _seg_begin, _seg_end;
+
+  /* the parameters that the layout and buffers were built for */
+  mutable I _built_block_size = 0;
+  mutable int _built_nbufs = 0;
+
+  /*
+   * slot s of the fetch buffers holds block _slot_block[s] (or -1), arriving
+   * with _slot_futs[s]. the buffers grow as needed to hold k rows per column
+   */
+  mutable std::vector<D> _bufs;
+  mutable std::vector< upcxx::future<> > _slot_futs;
+  mutable std::vector<I> _slot_block;
+
 };
 
 /*
- * RCMat is a "row-partition column matrix". It's like CSC format, but the
- * matrix is still partitioned across processors by row.
+ * GhostCSRMat renumbers the remote columns into a compact buffer of "ghost"
+ * values during setup(), and fetches each of them exactly once per product,
+ * with one aggregated request to each rank that owns any of them.
  */
 
 template <typename I, typename D>
-class RCMat : public Mat<I,D>
+class GhostCSRMat : public CSRMat<I,D>
 {
 
 public:
   /*==================================*/
   /*** constructors and destructors ***/
 
-  RCMat() {};
+  GhostCSRMat() {};
 
-  /* construct an RCMat with dimensions M, N */
-  RCMat(I M, I N) { this->set_dimensions(M, N); };
+  /* construct a CSRMat with dimensions M, N */
+  GhostCSRMat(I M, I N) { this->set_dimensions(M, N); };
 
   /*=========================================*/
   /*** value setting and memory allocation ***/
 
-  /* set up CSR storage format */
-  /* optional arguments reserve memory for matrix elements:
-   *  - nnz : expected number of nonzeros per column (will be divided by # procs)
-   */
-  void setup(I nnz = 0);
+  /* set up CSR storage format and the communication plan for the ghost values */
+  /* collective: must be called on all ranks */
+  void setup(I dnz = 0, I onz = 0);
 
   /*============================*/
   /*** matrix-vector products ***/
@@ -229,110 +586,3232 @@ public:
   /* Mat-vector sum product y = A*x + y */
   void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
 
-private:
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
 
-  /* a vector storing the columns! */
-  std::vector< std::pair<I, std::vector< std::pair<I, D>>>> _cols;
+private:
 
-  bool is_set_up = false;
+  mutable GhostScatter<I,D> _scatter;
+  mutable std::vector<D> _ghost_vals;
 
 };
 
-/* MAT */
-/*============================*/
-/*** dimensions and indices ***/
+/*
+ * PushCSRMat uses the same ghost buffer as GhostCSRMat, but the owners of the
+ * ghost values push them to us (see PushScatter) instead of us requesting
+ * them. Every rank must call dot()/plusdot() for each product, since our
+ * call is what sends our part of x to the ranks that need it (and for a
+ * MultiVec, all ranks must use the same number of vectors).
+ */
 
 template <typename I, typename D>
-void Mat<I, D>::set_dimensions(I M, I N)
+class PushCSRMat : public CSRMat<I,D>
 {
 
-  if (M <= 0 || N <= 0) {
-    throw std::length_error("Mat dimensions must be > 0");
-  }
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
 
-  _M = M;
-  _N = N;
+  PushCSRMat() {};
 
-  /* compute local rows */
-  _row_partitions = partition_array(M);
-  _col_partitions = partition_array(N);
-  _local_rows = _row_partitions[upcxx::rank_me()+1] - _row_partitions[upcxx::rank_me()];
+  /* construct a CSRMat with dimensions M, N */
+  PushCSRMat(I M, I N) { this->set_dimensions(M, N); };
 
-  size_set = true;
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
 
-}
+  /* set up CSR storage format and the communication plan for the ghost values */
+  /* collective: must be called on all ranks */
+  void setup(I dnz = 0, I onz = 0);
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+private:
+
+  mutable PushScatter<I,D> _scatter;
+
+};
+
+/*
+ * SELLMat stores the matrix in SELL-C-sigma ("sliced ELLPACK") format. The
+ * local rows are grouped into chunks of C, and each chunk is padded to the
+ * length of its longest row and stored column-major, so that the product
+ * can work on C rows at a time with vector instructions. To keep the padding
+ * small, rows are sorted by length within windows of sigma rows first.
+ *
+ * The matrix is assembled as a CSRMat, then converted during setup(). The
+ * local and remote parts are converted separately, and the remote values
+ * are fetched into a ghost buffer like in GhostCSRMat.
+ */
 
-/* set dimensions of Mat, clearing all values, and reserve space for elements. */
 template <typename I, typename D>
-void Mat<I, D>::get_dimensions(I& M, I& N) const
+class SELLMat : public CSRMat<I,D>
 {
-  M = _M;
-  N = _N;
-}
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  SELLMat() {};
+
+  /* construct a SELLMat with dimensions M, N */
+  SELLMat(I M, I N) { this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /*
+   * the layout parameters, which must be set before setup():
+   *  - chunk_size : C, the number of rows per chunk. should be a multiple of
+   *                 the SIMD width (8 suits AVX2 floats and AVX-512 doubles)
+   *  - sigma      : the window over which rows are sorted by length. must be
+   *                 a multiple of chunk_size
+   */
+  void set_chunk_size(I chunk_size);
+  I get_chunk_size() const;
+
+  void set_sigma(I sigma);
+  I get_sigma() const;
+
+  /* set up SELL storage format and the communication plan for the ghost values */
+  /* collective: must be called on all ranks */
+  /* the arguments are hints, as for CSRMat */
+  void setup(I dnz = 0, I onz = 0);
+
+  /* the number of stored entries (including padding) per nonzero */
+  double get_fill_ratio() const;
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+  /* the transpose products, as for CSRMat */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+private:
+
+  /* one part of the matrix in SELL format. see _sell_plusdot in kernels.hpp */
+  struct sell_t {
+    std::vector<I> rows;       /* the local row for each position in the chunks */
+    std::vector<I> chunk_ptr;
+    std::vector<I> cols;
+    std::vector<D> vals;
+  };
+
+  /* convert a CSR part of the matrix to SELL format */
+  void _to_sell(const std::vector<I>& row_ptr, const std::vector<I>& cols,
+                const std::vector<D>& vals, sell_t& sell) const;
+
+  I _chunk_size = 8;
+  I _sigma = 256;
+
+  /* the number of nonzeros actually set, for the fill ratio */
+  I _nnz = 0;
+
+  sell_t _local;
+  sell_t _remote;
+
+  mutable GhostScatter<I,D> _scatter;
+  mutable std::vector<D> _ghost_vals;
+
+};
+
+/*
+ * SymCSRMat stores a square symmetric matrix (Hermitian, for complex D) as
+ * just its upper triangle, and uses each stored entry twice in the product:
+ * as A(i,j) for row i and as A(j,i) = conj(A(i,j)) for row j. That is about
+ * half the memory and bandwidth of CSRMat.
+ *
+ * Entries below the diagonal are skipped at setup, so code that sets the
+ * whole matrix works unchanged. The x values for our columns past our rows
+ * come from the higher ranks with a GhostScatter, and our contributions to
+ * their rows of y go back in bulk with an AddScatter.
+ */
 
 template <typename I, typename D>
-void Mat<I, D>::check_dimensions(const Vec<I,D>& x, const Vec<I,D>& y) const
+class SymCSRMat : public CSRMat<I,D>
 {
-  I M, N;
-  get_dimensions(M, N);
-  if (x.get_size() != N) {
-    std::ostringstream out;
-    out << "vector x size " << x.get_size() << " does not match ";
-    out << "matrix row length " << N;
-    throw std::invalid_argument(out.str());
-  }
-  if (y.get_size() != M) {
-    std::ostringstream out;
-    out << "vector y size " << y.get_size() << " does not match ";
-    out << "matrix column length " << M;
-    throw std::invalid_argument(out.str());
-  }
-}
 
-template <typename I, typename D>
-void Mat<I, D>::get_local_rows(I& start, I& end) const
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  SymCSRMat() { this->_upper_triangle = true; this->_keeps_csr = false; };
+
+  /* construct a SymCSRMat with dimensions N, N */
+  SymCSRMat(I M, I N) { this->_upper_triangle = true; this->_keeps_csr = false; this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /* set up the upper triangle and the communication plans */
+  /* collective: must be called on all ranks */
+  /* the arguments are hints, as for CSRMat */
+  void setup(I dnz = 0, I onz = 0);
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the transpose products. A^T = conj(A), so these are the same sweep */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+private:
+
+  /* y += A*x, or A^T*x */
+  void _plusdot(Vec<I,D>& x, Vec<I,D>& y, bool transpose) const;
+
+  /*
+   * the diagonal. the CSR arrays hold the strict upper triangle: the local
+   * part is on and right of the diagonal block, and the remote part only
+   * has columns on higher ranks
+   */
+  std::vector<D> _diag;
+
+  mutable GhostScatter<I,D> _scatter;
+  mutable std::vector<D> _ghost_vals;
+
+};
+
+/*
+ * DeltaCSRMat stores the column indices of a CSRMat in less space. First,
+ * they are local indices, into the diagonal block or the ghost buffer as in
+ * GhostCSRMat, which fit in the local index type L even when the global
+ * index type I needs 64 bits. Then, each row's columns are stored as 16-bit
+ * gaps from the previous one (the first from the row's own index), with an
+ * escape to a full L for big jumps (see _delta_encode in kernels.hpp). For banded or well-ordered matrices that is
+ * 2 bytes per nonzero instead of sizeof(I).
+ *
+ * setup() throws std::overflow_error if the local indices don't fit in L.
+ */
+
+template <typename I, typename D, typename L = uint32_t>
+class DeltaCSRMat : public CSRMat<I,D>
 {
-  start = _row_partitions[upcxx::rank_me()];
-  end = _row_partitions[upcxx::rank_me() + 1];
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  DeltaCSRMat() {};
+
+  /* construct a DeltaCSRMat with dimensions M, N */
+  DeltaCSRMat(I M, I N) { this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /* set up the compressed columns and the communication plan for the ghost values */
+  /* collective: must be called on all ranks */
+  /* the arguments are hints, as for CSRMat */
+  void setup(I dnz = 0, I onz = 0);
+
+  /* the bytes of column index stored per nonzero */
+  double get_index_bytes() const;
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+  /* the transpose products, as for CSRMat */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+private:
+
+  /* one part of the matrix, see _delta_csr_plusdot in kernels.hpp */
+  struct delta_t {
+    std::vector<I> row_ptr;
+    std::vector<I> code_ptr;
+    std::vector<uint16_t> codes;
+    std::vector<D> vals;
+  };
+
+  /* convert a CSR part of the matrix, whose columns are all below ncols (checked in setup) */
+  void _to_delta(const std::vector<I>& row_ptr, const std::vector<I>& cols,
+                 std::vector<D>& vals, I ncols, delta_t& delta) const;
+
+  delta_t _local;
+  delta_t _remote;
+
+  mutable GhostScatter<I,D> _scatter;
+  mutable std::vector<D> _ghost_vals;
+
+};
+
+/*
+ * MixedCSRMat stores the matrix values in a narrower type S than the vectors
+ * use, e.g. float (or bfloat16, see kernels.hpp) values with double vectors.
+ * Each value is widened to D as it is used, and the products sum in D, so
+ * only the matrix's own precision is lost, at half (or a quarter) of the
+ * bandwidth for the values.
+ *
+ * The remote values of x are fetched into a ghost buffer as in GhostCSRMat,
+ * travelling as type W: D by default, or e.g. float to halve the message
+ * sizes too.
+ */
+
+template <typename I, typename D, typename S = float, typename W = D>
+class MixedCSRMat : public CSRMat<I,D>
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  MixedCSRMat() {};
+
+  /* construct a MixedCSRMat with dimensions M, N */
+  MixedCSRMat(I M, I N) { this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /* set up the narrow values and the communication plan for the ghost values */
+  /* collective: must be called on all ranks */
+  /* the arguments are hints, as for CSRMat */
+  void setup(I dnz = 0, I onz = 0);
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+  /* the transpose products, as for CSRMat */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+private:
+
+  std::vector<S> _local_svals;
+  std::vector<S> _remote_svals;
+
+  mutable GhostScatter<I,D,W> _scatter;
+  mutable std::vector<D> _ghost_vals;
+
+};
+
+/*
+ * BCSRMat stores the matrix as dense R x C blocks in block CSR format, for
+ * matrices that have that structure (e.g. from PDEs with several components
+ * per grid point). Only one column index is stored per block, and the block
+ * products are unrolled at compile time.
+ *
+ * Block rows start at the first local row, and block columns are aligned to
+ * multiples of C globally. Any block that does not lie entirely within our
+ * part of x is remote; the x values for those are fetched a whole block
+ * column at a time into a ghost buffer, with a GhostScatter.
+ */
+
+template <typename I, typename D, int R, int C = R>
+class BCSRMat : public Mat<I,D>
+{
+
+  static_assert(R >= 1 && R <= 8 && C >= 1 && C <= 8, "BCSRMat block dimensions must be between 1 and 8");
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  BCSRMat() {};
+
+  /* construct a BCSRMat with dimensions M, N */
+  BCSRMat(I M, I N) { this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /* set up block CSR storage format and the communication plan for the ghost values */
+  /* collective: must be called on all ranks */
+  /* optional arguments are hints, as for CSRMat. entries set more than once are summed */
+  /* reordering is not supported: the scalar ordering would scatter the blocks' rows */
+  void setup(I dnz = 0, I onz = 0);
+
+  /* the number of local blocks, including remote ones */
+  I get_num_blocks() const;
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+  /* the transpose products, as for CSRMat */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+private:
+
+  /*
+   * blocks are stored like the entries of CSRMat, but per block row, with R*C
+   * values per block. the "columns" are offsets into x (for local blocks,
+   * relative to the diagonal block) or into the ghost buffer (remote blocks).
+   */
+  std::vector<I> _local_brow_ptr;
+  std::vector<I> _local_cols;
+  std::vector<D> _local_vals;
+
+  std::vector<I> _remote_brow_ptr;
+  std::vector<I> _remote_cols;
+  std::vector<D> _remote_vals;
+
+  /* sorted global indices of the ghost values: every column of the remote block columns */
+  std::vector<I> _ghost_cols;
+
+  mutable GhostScatter<I,D> _scatter;
+  mutable std::vector<D> _ghost_vals;
+
+  /*
+   * for the transpose products, set up by the first one: the sums for each
+   * of _ghost_cols (padded like _ghost_vals), and the scatter that adds them
+   * into their owners' y
+   */
+  mutable AddScatter<I,D> _add_scatter;
+  mutable std::vector<D> _add_vals;
+
+  bool is_set_up = false;
+
+};
+
+/*
+ * RCMat is a "row-partition column matrix". It's like CSC format, but the
+ * matrix is still partitioned across processors by row.
+ */
+
+template <typename I, typename D>
+class RCMat : public Mat<I,D>
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  RCMat() { this->_tune_block_size = true; };
+
+  /* construct an RCMat with dimensions M, N */
+  RCMat(I M, I N) { this->_tune_block_size = true; this->set_dimensions(M, N); };
+
+  /*=========================================*/
+  /*** value setting and memory allocation ***/
+
+  /* set up CSR storage format */
+  /* collective: must be called on all ranks, since it finishes the assembly */
+  /* optional arguments reserve memory for matrix elements:
+   *  - nnz : expected number of nonzeros per column (will be divided by # procs)
+   */
+  void setup(I nnz = 0);
+
+  /*============================*/
+  /*** matrix-vector products ***/
+
+  /* Mat-vector product y = A*x */
+  void dot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* Mat-vector sum product y = A*x + y */
+  void plusdot(Vec<I,D>& x, Vec<I,D>& y) const;
+
+  /* the same products for each of the k vectors in a MultiVec */
+  void dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+  void plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const;
+
+  /*
+   * Mat-transpose-vector products. each stored column gives one entry of y,
+   * and the remote ones are sent in one message per owner.
+   * collective: must be called on all ranks
+   */
+  void dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+  void plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const;
+
+private:
+
+  /* a vector storing the columns! */
+  std::vector< std::pair<I, std::vector< std::pair<I, D>>>> _cols;
+
+  /* prefix sums of the number of entries in each local row, for splitting rows over threads */
+  std::vector<I> _row_nnz_ptr;
+
+  /* the product when there are several threads */
+  void _threaded_plusdot(Vec<I,D>& x, D* y_array) const;
+
+  /*
+   * for the transpose products, set up by the first one: for each of _cols,
+   * its index in _add_vals, or -1 if we own that entry of y
+   */
+  void _setup_transpose() const;
+  mutable AddScatter<I,D> _add_scatter;
+  mutable std::vector<D> _add_vals;
+  mutable std::vector<I> _transpose_slots;
+
+  bool is_set_up = false;
+
+};
+
+/* MAT */
+/*============================*/
+/*** dimensions and indices ***/
+
+template <typename I, typename D>
+void Mat<I, D>::set_dimensions(I M, I N)
+{
+  set_dimensions(M, N, Partitioner<I>(), Partitioner<I>());
+}
+
+template <typename I, typename D>
+void Mat<I, D>::set_dimensions(I M, I N, const Partitioner<I>& rows, const Partitioner<I>& cols)
+{
+
+  if (M <= 0 || N <= 0) {
+    throw std::length_error("Mat dimensions must be > 0");
+  }
+
+  _M = M;
+  _N = N;
+
+  /* compute local rows */
+  _row_partitions = rows.partition(M);
+  _col_partitions = cols.partition(N);
+  _row_owner = OwnerLookup<I>(_row_partitions);
+  _col_owner = OwnerLookup<I>(_col_partitions);
+  _local_rows = _row_partitions[upcxx::rank_me()+1] - _row_partitions[upcxx::rank_me()];
+
+  size_set = true;
+
+}
+
+/* set dimensions of Mat, clearing all values, and reserve space for elements. */
+template <typename I, typename D>
+void Mat<I, D>::get_dimensions(I& M, I& N) const
+{
+  M = _M;
+  N = _N;
+}
+
+template <typename I, typename D>
+void Mat<I, D>::check_dimensions(const Vec<I,D>& x, const Vec<I,D>& y) const
+{
+  I M, N;
+  get_dimensions(M, N);
+  if (x.get_size() != N) {
+    std::ostringstream out;
+    out << "vector x size " << x.get_size() << " does not match ";
+    out << "matrix row length " << N;
+    throw std::invalid_argument(out.str());
+  }
+  if (y.get_size() != M) {
+    std::ostringstream out;
+    out << "vector y size " << y.get_size() << " does not match ";
+    out << "matrix column length " << M;
+    throw std::invalid_argument(out.str());
+  }
+  if (x.get_partitions() != _col_partitions || y.get_partitions() != _row_partitions) {
+    throw std::invalid_argument("vectors are not partitioned like the matrix");
+  }
+}
+
+template <typename I, typename D>
+void Mat<I, D>::check_dimensions(const MultiVec<I,D>& x, const MultiVec<I,D>& y) const
+{
+  I M, N;
+  get_dimensions(M, N);
+  if (x.get_size() != N) {
+    std::ostringstream out;
+    out << "multivector x size " << x.get_size() << " does not match ";
+    out << "matrix row length " << N;
+    throw std::invalid_argument(out.str());
+  }
+  if (y.get_size() != M) {
+    std::ostringstream out;
+    out << "multivector y size " << y.get_size() << " does not match ";
+    out << "matrix column length " << M;
+    throw std::invalid_argument(out.str());
+  }
+  if (x.get_num_vecs() != y.get_num_vecs()) {
+    std::ostringstream out;
+    out << "multivectors x and y have different numbers of vectors (";
+    out << x.get_num_vecs() << " and " << y.get_num_vecs() << ")";
+    throw std::invalid_argument(out.str());
+  }
+  if (x.get_partitions() != _col_partitions || y.get_partitions() != _row_partitions) {
+    throw std::invalid_argument("multivectors are not partitioned like the matrix");
+  }
+}
+
+template <typename I, typename D>
+void Mat<I, D>::check_transpose_dimensions(const Vec<I,D>& x, const Vec<I,D>& y) const
+{
+  I M, N;
+  get_dimensions(M, N);
+  if (x.get_size() != M) {
+    std::ostringstream out;
+    out << "vector x size " << x.get_size() << " does not match ";
+    out << "matrix column length " << M;
+    throw std::invalid_argument(out.str());
+  }
+  if (y.get_size() != N) {
+    std::ostringstream out;
+    out << "vector y size " << y.get_size() << " does not match ";
+    out << "matrix row length " << N;
+    throw std::invalid_argument(out.str());
+  }
+  if (x.get_partitions() != _row_partitions || y.get_partitions() != _col_partitions) {
+    throw std::invalid_argument("vectors are not partitioned like the matrix");
+  }
+}
+
+template <typename I, typename D>
+void Mat<I, D>::get_local_rows(I& start, I& end) const
+{
+  start = _row_partitions[upcxx::rank_me()];
+  end = _row_partitions[upcxx::rank_me() + 1];
+}
+
+template <typename I, typename D>
+void Mat<I, D>::get_diag_cols(I& start, I& end) const
+{
+  start = _col_partitions[upcxx::rank_me()];
+  end = _col_partitions[upcxx::rank_me() + 1];
+}
+
+template <typename I, typename D>
+I Mat<I, D>::get_local_rows_size() const
+{
+  I start, end;
+  get_local_rows(start, end);
+  return end-start;
+}
+
+template <typename I, typename D>
+const std::vector<I>& Mat<I, D>::get_row_partitions() const
+{
+  return _row_partitions;
+}
+
+template <typename I, typename D>
+const std::vector<I>& Mat<I, D>::get_col_partitions() const
+{
+  return _col_partitions;
+}
+
+/*=========================================*/
+/*** value setting and memory allocation ***/
+
+template <typename I, typename D>
+void Mat<I, D>::set_value(I row, I col, D value)
+{
+  _add_element(row, col, value);
+}
+
+template <typename I, typename D>
+void Mat<I, D>::set_values(const I* rows, const I* cols, const D* vals, I n)
+{
+  /* grow geometrically, so that many small batches are still cheap */
+  size_t size = _elements.size() + n;
+  if (size > _elements.capacity()) {
+    _elements.reserve(std::max(size, 2*_elements.capacity()));
+  }
+
+  for (I k = 0; k < n; ++k) {
+    _add_element(rows[k], cols[k], vals[k]);
+  }
+}
+
+template <typename I, typename D>
+void Mat<I, D>::_add_element(I row, I col, D value)
+{
+#ifdef DEBUG
+  assert(row >= 0 && row < _M);
+  assert(col >= 0 && col < _N);
+#endif
+
+  I rstart, rend;
+  get_local_rows(rstart, rend);
+
+  if (row >= rstart && row < rend) {
+    _elements.push_back(std::make_pair( std::make_pair(row, col), value ));
+    return;
+  }
+
+  if (_assembly != UNASSEMBLED) {
+    throw std::logic_error("Cannot set values in other ranks' rows after assemble_begin()");
+  }
+
+  if (_stash.empty()) {
+    _stash.resize(upcxx::rank_n());
+  }
+  _stash[_row_owner(row)].push_back(std::make_pair( std::make_pair(row, col), value ));
+}
+
+/*================*/
+/*** assembly ***/
+
+template <typename I, typename D>
+void Mat<I, D>::assemble_begin()
+{
+  if (_assembly != UNASSEMBLED) {
+    throw std::logic_error("assemble_begin() already called");
+  }
+
+  typedef std::pair< std::pair<I,I>, D> element_t;
+
+  _assembly_obj = std::make_shared< upcxx::dist_object< Mat<I,D>* > >(this);
+  _assembly_fut = upcxx::make_future();
+
+  for (size_t owner = 0; owner < _stash.size(); ++owner) {
+    if (_stash[owner].empty()) {
+      continue;
+    }
+    _assembly_fut = upcxx::when_all(_assembly_fut,
+      upcxx::rpc(owner,
+                 [] (upcxx::dist_object< Mat<I,D>* >& m, upcxx::view<element_t> elements) {
+                   (*m)->_elements.insert((*m)->_elements.end(), elements.begin(), elements.end());
+                 }, *_assembly_obj, upcxx::make_view(_stash[owner].begin(), _stash[owner].end()))
+    );
+  }
+
+  /* the views are serialized when the rpcs are sent, so the stash can go */
+  std::vector< std::vector<element_t> >().swap(_stash);
+
+  _assembly = ASSEMBLING;
+}
+
+template <typename I, typename D>
+void Mat<I, D>::assemble_end()
+{
+  if (_assembly != ASSEMBLING) {
+    throw std::logic_error("Must call assemble_begin() before assemble_end()");
+  }
+
+  /* once everyone's batches have been added, no more can arrive */
+  _assembly_fut.wait();
+  upcxx::barrier();
+  _assembly_obj.reset();
+
+  _assembly = ASSEMBLED;
+}
+
+template <typename I, typename D>
+void Mat<I, D>::_assemble()
+{
+  if (_assembly == UNASSEMBLED) {
+    assemble_begin();
+  }
+  if (_assembly == ASSEMBLING) {
+    assemble_end();
+  }
+  if (_reorder && !_reordered) {
+    _reorder_elements();
+  }
+}
+
+/*================*/
+/*** reordering ***/
+
+template <typename I, typename D>
+void Mat<I, D>::set_reordering(bool enable)
+{
+  if (_assembly == ASSEMBLED) {
+    throw std::logic_error("Must set reordering before setup()");
+  }
+  _reorder = enable;
+}
+
+template <typename I, typename D>
+bool Mat<I, D>::get_reordering() const
+{
+  return _reorder;
+}
+
+template <typename I, typename D>
+const std::vector<I>& Mat<I, D>::get_permutation() const
+{
+  return _perm;
+}
+
+template <typename I, typename D>
+void Mat<I, D>::_reorder_elements()
+{
+  if (_M != _N || _row_partitions != _col_partitions) {
+    throw std::logic_error("Reordering needs a square matrix, with square diagonal blocks");
+  }
+
+  if (_upper_triangle) {
+    size_t n = 0;
+    for (size_t k = 0; k < _elements.size(); ++k) {
+      if (_elements[k].first.second >= _elements[k].first.first) {
+        _elements[n++] = _elements[k];
+      }
+    }
+    _elements.resize(n);
+  }
+
+  /* our rows' edges, which the ordering completes with their transposes */
+  std::vector< std::pair<I,I> > edges;
+  edges.reserve(_elements.size());
+  for (const auto& e: _elements) {
+    if (e.first.first != e.first.second) {
+      edges.push_back(e.first);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  _perm = _rcm_ordering_distributed(_row_partitions, edges);
+  std::vector< std::pair<I,I> >().swap(edges);
+
+  /* the new indices of the remote columns we use, asked of their owners */
+  I rstart, rend;
+  get_local_rows(rstart, rend);
+
+  std::vector<I> remote;
+  for (const auto& e: _elements) {
+    if (e.first.second < rstart || e.first.second >= rend) {
+      remote.push_back(e.first.second);
+    }
+  }
+  std::sort(remote.begin(), remote.end());
+  remote.erase(std::unique(remote.begin(), remote.end()), remote.end());
+
+  std::vector<I> remote_perm(remote.size());
+  {
+    upcxx::dist_object< const std::vector<I>* > perm_obj(&_perm);
+
+    std::vector< std::pair< size_t, upcxx::future< std::vector<I> > > > requests;
+    for (size_t k = 0; k < remote.size(); ) {
+      int proc = _row_owner(remote[k]);
+      size_t first = k;
+      while (k < remote.size() && remote[k] < _row_partitions[proc+1]) {
+        ++k;
+      }
+      requests.push_back(std::make_pair(first,
+        upcxx::rpc(proc,
+                   [] (upcxx::dist_object< const std::vector<I>* >& perm, I start, upcxx::view<I> idxs) {
+                     std::vector<I> renumbered;
+                     renumbered.reserve(idxs.size());
+                     for (I idx: idxs) {
+                       renumbered.push_back((**perm)[idx - start]);
+                     }
+                     return renumbered;
+                   }, perm_obj, _row_partitions[proc], upcxx::make_view(remote.begin() + first, remote.begin() + k))
+      ));
+    }
+
+    for (auto& r: requests) {
+      std::vector<I> renumbered = r.second.wait();
+      std::copy(renumbered.begin(), renumbered.end(), remote_perm.begin() + r.first);
+    }
+
+    /* the other ranks may still be asking us */
+    upcxx::barrier();
+  }
+
+  auto renumber = [&] (I idx) {
+    if (idx >= rstart && idx < rend) {
+      return _perm[idx - rstart];
+    }
+    return remote_perm[std::lower_bound(remote.begin(), remote.end(), idx) - remote.begin()];
+  };
+
+  /* renumber, stashing the rows that now belong to other ranks */
+  _stash.resize(upcxx::rank_n());
+  size_t n = 0;
+  for (size_t k = 0; k < _elements.size(); ++k) {
+    I row = renumber(_elements[k].first.first);
+    I col = renumber(_elements[k].first.second);
+    D value = _elements[k].second;
+    if (_upper_triangle && col < row) {
+      /* A(j,i) = conj(A(i,j)) */
+      std::swap(row, col);
+      value = _conj(value);
+    }
+
+    auto e = std::make_pair( std::make_pair(row, col), value );
+    if (row >= rstart && row < rend) {
+      _elements[n++] = e;
+    }
+    else {
+      _stash[_row_owner(row)].push_back(e);
+    }
+  }
+  _elements.resize(n);
+
+  _assembly = UNASSEMBLED;
+  assemble_begin();
+  assemble_end();
+  _reordered = true;
+}
+
+/*==========================*/
+/*** communication tuning ***/
+
+template <typename I, typename D>
+void Mat<I, D>::set_block_size(I block_size)
+{
+  if (block_size <= 0) {
+    throw std::invalid_argument("block size must be > 0");
+  }
+  _block_size = block_size;
+}
+
+template <typename I, typename D>
+I Mat<I, D>::get_block_size() const
+{
+  return _block_size;
+}
+
+template <typename I, typename D>
+void Mat<I, D>::set_nbufs(int nbufs)
+{
+  if (nbufs <= 0) {
+    throw std::invalid_argument("number of buffers must be > 0");
+  }
+  _nbufs = nbufs;
+}
+
+template <typename I, typename D>
+int Mat<I, D>::get_nbufs() const
+{
+  return _nbufs;
+}
+
+template <typename I, typename D>
+void Mat<I, D>::autotune(int reps)
+{
+  if (reps <= 0) {
+    throw std::invalid_argument("reps must be > 0");
+  }
+
+  _tune_candidates.clear();
+
+  /* nothing to tune for this matrix type */
+  if (!_tune_block_size) {
+    return;
+  }
+
+  for (I block_size = 256; block_size <= 16384; block_size *= 2) {
+    if (_tune_nbufs) {
+      for (int nbufs = 1; nbufs <= 8; nbufs *= 2) {
+        _tune_candidates.push_back(std::make_pair(block_size, nbufs));
+      }
+    }
+    else {
+      _tune_candidates.push_back(std::make_pair(block_size, _nbufs));
+    }
+  }
+
+  _tune_times.assign(_tune_candidates.size(), 0);
+  _tune_idx = 0;
+  _tune_rep = 0;
+  _tune_reps = reps;
+
+  _block_size = _tune_candidates[0].first;
+  _nbufs = _tune_candidates[0].second;
+}
+
+template <typename I, typename D>
+bool Mat<I, D>::is_tuning() const
+{
+  return _tune_idx < _tune_candidates.size();
+}
+
+template <typename I, typename D>
+void Mat<I, D>::_tune_start() const
+{
+  if (is_tuning()) {
+    _tune_tick = std::chrono::steady_clock::now();
+  }
+}
+
+template <typename I, typename D>
+void Mat<I, D>::_tune_stop() const
+{
+  if (!is_tuning()) {
+    return;
+  }
+
+  auto tock = std::chrono::steady_clock::now();
+  _tune_times[_tune_idx] += std::chrono::duration<double>(tock - _tune_tick).count();
+
+  if (++_tune_rep < _tune_reps) {
+    return;
+  }
+
+  _tune_rep = 0;
+  _tune_idx++;
+
+  if (is_tuning()) {
+    _block_size = _tune_candidates[_tune_idx].first;
+    _nbufs = _tune_candidates[_tune_idx].second;
+    return;
+  }
+
+  /* tried them all. the product is only as fast as the slowest rank */
+  std::vector<double> slowest(_tune_times.size());
+  upcxx::reduce_all(_tune_times.data(), slowest.data(), slowest.size(), upcxx::op_fast_max).wait();
+  size_t best = std::min_element(slowest.begin(), slowest.end()) - slowest.begin();
+
+  _block_size = _tune_candidates[best].first;
+  _nbufs = _tune_candidates[best].second;
+}
+
+/*===============*/
+/*** threading ***/
+
+template <typename I, typename D>
+void Mat<I, D>::set_num_threads(int nthreads)
+{
+  if (nthreads <= 0) {
+    throw std::invalid_argument("number of threads must be > 0");
+  }
+
+  if (nthreads == 1) {
+    _pool.reset();
+  }
+  else if (nthreads != get_num_threads()) {
+    _pool = std::make_shared<ThreadPool>(nthreads);
+  }
+}
+
+template <typename I, typename D>
+int Mat<I, D>::get_num_threads() const
+{
+  return _pool ? _pool->get_num_threads() : 1;
+}
+
+template <typename I, typename D>
+ThreadPool* Mat<I, D>::_get_pool() const
+{
+  return _pool.get();
+}
+
+template <typename I, typename D>
+void Mat<I, D>::set_progress_thread(bool enable)
+{
+  if (!enable) {
+    _progress_pool.reset();
+  }
+  else if (!_progress_pool) {
+    _progress_pool = std::make_shared<ThreadPool>(2);
+  }
+}
+
+template <typename I, typename D>
+bool Mat<I, D>::get_progress_thread() const
+{
+  return bool(_progress_pool);
+}
+
+template <typename I, typename D>
+ThreadPool* Mat<I, D>::_get_progress_pool() const
+{
+  return _progress_pool.get();
+}
+
+template <typename I, typename D>
+template <typename Col, typename Before, typename Consume>
+void Mat<I, D>::_progress_stream(Vec<I,D>& x, I n, Col col, Before before, Consume consume) const
+{
+  I nslots = std::max(I(1), std::min(n, _block_size));
+
+  std::vector<D> vals(nslots);
+  std::vector< upcxx::future<> > futs(nslots);
+  SlotHandoff handoff;
+  handoff.reset(nslots);
+
+  _progress_pool->run([&] (int t) {
+
+    if (t == 1) {
+      /* the helper: all of the compute */
+      before();
+      for (I j = 0; j < n; ++j) {
+        handoff.wait_ready(j % nslots);
+        consume(j, vals[j % nslots]);
+        handoff.set(j % nslots, SlotHandoff::EMPTY);
+      }
+      return;
+    }
+
+    /* the calling thread: refill the slots as they empty, and hand them over as they land */
+    I issued = 0, landed = 0;
+    while (landed < n) {
+      while (issued < n && handoff.get(issued % nslots) == SlotHandoff::EMPTY) {
+        futs[issued % nslots] = upcxx::rget(x[col(issued)].get_address(), &vals[issued % nslots], 1);
+        handoff.set(issued % nslots, SlotHandoff::IN_FLIGHT);
+        issued++;
+      }
+
+      upcxx::progress();
+
+      bool moved = false;
+      while (landed < issued && futs[landed % nslots].ready()) {
+        handoff.set(landed % nslots, SlotHandoff::READY);
+        landed++;
+        moved = true;
+      }
+
+      if (!moved) {
+        std::this_thread::yield();
+      }
+    }
+  });
+}
+
+/*=====================*/
+/* CSR MATRIX          */
+/*=====================*/
+
+/*
+ * sort the columns (and corresponding values) of one CSR row, summing the
+ * values of repeated columns. returns the new length of the row
+ */
+template <typename I, typename D>
+static I _sort_sum_csr_row(I* cols, D* vals, I n)
+{
+  /* rows are usually set in order, so check that first */
+  bool increasing = true;
+  for (I i = 1; i < n && increasing; ++i) {
+    increasing = cols[i-1] < cols[i];
+  }
+  if (increasing) {
+    return n;
+  }
+
+  /* stable, so that repeated entries are summed in the order they were set */
+  if (n <= 32) {
+    for (I i = 1; i < n; ++i) {
+      I c = cols[i];
+      D v = vals[i];
+      I j = i;
+      for (; j > 0 && cols[j-1] > c; --j) {
+        cols[j] = cols[j-1];
+        vals[j] = vals[j-1];
+      }
+      cols[j] = c;
+      vals[j] = v;
+    }
+  }
+  else {
+    std::vector< std::pair<I,D> > tmp(n);
+    for (I i = 0; i < n; ++i) {
+      tmp[i] = std::make_pair(cols[i], vals[i]);
+    }
+    std::stable_sort(tmp.begin(), tmp.end(),
+                     [] (const std::pair<I,D>& a, const std::pair<I,D>& b) { return a.first < b.first; });
+    for (I i = 0; i < n; ++i) {
+      cols[i] = tmp[i].first;
+      vals[i] = tmp[i].second;
+    }
+  }
+
+  I len = 0;
+  for (I i = 0; i < n; ++i) {
+    if (len > 0 && cols[len-1] == cols[i]) {
+      vals[len-1] += vals[i];
+    }
+    else {
+      cols[len] = cols[i];
+      vals[len] = vals[i];
+      ++len;
+    }
+  }
+  return len;
+}
+
+/*
+ * sort and sum each row of a CSR matrix on the threads of pool, and then
+ * close up the gaps left by the repeated entries. if row_end is given, row i
+ * is only filled up to row_end[i]
+ */
+template <typename I, typename D>
+static void _sort_sum_csr(ThreadPool* pool, std::vector<I>& row_ptr, std::vector<I>& cols,
+                          std::vector<D>& vals, const I* row_end = nullptr)
+{
+  I nrows = row_ptr.size() - 1;
+  std::vector<I> lens(nrows);
+
+  auto sort_rows = [&] (I start, I end) {
+    for (I i = start; i < end; ++i) {
+      I len = (row_end ? row_end[i] : row_ptr[i+1]) - row_ptr[i];
+      lens[i] = _sort_sum_csr_row(cols.data() + row_ptr[i], vals.data() + row_ptr[i], len);
+    }
+  };
+
+  if (pool == nullptr || pool->get_num_threads() == 1) {
+    sort_rows(0, nrows);
+  }
+  else {
+    pool->run([&] (int t) {
+      I start, end;
+      _balanced_range(row_ptr.data(), nrows, t, pool->get_num_threads(), start, end);
+      sort_rows(start, end);
+    });
+  }
+
+  /* each row only moves towards the front, so this can go in order in place */
+  I pos = 0;
+  for (I i = 0; i < nrows; ++i) {
+    I start = row_ptr[i];
+    row_ptr[i] = pos;
+    if (pos != start) {
+      std::copy(cols.begin() + start, cols.begin() + start + lens[i], cols.begin() + pos);
+      std::copy(vals.begin() + start, vals.begin() + start + lens[i], vals.begin() + pos);
+    }
+    pos += lens[i];
+  }
+  row_ptr[nrows] = pos;
+  cols.resize(pos);
+  vals.resize(pos);
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::setup(I, I)
+{
+  if (!this->size_set) {
+    throw std::logic_error("Must set size before calling setup()");
+  }
+  if (is_set_up) {
+    throw std::logic_error("Matrix already set up");
+  }
+  if (_preallocated && this->get_reordering()) {
+    throw std::logic_error("Cannot reorder a preallocated matrix");
+  }
+  if (_loaded && this->get_reordering()) {
+    throw std::logic_error("Cannot reorder a matrix set with set_local_csr()");
+  }
+
+  this->_assemble();
+
+  if (_loaded) {
+    if (!this->_elements.empty()) {
+      throw std::logic_error("Cannot set values in a matrix set with set_local_csr()");
+    }
+    is_set_up = true;
+    return;
+  }
+
+  ThreadPool* pool = this->_get_pool();
+
+  if (_preallocated) {
+    /* only the elements that came from other ranks are left to place */
+    for (const auto& e: this->_elements) {
+      _place(e.first.first, e.first.second, e.second);
+    }
+    std::vector< std::pair< std::pair<I,I>, D> >().swap(this->_elements);
+
+    _sort_sum_csr(pool, _local_row_ptr, _local_cols, _local_vals, _local_fill.data());
+    _sort_sum_csr(pool, _remote_row_ptr, _remote_cols, _remote_vals, _remote_fill.data());
+
+    std::vector<I>().swap(_local_fill);
+    std::vector<I>().swap(_remote_fill);
+
+    is_set_up = true;
+    return;
+  }
+
+  I rstart, rend;
+  I cstart, cend;
+
+  this->get_local_rows(rstart, rend);
+  this->get_diag_cols(cstart, cend);
+
+  I local_size = rend - rstart;
+
+  /* the plan: a counting sort of the elements into rows, then sort each row
+   * and sum any repeated entries. each thread counts, and then places, its
+   * own slice of the elements, so the rows keep the order things were set in */
+
+  const auto& elements = this->_elements;
+  size_t nnz = elements.size();
+
+  int nthreads = pool ? pool->get_num_threads() : 1;
+
+  auto on_threads = [&] (const std::function<void(int)>& f) {
+    if (nthreads == 1) f(0);
+    else pool->run(f);
+  };
+
+  /* the next free slot for each thread in each row, after the prefix sum */
+  std::vector<I> local_fill(size_t(nthreads) * local_size, 0);
+  std::vector<I> remote_fill(size_t(nthreads) * local_size, 0);
+
+  on_threads([&] (int t) {
+    I* local_count = local_fill.data() + size_t(t) * local_size;
+    I* remote_count = remote_fill.data() + size_t(t) * local_size;
+    for (size_t k = nnz * t / nthreads; k < nnz * (t+1) / nthreads; ++k) {
+      I row = elements[k].first.first, col = elements[k].first.second;
+      if (col >= cstart && col < cend) {
+        local_count[row-rstart]++;
+      }
+      else {
+        remote_count[row-rstart]++;
+      }
+    }
+  });
+
+  _local_row_ptr.assign(local_size + 1, 0);
+  _remote_row_ptr.assign(local_size + 1, 0);
+
+  I local_pos = 0, remote_pos = 0;
+  for (I i = 0; i < local_size; ++i) {
+    _local_row_ptr[i] = local_pos;
+    _remote_row_ptr[i] = remote_pos;
+    for (int t = 0; t < nthreads; ++t) {
+      I n = local_fill[size_t(t) * local_size + i];
+      local_fill[size_t(t) * local_size + i] = local_pos;
+      local_pos += n;
+
+      n = remote_fill[size_t(t) * local_size + i];
+      remote_fill[size_t(t) * local_size + i] = remote_pos;
+      remote_pos += n;
+    }
+  }
+  _local_row_ptr[local_size] = local_pos;
+  _remote_row_ptr[local_size] = remote_pos;
+
+  _local_cols.resize(local_pos);
+  _local_vals.resize(local_pos);
+  _remote_cols.resize(remote_pos);
+  _remote_vals.resize(remote_pos);
+
+  on_threads([&] (int t) {
+    I* local_next = local_fill.data() + size_t(t) * local_size;
+    I* remote_next = remote_fill.data() + size_t(t) * local_size;
+    for (size_t k = nnz * t / nthreads; k < nnz * (t+1) / nthreads; ++k) {
+      I row = elements[k].first.first, col = elements[k].first.second;
+      D val = elements[k].second;
+      if (col >= cstart && col < cend) {
+        I idx = local_next[row-rstart]++;
+        _local_cols[idx] = col-cstart;
+        _local_vals[idx] = val;
+      }
+      else {
+        I idx = remote_next[row-rstart]++;
+        _remote_cols[idx] = col;
+        _remote_vals[idx] = val;
+      }
+    }
+  });
+
+  /* the COO copy is not needed anymore */
+  std::vector< std::pair< std::pair<I,I>, D> >().swap(this->_elements);
+
+  /* now sort them */
+  _sort_sum_csr(pool, _local_row_ptr, _local_cols, _local_vals);
+  _sort_sum_csr(pool, _remote_row_ptr, _remote_cols, _remote_vals);
+
+  is_set_up = true;
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::preallocate(const I* dnnz, const I* onnz)
+{
+  if (!this->size_set) {
+    throw std::logic_error("Must set size before calling preallocate()");
+  }
+  if (is_set_up) {
+    throw std::logic_error("Matrix already set up");
+  }
+
+  I local_size = this->get_local_rows_size();
+
+  _local_row_ptr.assign(local_size + 1, 0);
+  _remote_row_ptr.assign(local_size + 1, 0);
+  for (I i = 0; i < local_size; ++i) {
+    _local_row_ptr[i+1] = _local_row_ptr[i] + dnnz[i];
+    _remote_row_ptr[i+1] = _remote_row_ptr[i] + onnz[i];
+  }
+
+  _local_cols.resize(_local_row_ptr[local_size]);
+  _local_vals.resize(_local_row_ptr[local_size]);
+  _remote_cols.resize(_remote_row_ptr[local_size]);
+  _remote_vals.resize(_remote_row_ptr[local_size]);
+
+  _local_fill.assign(_local_row_ptr.begin(), _local_row_ptr.end()-1);
+  _remote_fill.assign(_remote_row_ptr.begin(), _remote_row_ptr.end()-1);
+
+  _preallocated = true;
+
+  /* anything set already goes in its place now */
+  I rstart, rend;
+  this->get_local_rows(rstart, rend);
+  for (const auto& e: this->_elements) {
+    if (e.first.first >= rstart && e.first.first < rend) {
+      _place(e.first.first, e.first.second, e.second);
+    }
+  }
+  std::vector< std::pair< std::pair<I,I>, D> >().swap(this->_elements);
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::set_value(I row, I col, D value)
+{
+  I rstart, rend;
+  this->get_local_rows(rstart, rend);
+
+  if (_preallocated && row >= rstart && row < rend) {
+#ifdef DEBUG
+    assert(col >= 0 && col < this->_N);
+#endif
+    _place(row, col, value);
+  }
+  else {
+    Mat<I,D>::set_value(row, col, value);
+  }
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::set_values(const I* rows, const I* cols, const D* vals, I n)
+{
+  if (!_preallocated) {
+    Mat<I,D>::set_values(rows, cols, vals, n);
+    return;
+  }
+  for (I k = 0; k < n; ++k) {
+    set_value(rows[k], cols[k], vals[k]);
+  }
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::_place(I row, I col, D value)
+{
+  I rstart, rend;
+  I cstart, cend;
+  this->get_local_rows(rstart, rend);
+  this->get_diag_cols(cstart, cend);
+
+  I i = row - rstart;
+  if (col >= cstart && col < cend) {
+    if (_local_fill[i] == _local_row_ptr[i+1]) {
+      throw std::length_error("more diagonal block values set in a row than preallocated");
+    }
+    I idx = _local_fill[i]++;
+    _local_cols[idx] = col-cstart;
+    _local_vals[idx] = value;
+  }
+  else {
+    if (_remote_fill[i] == _remote_row_ptr[i+1]) {
+      throw std::length_error("more off-diagonal values set in a row than preallocated");
+    }
+    I idx = _remote_fill[i]++;
+    _remote_cols[idx] = col;
+    _remote_vals[idx] = value;
+  }
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::set_local_csr(const I* row_ptr, const I* cols, const D* vals)
+{
+  if (!this->size_set) {
+    throw std::logic_error("Must set size before calling set_local_csr()");
+  }
+  if (is_set_up) {
+    throw std::logic_error("Matrix already set up");
+  }
+  if (_preallocated || _loaded) {
+    throw std::logic_error("Matrix storage already set");
+  }
+
+  I rstart, rend;
+  I cstart, cend;
+  this->get_local_rows(rstart, rend);
+  this->get_diag_cols(cstart, cend);
+  I local_size = rend - rstart;
+
+  /* each row's diagonal block columns are one run, if the row is sorted */
+  _local_row_ptr.assign(local_size + 1, 0);
+  _remote_row_ptr.assign(local_size + 1, 0);
+  bool sorted = true;
+  for (I i = 0; i < local_size; ++i) {
+    I start = row_ptr[i], end = row_ptr[i+1];
+    I dstart = std::lower_bound(cols + start, cols + end, cstart) - cols;
+    I dend = std::lower_bound(cols + dstart, cols + end, cend) - cols;
+    _local_row_ptr[i+1] = _local_row_ptr[i] + (dend - dstart);
+    _remote_row_ptr[i+1] = _remote_row_ptr[i] + (end - start) - (dend - dstart);
+    for (I j = start + 1; j < end && sorted; ++j) {
+      sorted = cols[j-1] < cols[j];
+    }
+  }
+
+  if (!sorted) {
+    /* the long way: count again by column, then sort and sum */
+    for (I i = 0; i < local_size; ++i) {
+      I nlocal = 0;
+      for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+        nlocal += (cols[j] >= cstart && cols[j] < cend);
+      }
+      _local_row_ptr[i+1] = _local_row_ptr[i] + nlocal;
+      _remote_row_ptr[i+1] = _remote_row_ptr[i] + (row_ptr[i+1] - row_ptr[i]) - nlocal;
+    }
+  }
+
+  _local_cols.resize(_local_row_ptr[local_size]);
+  _local_vals.resize(_local_row_ptr[local_size]);
+  _remote_cols.resize(_remote_row_ptr[local_size]);
+  _remote_vals.resize(_remote_row_ptr[local_size]);
+
+  ThreadPool* pool = this->_get_pool();
+  auto fill_rows = [&] (I first, I last) {
+    for (I i = first; i < last; ++i) {
+      I local_idx = _local_row_ptr[i], remote_idx = _remote_row_ptr[i];
+      for (I j = row_ptr[i]; j < row_ptr[i+1]; ++j) {
+        if (cols[j] >= cstart && cols[j] < cend) {
+          _local_cols[local_idx] = cols[j] - cstart;
+          _local_vals[local_idx++] = vals[j];
+        }
+        else {
+          _remote_cols[remote_idx] = cols[j];
+          _remote_vals[remote_idx++] = vals[j];
+        }
+      }
+    }
+  };
+
+  if (pool) {
+    pool->run([&] (int t) {
+      I first, last;
+      _balanced_range(row_ptr, local_size, t, pool->get_num_threads(), first, last);
+      fill_rows(first, last);
+    });
+  }
+  else {
+    fill_rows(0, local_size);
+  }
+
+  if (!sorted) {
+    _sort_sum_csr(pool, _local_row_ptr, _local_cols, _local_vals);
+    _sort_sum_csr(pool, _remote_row_ptr, _remote_cols, _remote_vals);
+  }
+
+  _loaded = true;
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::get_local_csr(std::vector<I>& row_ptr, std::vector<I>& cols,
+                                 std::vector<D>& vals) const
+{
+  if (!is_set_up) {
+    throw std::logic_error("Must call setup() before get_local_csr()");
+  }
+
+  I rstart, rend;
+  I cstart, cend;
+  this->get_local_rows(rstart, rend);
+  this->get_diag_cols(cstart, cend);
+  I local_size = rend - rstart;
+
+  if (!_keeps_csr) {
+    throw std::logic_error("This matrix type does not keep its CSR arrays after setup()");
+  }
+
+  auto global_col = [this] (I j) {
+    return _remote_compressed ? _ghost_cols[_remote_cols[j]] : _remote_cols[j];
+  };
+
+  row_ptr.resize(local_size + 1);
+  cols.resize(_local_row_ptr[local_size] + _remote_row_ptr[local_size]);
+  vals.resize(cols.size());
+
+  /* the remote columns left of the diagonal block, the block, then the rest */
+  I pos = 0;
+  for (I i = 0; i < local_size; ++i) {
+    row_ptr[i] = pos;
+    I j = _remote_row_ptr[i];
+    for (; j < _remote_row_ptr[i+1] && global_col(j) < cstart; ++j) {
+      cols[pos] = global_col(j);
+      vals[pos++] = _remote_vals[j];
+    }
+    for (I k = _local_row_ptr[i]; k < _local_row_ptr[i+1]; ++k) {
+      cols[pos] = _local_cols[k] + cstart;
+      vals[pos++] = _local_vals[k];
+    }
+    for (; j < _remote_row_ptr[i+1]; ++j) {
+      cols[pos] = global_col(j);
+      vals[pos++] = _remote_vals[j];
+    }
+  }
+  row_ptr[local_size] = pos;
+}
+
+/* y += A_local * x_local, for the block diagonal part */
+template <typename I, typename D>
+void CSRMat<I, D>::_local_plusdot(const D* x_array, D* y_array) const
+{
+  _csr_plusdot_threaded(this->_get_pool(), this->get_local_rows_size(), _local_row_ptr.data(),
+                        _local_cols.data(), _local_vals.data(), x_array, y_array);
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::_local_plusdot(const D* x_array, D* y_array, int k) const
+{
+  _csr_plusdot_multi(this->get_local_rows_size(), _local_row_ptr.data(), _local_cols.data(),
+                     _local_vals.data(), x_array, y_array, k);
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::_compress_remote_cols()
+{
+  /* collect the unique remote columns */
+  _ghost_cols = _remote_cols;
+  std::sort(_ghost_cols.begin(), _ghost_cols.end());
+  _ghost_cols.erase(std::unique(_ghost_cols.begin(), _ghost_cols.end()), _ghost_cols.end());
+  _ghost_cols.shrink_to_fit();
+
+  /* renumber the remote columns to point into the ghost buffer */
+  for (auto& col: _remote_cols) {
+    col = std::lower_bound(_ghost_cols.begin(), _ghost_cols.end(), col) - _ghost_cols.begin();
+  }
+
+  _remote_compressed = true;
+}
+
+template <typename I, typename D>
+void CSRMat<I, D>::_setup_transpose() const
+{
+  if (_remote_compressed) {
+    _add_scatter.setup(_ghost_cols, this->_col_partitions);
+    _add_vals.resize(_ghost_cols.size());
+    return;
+  }
+
+  std::vector<I> ghost_cols = _remote_cols;
+  std::sort(ghost_cols.begin(), ghost_cols.end());
+  ghost_cols.erase(std::unique(ghost_cols.begin(), ghost_cols.end()), ghost_cols.end());
+
+  _transpose_slots.resize(_remote_cols.size());
+  for (size_t j = 0; j < _remote_cols.size(); ++j) {
+    _transpose_slots[j] = std::lower_bound(ghost_cols.begin(), ghost_cols.end(), _remote_cols[j])
+                          - ghost_cols.begin();
+  }
+
+  _add_scatter.setup(ghost_cols, this->_col_partitions);
+  _add_vals.resize(ghost_cols.size());
+}
+
+/* Mat-transpose-vector product y = A^T*x */
+template <typename I, typename D>
+void CSRMat<I, D>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot_transpose(x, y);
+}
+
+/* Mat-transpose-vector sum product y = A^T*x + y */
+template <typename I, typename D>
+void CSRMat<I, D>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_transpose_dimensions(x, y);
+  if (!is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
+
+  if (!_add_scatter.is_set_up()) {
+    _setup_transpose();
+  }
+
+  I local_size = this->get_local_rows_size();
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  /* sum up the remote contributions first, so they travel during the local part */
+  std::fill(_add_vals.begin(), _add_vals.end(), D(0));
+  const I* slots = _remote_compressed ? _remote_cols.data() : _transpose_slots.data();
+  _csr_plusdot_transpose(local_size, _remote_row_ptr.data(), slots, _remote_vals.data(),
+                         x_array, _add_vals.data());
+
+  _add_scatter.begin(_add_vals.data());
+
+  _csr_plusdot_transpose(local_size, _local_row_ptr.data(), _local_cols.data(),
+                         _local_vals.data(), x_array, y_array);
+
+  _add_scatter.complete(y);
+}
+
+/*=====================*/
+/* CSRNAIVE MATRIX     */
+/*=====================*/
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void NaiveCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void NaiveCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  /* first do the local matvec */
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I local_size = this->get_local_rows_size();
+
+  this->_local_plusdot(x_array, y_array);
+
+  /* now remote part */
+  for (I i = 0; i < local_size; ++i) {
+    for (I j = this->_remote_row_ptr[i]; j < this->_remote_row_ptr[i+1]; ++j) {
+      /* x[col] implicitly gets the remote value */
+      y_array[i] += this->_remote_vals[j] * x[this->_remote_cols[j]].get();
+    }
+  }
+
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void NaiveCSRMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void NaiveCSRMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  /* first do the local matvec */
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I local_size = this->get_local_rows_size();
+  int k = x.get_num_vecs();
+
+  this->_local_plusdot(x_array, y_array, k);
+
+  /* now remote part, fetching the row of x for each entry */
+  std::vector<D> x_row(k);
+  for (I i = 0; i < local_size; ++i) {
+    for (I j = this->_remote_row_ptr[i]; j < this->_remote_row_ptr[i+1]; ++j) {
+      I col = this->_remote_cols[j];
+      x.read_range_async(col, col+1, x_row.data()).wait();
+      for (int t = 0; t < k; ++t) {
+        y_array[i*k + t] += this->_remote_vals[j] * x_row[t];
+      }
+    }
+  }
+
+}
+
+/*=====================*/
+/* CSRBLOCK MATRIX     */
+/*=====================*/
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void BlockCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/*
+ * the blocks cover the remote part of x, with each block coming from a
+ * single owner. they are ordered round-robin over the owners, starting from
+ * the rank after us, so that the fetches in flight are spread over several
+ * ranks (and all the ranks don't ask rank 0 first).
+ */
+template <typename I, typename D>
+void BlockCSRMat<I,D>::_get_blocks(std::vector< std::pair<I,I> >& blocks) const
+{
+  int nranks = upcxx::rank_n();
+  const std::vector<I>& parts = this->_col_partitions;
+
+  blocks.clear();
+
+  bool any_left = true;
+  for (I offset = 0; any_left; offset += this->_block_size) {
+    any_left = false;
+    for (int r = 1; r < nranks; ++r) {
+      int owner = (upcxx::rank_me() + r) % nranks;
+      I start = parts[owner] + offset;
+      if (start < parts[owner+1]) {
+        blocks.push_back(std::make_pair(start, std::min(parts[owner+1], start + this->_block_size)));
+        any_left = true;
+      }
+    }
+  }
+}
+
+template <typename I, typename D>
+void BlockCSRMat<I, D>::setup(I dnz, I onz)
+{
+  CSRMat<I,D>::setup(dnz, onz);
+  _build_blocks();
+}
+
+template <typename I, typename D>
+void BlockCSRMat<I,D>::_build_blocks() const
+{
+  I block_size = this->_block_size;
+  int nranks = upcxx::rank_n();
+  const std::vector<I>& parts = this->_col_partitions;
+
+  _get_blocks(_blocks);
+  I n_blocks = _blocks.size();
+
+  /* block_order maps (owner, block within owner) to the block's position in _blocks */
+  std::vector<I> owner_base(nranks+1, 0);
+  for (int r = 0; r < nranks; ++r) {
+    owner_base[r+1] = owner_base[r] + (parts[r+1] - parts[r] + block_size - 1) / block_size;
+  }
+
+  std::vector<I> block_order(owner_base[nranks]);
+  for (I b = 0; b < n_blocks; ++b) {
+    I owner = this->_col_owner(_blocks[b].first);
+    block_order[owner_base[owner] + (_blocks[b].first - parts[owner]) / block_size] = b;
+  }
+
+  I local_size = this->get_local_rows_size();
+  const I* remote_row_ptr = this->_remote_row_ptr.data();
+  const I* remote_cols = this->_remote_cols.data();
+
+  /* count the segments in each block, then fill them in. since we go through
+   * the rows in order, each block's segments end up sorted by row */
+  _blk_ptr.assign(n_blocks+1, 0);
+
+  for (int pass = 0; pass < 2; ++pass) {
+
+    std::vector<I> fill;
+    if (pass == 1) {
+      for (I b = 0; b < n_blocks; ++b) {
+        _blk_ptr[b+1] += _blk_ptr[b];
+      }
+      _seg_row.resize(_blk_ptr[n_blocks]);
+      _seg_begin.resize(_blk_ptr[n_blocks]);
+      _seg_end.resize(_blk_ptr[n_blocks]);
+      fill.assign(_blk_ptr.begin(), _blk_ptr.end()-1);
+    }
+
+    for (I i = 0; i < local_size; ++i) {
+      I j = remote_row_ptr[i];
+      while (j < remote_row_ptr[i+1]) {
+        I col = remote_cols[j];
+        I owner = this->_col_owner(col);
+        I b = block_order[owner_base[owner] + (col - parts[owner]) / block_size];
+
+        I seg_start = j;
+        while (j < remote_row_ptr[i+1] && remote_cols[j] < _blocks[b].second) {
+          ++j;
+        }
+
+        if (pass == 0) {
+          _blk_ptr[b+1]++;
+        }
+        else {
+          I k = fill[b]++;
+          _seg_row[k] = i;
+          _seg_begin[k] = seg_start;
+          _seg_end[k] = j;
+        }
+      }
+    }
+  }
+
+  /*
+   * drop the blocks that no local row references, and shrink the rest to the
+   * range of columns that are actually used, so that we only fetch the
+   * column footprint of our rows. empty blocks have no segments, so the
+   * segment arrays stay as they are.
+   */
+  I n_kept = 0;
+  for (I b = 0; b < n_blocks; ++b) {
+    I seg_start = _blk_ptr[b], seg_end = _blk_ptr[b+1];
+    if (seg_start == seg_end) {
+      continue;
+    }
+
+    I first_col = _blocks[b].second, last_col = _blocks[b].first;
+    for (I k = seg_start; k < seg_end; ++k) {
+      first_col = std::min(first_col, remote_cols[_seg_begin[k]]);
+      last_col = std::max(last_col, remote_cols[_seg_end[k]-1]);
+    }
+
+    _blocks[n_kept] = std::make_pair(first_col, last_col+1);
+    _blk_ptr[n_kept] = seg_start;
+    n_kept++;
+  }
+  _blk_ptr[n_kept] = _blk_ptr[n_blocks];
+
+  n_blocks = n_kept;
+  _blocks.resize(n_blocks);
+  _blk_ptr.resize(n_blocks+1);
+
+  /* and the buffers to fetch into */
+  I n_slots = std::min(n_blocks, I(this->_nbufs));
+  _bufs.resize(n_slots * block_size);
+  _slot_futs.resize(n_slots);
+  _slot_block.resize(n_slots);
+
+  _built_block_size = block_size;
+  _built_nbufs = this->_nbufs;
+}
+
+template <typename I, typename D>
+void BlockCSRMat<I,D>::_block_plusdot(I b, const D* buf, D* y_array, int k) const
+{
+  I start = _blocks[b].first;
+
+  const I* remote_cols = this->_remote_cols.data();
+  const D* remote_vals = this->_remote_vals.data();
+
+  /* only the rows that have entries in this block */
+  if (k == 1) {
+    for (I seg = _blk_ptr[b]; seg < _blk_ptr[b+1]; ++seg) {
+      D sum = 0;
+      for (I j = _seg_begin[seg]; j < _seg_end[seg]; ++j) {
+        sum += remote_vals[j] * buf[remote_cols[j] - start];
+      }
+      y_array[_seg_row[seg]] += sum;
+    }
+    return;
+  }
+
+  for (I seg = _blk_ptr[b]; seg < _blk_ptr[b+1]; ++seg) {
+    D* y_row = y_array + _seg_row[seg]*k;
+    for (I j = _seg_begin[seg]; j < _seg_end[seg]; ++j) {
+      const D* x_row = buf + (remote_cols[j] - start)*k;
+      for (int t = 0; t < k; ++t) {
+        y_row[t] += remote_vals[j] * x_row[t];
+      }
+    }
+  }
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void BlockCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_dimensions(x, y);
+  _plusdot(x, x.get_local_array_read(), y.get_local_array(), 1);
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void BlockCSRMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void BlockCSRMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  this->check_dimensions(x, y);
+  _plusdot(x, x.get_local_array_read(), y.get_local_array(), x.get_num_vecs());
+}
+
+template <typename I, typename D>
+template <typename X>
+void BlockCSRMat<I,D>::_plusdot(const X& x, const D* x_array, D* y_array, int k) const
+{
+
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  this->_tune_start();
+
+  if (_built_block_size != this->_block_size || _built_nbufs != this->_nbufs) {
+    _build_blocks();
+  }
+
+  I local_size = this->get_local_rows_size();
+  I block_size = this->_block_size;
+
+  I n_blocks = _blocks.size();
+  I n_slots = _slot_block.size();
+
+  /* each slot holds block_size rows of x */
+  I slot_size = block_size * k;
+  if (I(_bufs.size()) < n_slots * slot_size) {
+    _bufs.resize(n_slots * slot_size);
+  }
+
+  if (this->_get_progress_pool() != nullptr) {
+    _progress_plusdot(x, local_size, x_array, y_array, k);
+    this->_tune_stop();
+    return;
+  }
+
+  I next_block = 0, n_done = 0;
+
+  for (I s = 0; s < n_slots; ++s) {
+    _slot_block[s] = next_block;
+    _slot_futs[s] = x.read_range_async(_blocks[next_block].first, _blocks[next_block].second,
+                                       _bufs.data() + s*slot_size);
+    next_block++;
+  }
+
+  /*
+   * work on whichever block has arrived, and refill its slot. between checks,
+   * do the local matvec, so that it fills in the time we would spend waiting
+   */
+  I local_row = 0;
+
+  while (n_done < n_blocks || local_row < local_size) {
+
+    upcxx::progress();
+
+    bool found = false;
+    for (I s = 0; s < n_slots; ++s) {
+      if (_slot_block[s] == I(-1) || !_slot_futs[s].ready()) {
+        continue;
+      }
+
+      found = true;
+      _block_plusdot(_slot_block[s], _bufs.data() + s*slot_size, y_array, k);
+      n_done++;
+
+      if (next_block < n_blocks) {
+        _slot_block[s] = next_block;
+        _slot_futs[s] = x.read_range_async(_blocks[next_block].first, _blocks[next_block].second,
+                                           _bufs.data() + s*slot_size);
+        next_block++;
+      }
+      else {
+        _slot_block[s] = -1;
+      }
+    }
+
+    if (!found && local_row < local_size) {
+      local_row += _local_chunk(local_row, local_size, x_array, y_array, k);
+    }
+  }
+
+  this->_tune_stop();
+}
+
+/*
+ * with the progress thread: the helper does the blocks as they are handed
+ * over and the local part in between, while the calling thread keeps the
+ * slots full
+ */
+template <typename I, typename D>
+template <typename X>
+void BlockCSRMat<I,D>::_progress_plusdot(const X& x, I local_size, const D* x_array, D* y_array,
+                                         int k) const
+{
+  I n_blocks = _blocks.size();
+  I n_slots = _slot_block.size();
+  I slot_size = this->_block_size * k;
+
+  SlotHandoff handoff;
+  handoff.reset(n_slots);
+
+  this->_get_progress_pool()->run([&] (int t) {
+
+    if (t == 1) {
+      I n_done = 0, local_row = 0;
+      while (n_done < n_blocks || local_row < local_size) {
+        bool found = false;
+        for (I s = 0; s < n_slots; ++s) {
+          if (handoff.get(s) != SlotHandoff::READY) {
+            continue;
+          }
+
+          found = true;
+          _block_plusdot(_slot_block[s], _bufs.data() + s*slot_size, y_array, k);
+          n_done++;
+          handoff.set(s, SlotHandoff::EMPTY);
+        }
+
+        if (!found) {
+          if (local_row < local_size) {
+            local_row += _local_chunk(local_row, local_size, x_array, y_array, k);
+          }
+          else {
+            std::this_thread::yield();
+          }
+        }
+      }
+      return;
+    }
+
+    I next_block = 0, n_landed = 0;
+    while (n_landed < n_blocks) {
+      for (I s = 0; s < n_slots && next_block < n_blocks; ++s) {
+        if (handoff.get(s) == SlotHandoff::EMPTY) {
+          _slot_block[s] = next_block;
+          _slot_futs[s] = x.read_range_async(_blocks[next_block].first, _blocks[next_block].second,
+                                             _bufs.data() + s*slot_size);
+          handoff.set(s, SlotHandoff::IN_FLIGHT);
+          next_block++;
+        }
+      }
+
+      upcxx::progress();
+
+      bool moved = false;
+      for (I s = 0; s < n_slots; ++s) {
+        if (handoff.get(s) == SlotHandoff::IN_FLIGHT && _slot_futs[s].ready()) {
+          handoff.set(s, SlotHandoff::READY);
+          n_landed++;
+          moved = true;
+        }
+      }
+
+      if (!moved) {
+        std::this_thread::yield();
+      }
+    }
+  });
+}
+
+/* one chunk of the local product, starting at local_row. returns the number of rows done */
+template <typename I, typename D>
+I BlockCSRMat<I,D>::_local_chunk(I local_row, I local_size, const D* x_array, D* y_array,
+                                 int k) const
+{
+  if (k == 1) {
+    /* a bigger chunk when threaded, so each thread still gets a fair share */
+    I chunk = std::min(local_size - local_row, I(LOCAL_POLL_ROWS * this->get_num_threads()));
+    _csr_plusdot_threaded(this->_get_pool(), chunk, this->_local_row_ptr.data() + local_row,
+                          this->_local_cols.data(), this->_local_vals.data(), x_array,
+                          y_array + local_row);
+    return chunk;
+  }
+
+  I chunk = std::min(local_size - local_row, I(LOCAL_POLL_ROWS));
+  _csr_plusdot_multi(chunk, this->_local_row_ptr.data() + local_row, this->_local_cols.data(),
+                     this->_local_vals.data(), x_array, y_array + local_row*k, k);
+  return chunk;
+}
+
+/*=====================*/
+/* CSRSINGLE MATRIX    */
+/*=====================*/
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void SingleCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void SingleCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  this->_tune_start();
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I local_size = this->get_local_rows_size();
+  I block_size = this->_block_size;
+
+  /* the remote entries are contiguous, so we prefetch them in storage order */
+  const I* remote_row_ptr = this->_remote_row_ptr.data();
+  const I* remote_cols = this->_remote_cols.data();
+  const D* remote_vals = this->_remote_vals.data();
+  I remote_nnz = remote_row_ptr[local_size];
+
+  if (this->_get_progress_pool() != nullptr) {
+    const I* local_row_ptr = this->_local_row_ptr.data();
+    const I* local_cols = this->_local_cols.data();
+    const D* local_vals = this->_local_vals.data();
+    I row = 0;
+
+    this->_progress_stream(x, remote_nnz,
+      [&] (I j) { return remote_cols[j]; },
+      [&] { _csr_plusdot_threaded(this->_get_pool(), local_size, local_row_ptr, local_cols,
+                                  local_vals, x_array, y_array); },
+      [&] (I j, D val) {
+        while (remote_row_ptr[row+1] <= j) {
+          row++;
+        }
+        y_array[row] += remote_vals[j] * val;
+      });
+
+    this->_tune_stop();
+    return;
+  }
+
+  /* start fetching the x values for the first rows of mat */
+  std::vector<RData<I,D>> prefetched(block_size);
+  I pfch_idx;
+
+  for (pfch_idx = 0; pfch_idx < std::min(remote_nnz, block_size); ++pfch_idx) {
+    prefetched[pfch_idx].update(x[remote_cols[pfch_idx]].get_address());
+    prefetched[pfch_idx].prefetch();
+  }
+
+  /* do the local matvec while those values are on their way */
+  this->_local_plusdot(x_array, y_array);
+
+  /* now remote part */
+  for (I i = 0; i < local_size; ++i) {
+    for (I j = remote_row_ptr[i]; j < remote_row_ptr[i+1]; ++j) {
+
+      /* get the prefetched value */
+      D val = prefetched[j % block_size].get();
+
+      /* prefetch the next one into the slot we just emptied */
+      if (pfch_idx < remote_nnz) {
+        prefetched[j % block_size].update(x[remote_cols[pfch_idx]].get_address());
+        prefetched[j % block_size].prefetch();
+        ++pfch_idx;
+      }
+
+      y_array[i] += remote_vals[j] * val;
+    }
+  }
+
+  this->_tune_stop();
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void SingleCSRMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void SingleCSRMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  this->_tune_start();
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I local_size = this->get_local_rows_size();
+  I block_size = this->_block_size;
+  int k = x.get_num_vecs();
+
+  const I* remote_row_ptr = this->_remote_row_ptr.data();
+  const I* remote_cols = this->_remote_cols.data();
+  const D* remote_vals = this->_remote_vals.data();
+  I remote_nnz = remote_row_ptr[local_size];
+
+  /* as for a single vector, but each slot holds the k values of a row of x */
+  std::vector<D> prefetched(block_size * k);
+  std::vector< upcxx::future<> > futs(block_size);
+  I pfch_idx;
+
+  for (pfch_idx = 0; pfch_idx < std::min(remote_nnz, block_size); ++pfch_idx) {
+    futs[pfch_idx] = x.read_range_async(remote_cols[pfch_idx], remote_cols[pfch_idx]+1,
+                                        prefetched.data() + pfch_idx*k);
+  }
+
+  /* do the local matvec while those values are on their way */
+  this->_local_plusdot(x_array, y_array, k);
+
+  /* now remote part */
+  for (I i = 0; i < local_size; ++i) {
+    for (I j = remote_row_ptr[i]; j < remote_row_ptr[i+1]; ++j) {
+
+      I slot = j % block_size;
+      futs[slot].wait();
+
+      for (int t = 0; t < k; ++t) {
+        y_array[i*k + t] += remote_vals[j] * prefetched[slot*k + t];
+      }
+
+      /* prefetch the next one into the slot we just emptied */
+      if (pfch_idx < remote_nnz) {
+        futs[slot] = x.read_range_async(remote_cols[pfch_idx], remote_cols[pfch_idx]+1,
+                                        prefetched.data() + slot*k);
+        ++pfch_idx;
+      }
+    }
+  }
+
+  this->_tune_stop();
+}
+
+/*=====================*/
+/* CSRGHOST MATRIX     */
+/*=====================*/
+
+template <typename I, typename D>
+void GhostCSRMat<I, D>::setup(I dnz, I onz)
+{
+  CSRMat<I,D>::setup(dnz, onz);
+  this->_compress_remote_cols();
+
+  _scatter.setup(this->_ghost_cols, this->_col_partitions);
+  _ghost_vals.resize(this->_ghost_cols.size());
+}
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void GhostCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void GhostCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  /* request the ghost values */
+  _scatter.begin(x, _ghost_vals.data());
+
+  /* do the local matvec while those values are on their way */
+  this->_local_plusdot(x_array, y_array);
+
+  /* now remote part, all out of the ghost buffer */
+  _scatter.complete();
+
+  _csr_plusdot_threaded(this->_get_pool(), this->get_local_rows_size(),
+                        this->_remote_row_ptr.data(), this->_remote_cols.data(),
+                        this->_remote_vals.data(), _ghost_vals.data(), y_array);
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void GhostCSRMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void GhostCSRMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+  int k = x.get_num_vecs();
+
+  /* the ghost buffer holds a row of k values per ghost */
+  if (_ghost_vals.size() < this->_ghost_cols.size() * k) {
+    _ghost_vals.resize(this->_ghost_cols.size() * k);
+  }
+
+  _scatter.begin(x, _ghost_vals.data());
+
+  this->_local_plusdot(x_array, y_array, k);
+
+  _scatter.complete();
+
+  _csr_plusdot_multi(this->get_local_rows_size(), this->_remote_row_ptr.data(),
+                     this->_remote_cols.data(), this->_remote_vals.data(),
+                     _ghost_vals.data(), y_array, k);
+}
+
+/*=====================*/
+/* CSRPUSH MATRIX      */
+/*=====================*/
+
+template <typename I, typename D>
+void PushCSRMat<I, D>::setup(I dnz, I onz)
+{
+  CSRMat<I,D>::setup(dnz, onz);
+  this->_compress_remote_cols();
+
+  _scatter.setup(this->_ghost_cols, this->_col_partitions);
+}
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void PushCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void PushCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  /* send our values to whoever needs them */
+  _scatter.begin(x);
+
+  /* do the local matvec while values are moving */
+  this->_local_plusdot(x_array, y_array);
+
+  /* now remote part, once everything has been pushed to us */
+  _scatter.complete();
+
+  _csr_plusdot_threaded(this->_get_pool(), this->get_local_rows_size(),
+                        this->_remote_row_ptr.data(), this->_remote_cols.data(),
+                        this->_remote_vals.data(), _scatter.get_ghost_array(), y_array);
+
+  _scatter.release();
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void PushCSRMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void PushCSRMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+  int k = x.get_num_vecs();
+
+  /* the owners push a row of k values per ghost */
+  _scatter.begin(x);
+
+  this->_local_plusdot(x_array, y_array, k);
+
+  _scatter.complete();
+
+  _csr_plusdot_multi(this->get_local_rows_size(), this->_remote_row_ptr.data(),
+                     this->_remote_cols.data(), this->_remote_vals.data(),
+                     _scatter.get_ghost_array(), y_array, k);
+
+  _scatter.release();
+}
+
+/*=====================*/
+/* SELL MATRIX         */
+/*=====================*/
+
+template <typename I, typename D>
+void SELLMat<I, D>::set_chunk_size(I chunk_size)
+{
+  if (chunk_size <= 0) {
+    throw std::invalid_argument("chunk size must be positive");
+  }
+  if (this->is_set_up) {
+    throw std::logic_error("Must set chunk size before calling setup()");
+  }
+  _chunk_size = chunk_size;
+}
+
+template <typename I, typename D>
+I SELLMat<I, D>::get_chunk_size() const
+{
+  return _chunk_size;
+}
+
+template <typename I, typename D>
+void SELLMat<I, D>::set_sigma(I sigma)
+{
+  if (sigma <= 0) {
+    throw std::invalid_argument("sigma must be positive");
+  }
+  if (this->is_set_up) {
+    throw std::logic_error("Must set sigma before calling setup()");
+  }
+  _sigma = sigma;
+}
+
+template <typename I, typename D>
+I SELLMat<I, D>::get_sigma() const
+{
+  return _sigma;
+}
+
+template <typename I, typename D>
+void SELLMat<I, D>::setup(I dnz, I onz)
+{
+  if (_sigma % _chunk_size != 0) {
+    throw std::invalid_argument("sigma must be a multiple of the chunk size");
+  }
+
+  CSRMat<I,D>::setup(dnz, onz);
+  this->_compress_remote_cols();
+
+  _nnz = this->_local_cols.size() + this->_remote_cols.size();
+
+  _to_sell(this->_local_row_ptr, this->_local_cols, this->_local_vals, _local);
+  _to_sell(this->_remote_row_ptr, this->_remote_cols, this->_remote_vals, _remote);
+
+  /* we don't need the CSR copy anymore */
+  this->_keeps_csr = false;
+  std::vector<I>().swap(this->_local_row_ptr);
+  std::vector<I>().swap(this->_local_cols);
+  std::vector<D>().swap(this->_local_vals);
+  std::vector<I>().swap(this->_remote_row_ptr);
+  std::vector<I>().swap(this->_remote_cols);
+  std::vector<D>().swap(this->_remote_vals);
+
+  _scatter.setup(this->_ghost_cols, this->_col_partitions);
+  _ghost_vals.resize(this->_ghost_cols.size());
+}
+
+template <typename I, typename D>
+void SELLMat<I, D>::_to_sell(const std::vector<I>& row_ptr, const std::vector<I>& cols,
+                             const std::vector<D>& vals, sell_t& sell) const
+{
+  I nrows = row_ptr.size() - 1;
+  I C = _chunk_size;
+  I nchunks = (nrows + C - 1) / C;
+
+  auto row_len = [&] (I row) { return row_ptr[row+1] - row_ptr[row]; };
+
+  /* sort the rows by decreasing length within each window. the windows line
+   * up with the chunks, so the first row of each chunk is its longest */
+  sell.rows.resize(nrows);
+  for (I i = 0; i < nrows; ++i) {
+    sell.rows[i] = i;
+  }
+  for (I w = 0; w < nrows; w += _sigma) {
+    I wend = std::min(w + _sigma, nrows);
+    std::stable_sort(sell.rows.begin() + w, sell.rows.begin() + wend,
+                     [&] (I a, I b) { return row_len(a) > row_len(b); });
+  }
+
+  sell.chunk_ptr.assign(nchunks + 1, 0);
+  for (I c = 0; c < nchunks; ++c) {
+    sell.chunk_ptr[c+1] = sell.chunk_ptr[c] + row_len(sell.rows[c*C]) * C;
+  }
+
+  sell.cols.resize(sell.chunk_ptr[nchunks]);
+  sell.vals.resize(sell.chunk_ptr[nchunks]);
+
+  for (I c = 0; c < nchunks; ++c) {
+    I width = row_len(sell.rows[c*C]);
+    if (width == 0) {
+      continue;
+    }
+
+    for (I r = 0; r < C; ++r) {
+      I len = 0, start = 0;
+      if (c*C + r < nrows) {
+        start = row_ptr[sell.rows[c*C + r]];
+        len = row_len(sell.rows[c*C + r]);
+      }
+      for (I j = 0; j < width; ++j) {
+        I pos = sell.chunk_ptr[c] + j*C + r;
+        if (j < len) {
+          sell.cols[pos] = cols[start + j];
+          sell.vals[pos] = vals[start + j];
+        }
+        else {
+          /* the kernels skip these, so x is never read for them */
+          sell.cols[pos] = _sell_pad<I>();
+          sell.vals[pos] = 0;
+        }
+      }
+    }
+  }
+}
+
+template <typename I, typename D>
+double SELLMat<I, D>::get_fill_ratio() const
+{
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::get_fill_ratio");
+  }
+  if (_nnz == 0) {
+    return 1;
+  }
+  return double(_local.vals.size() + _remote.vals.size()) / _nnz;
+}
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void SELLMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void SELLMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* request the ghost values */
+  _scatter.begin(x, _ghost_vals.data());
+
+  /* do the local matvec while those values are on their way */
+  _sell_plusdot_threaded(this->_get_pool(), nrows, _chunk_size, _local.chunk_ptr.data(),
+                         _local.rows.data(), _local.cols.data(), _local.vals.data(),
+                         x_array, y_array);
+
+  /* now remote part, all out of the ghost buffer */
+  _scatter.complete();
+
+  _sell_plusdot_threaded(this->_get_pool(), nrows, _chunk_size, _remote.chunk_ptr.data(),
+                         _remote.rows.data(), _remote.cols.data(), _remote.vals.data(),
+                         _ghost_vals.data(), y_array);
+}
+
+/* Mat-transpose-vector product y = A^T*x */
+template <typename I, typename D>
+void SELLMat<I, D>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot_transpose(x, y);
+}
+
+/* Mat-transpose-vector sum product y = A^T*x + y */
+template <typename I, typename D>
+void SELLMat<I,D>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_transpose_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
+
+  if (!this->_add_scatter.is_set_up()) {
+    this->_setup_transpose();
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* the remote columns index _ghost_cols, i.e. the sums to send */
+  std::fill(this->_add_vals.begin(), this->_add_vals.end(), D(0));
+  _sell_plusdot_transpose(nrows, _chunk_size, _remote.chunk_ptr.data(), _remote.rows.data(),
+                          _remote.cols.data(), _remote.vals.data(), x_array,
+                          this->_add_vals.data());
+
+  this->_add_scatter.begin(this->_add_vals.data());
+
+  _sell_plusdot_transpose(nrows, _chunk_size, _local.chunk_ptr.data(), _local.rows.data(),
+                          _local.cols.data(), _local.vals.data(), x_array, y_array);
+
+  this->_add_scatter.complete(y);
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void SELLMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void SELLMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+  int k = x.get_num_vecs();
+
+  if (_ghost_vals.size() < this->_ghost_cols.size() * k) {
+    _ghost_vals.resize(this->_ghost_cols.size() * k);
+  }
+
+  _scatter.begin(x, _ghost_vals.data());
+
+  _sell_plusdot_multi(nrows, _chunk_size, _local.chunk_ptr.data(), _local.rows.data(),
+                      _local.cols.data(), _local.vals.data(), x_array, y_array, k);
+
+  _scatter.complete();
+
+  _sell_plusdot_multi(nrows, _chunk_size, _remote.chunk_ptr.data(), _remote.rows.data(),
+                      _remote.cols.data(), _remote.vals.data(), _ghost_vals.data(), y_array, k);
+}
+
+/*=====================*/
+/* DELTA MATRIX        */
+/*=====================*/
+
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::setup(I dnz, I onz)
+{
+  CSRMat<I,D>::setup(dnz, onz);
+  this->_compress_remote_cols();
+
+  I cstart, cend;
+  this->get_diag_cols(cstart, cend);
+
+  /*
+   * the local indices must fit in L on every rank. agree on it first, so that
+   * a rank whose block is too wide doesn't leave the others in the scatter's setup
+   */
+  auto too_wide = [] (I ncols) {
+    return ncols > 0 && (unsigned long long)(ncols - 1) > (unsigned long long)std::numeric_limits<L>::max();
+  };
+  bool overflow = too_wide(cend - cstart) || too_wide(I(this->_ghost_cols.size()));
+  if (upcxx::allreduce(int(overflow), [] (int a, int b) { return std::max(a, b); }).wait()) {
+    throw std::overflow_error("local column indices do not fit in the local index type");
+  }
+
+  _to_delta(this->_local_row_ptr, this->_local_cols, this->_local_vals, cend - cstart, _local);
+  _to_delta(this->_remote_row_ptr, this->_remote_cols, this->_remote_vals,
+            this->_ghost_cols.size(), _remote);
+
+  /* we don't need the CSR copy anymore */
+  this->_keeps_csr = false;
+  std::vector<I>().swap(this->_local_row_ptr);
+  std::vector<I>().swap(this->_local_cols);
+  std::vector<I>().swap(this->_remote_row_ptr);
+  std::vector<I>().swap(this->_remote_cols);
+
+  _scatter.setup(this->_ghost_cols, this->_col_partitions);
+  _ghost_vals.resize(this->_ghost_cols.size());
+}
+
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::_to_delta(const std::vector<I>& row_ptr, const std::vector<I>& cols,
+                                     std::vector<D>& vals, I ncols, delta_t& delta) const
+{
+  I nrows = row_ptr.size() - 1;
+
+  delta.row_ptr = row_ptr;
+  delta.code_ptr.resize(nrows + 1);
+  delta.codes.clear();
+  delta.codes.reserve(cols.size());
+
+  for (I i = 0; i < nrows; ++i) {
+    delta.code_ptr[i] = delta.codes.size();
+    _delta_encode<L>(i, row_ptr[i+1] - row_ptr[i], cols.data() + row_ptr[i], delta.codes);
+  }
+  delta.code_ptr[nrows] = delta.codes.size();
+  delta.codes.shrink_to_fit();
+
+  /* the values are unchanged, so just take them */
+  delta.vals.swap(vals);
+}
+
+template <typename I, typename D, typename L>
+double DeltaCSRMat<I, D, L>::get_index_bytes() const
+{
+  size_t nnz = _local.vals.size() + _remote.vals.size();
+  if (nnz == 0) {
+    return 0;
+  }
+  return 2.0 * (_local.codes.size() + _remote.codes.size()) / nnz;
+}
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* request the ghost values */
+  _scatter.begin(x, _ghost_vals.data());
+
+  /* do the local matvec while those values are on their way */
+  _delta_csr_plusdot_threaded<L>(this->_get_pool(), nrows, _local.row_ptr.data(),
+                                 _local.code_ptr.data(), _local.codes.data(), _local.vals.data(),
+                                 x_array, y_array);
+
+  /* now remote part, all out of the ghost buffer */
+  _scatter.complete();
+
+  _delta_csr_plusdot_threaded<L>(this->_get_pool(), nrows, _remote.row_ptr.data(),
+                                 _remote.code_ptr.data(), _remote.codes.data(), _remote.vals.data(),
+                                 _ghost_vals.data(), y_array);
+}
+
+/* Mat-transpose-vector product y = A^T*x */
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot_transpose(x, y);
+}
+
+/* Mat-transpose-vector sum product y = A^T*x + y */
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_transpose_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
+
+  if (!this->_add_scatter.is_set_up()) {
+    this->_setup_transpose();
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* the remote columns index _ghost_cols, i.e. the sums to send */
+  std::fill(this->_add_vals.begin(), this->_add_vals.end(), D(0));
+  _delta_csr_plusdot_transpose<L>(nrows, _remote.row_ptr.data(), _remote.code_ptr.data(),
+                                  _remote.codes.data(), _remote.vals.data(), x_array,
+                                  this->_add_vals.data());
+
+  this->_add_scatter.begin(this->_add_vals.data());
+
+  _delta_csr_plusdot_transpose<L>(nrows, _local.row_ptr.data(), _local.code_ptr.data(),
+                                  _local.codes.data(), _local.vals.data(), x_array, y_array);
+
+  this->_add_scatter.complete(y);
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D, typename L>
+void DeltaCSRMat<I, D, L>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+  int k = x.get_num_vecs();
+
+  if (_ghost_vals.size() < this->_ghost_cols.size() * k) {
+    _ghost_vals.resize(this->_ghost_cols.size() * k);
+  }
+
+  _scatter.begin(x, _ghost_vals.data());
+
+  _delta_csr_plusdot_multi<L>(nrows, _local.row_ptr.data(), _local.code_ptr.data(),
+                              _local.codes.data(), _local.vals.data(), x_array, y_array, k);
+
+  _scatter.complete();
+
+  _delta_csr_plusdot_multi<L>(nrows, _remote.row_ptr.data(), _remote.code_ptr.data(),
+                              _remote.codes.data(), _remote.vals.data(), _ghost_vals.data(),
+                              y_array, k);
+}
+
+/*=====================*/
+/* MIXED MATRIX        */
+/*=====================*/
+
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::setup(I dnz, I onz)
+{
+  CSRMat<I,D>::setup(dnz, onz);
+  this->_compress_remote_cols();
+
+  _local_svals.assign(this->_local_vals.begin(), this->_local_vals.end());
+  _remote_svals.assign(this->_remote_vals.begin(), this->_remote_vals.end());
+
+  /* we don't need the wide copy anymore */
+  this->_keeps_csr = false;
+  std::vector<D>().swap(this->_local_vals);
+  std::vector<D>().swap(this->_remote_vals);
+
+  _scatter.setup(this->_ghost_cols, this->_col_partitions);
+  _ghost_vals.resize(this->_ghost_cols.size());
+}
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* request the ghost values */
+  _scatter.begin(x, _ghost_vals.data());
+
+  /* do the local matvec while those values are on their way */
+  _mixed_csr_plusdot_threaded(this->_get_pool(), nrows, this->_local_row_ptr.data(),
+                              this->_local_cols.data(), _local_svals.data(), x_array, y_array);
+
+  /* now remote part, all out of the ghost buffer */
+  _scatter.complete();
+
+  _mixed_csr_plusdot_threaded(this->_get_pool(), nrows, this->_remote_row_ptr.data(),
+                              this->_remote_cols.data(), _remote_svals.data(),
+                              _ghost_vals.data(), y_array);
+}
+
+/* Mat-transpose-vector product y = A^T*x */
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot_transpose(x, y);
+}
+
+/* Mat-transpose-vector sum product y = A^T*x + y */
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_transpose_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
+
+  if (!this->_add_scatter.is_set_up()) {
+    this->_setup_transpose();
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* the remote columns index _ghost_cols, i.e. the sums to send */
+  std::fill(this->_add_vals.begin(), this->_add_vals.end(), D(0));
+  _mixed_csr_plusdot_transpose(nrows, this->_remote_row_ptr.data(), this->_remote_cols.data(),
+                               _remote_svals.data(), x_array, this->_add_vals.data());
+
+  this->_add_scatter.begin(this->_add_vals.data());
+
+  _mixed_csr_plusdot_transpose(nrows, this->_local_row_ptr.data(), this->_local_cols.data(),
+                               _local_svals.data(), x_array, y_array);
+
+  this->_add_scatter.complete(y);
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D, typename S, typename W>
+void MixedCSRMat<I, D, S, W>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+  int k = x.get_num_vecs();
+
+  if (_ghost_vals.size() < this->_ghost_cols.size() * k) {
+    _ghost_vals.resize(this->_ghost_cols.size() * k);
+  }
+
+  _scatter.begin(x, _ghost_vals.data());
+
+  _mixed_csr_plusdot_multi(nrows, this->_local_row_ptr.data(), this->_local_cols.data(),
+                           _local_svals.data(), x_array, y_array, k);
+
+  _scatter.complete();
+
+  _mixed_csr_plusdot_multi(nrows, this->_remote_row_ptr.data(), this->_remote_cols.data(),
+                           _remote_svals.data(), _ghost_vals.data(), y_array, k);
+}
+
+/*=====================*/
+/* SYM MATRIX          */
+/*=====================*/
+
+template <typename I, typename D>
+void SymCSRMat<I, D>::setup(I dnz, I onz)
+{
+  if (!this->size_set) {
+    throw std::logic_error("Must set size before calling setup()");
+  }
+  if (this->is_set_up) {
+    throw std::logic_error("Matrix already set up");
+  }
+
+  I M, N;
+  this->get_dimensions(M, N);
+  if (M != N || this->_row_partitions != this->_col_partitions) {
+    throw std::logic_error("SymCSRMat must be square, with square diagonal blocks");
+  }
+
+  this->_assemble();
+
+  /* drop the lower triangle early, to save memory in setup */
+  auto& elements = this->_elements;
+  size_t n = 0;
+  for (size_t k = 0; k < elements.size(); ++k) {
+    if (elements[k].first.second >= elements[k].first.first) {
+      elements[n++] = elements[k];
+    }
+  }
+  elements.resize(n);
+
+  CSRMat<I,D>::setup(dnz, onz);
+
+  /* then pull out the diagonal, and anything below it that was preallocated */
+  I rstart, rend;
+  this->get_local_rows(rstart, rend);
+  I nrows = rend - rstart;
+
+  _diag.assign(nrows, D(0));
+
+  I local_pos = 0, remote_pos = 0;
+  for (I i = 0; i < nrows; ++i) {
+    I local_start = this->_local_row_ptr[i], local_end = this->_local_row_ptr[i+1];
+    I remote_start = this->_remote_row_ptr[i], remote_end = this->_remote_row_ptr[i+1];
+    this->_local_row_ptr[i] = local_pos;
+    this->_remote_row_ptr[i] = remote_pos;
+
+    /* the diagonal block's columns are relative to rstart, since it is square */
+    for (I j = local_start; j < local_end; ++j) {
+      I col = this->_local_cols[j];
+      if (col == i) {
+        _diag[i] += this->_local_vals[j];
+      }
+      else if (col > i) {
+        this->_local_cols[local_pos] = col;
+        this->_local_vals[local_pos] = this->_local_vals[j];
+        ++local_pos;
+      }
+    }
+
+    for (I j = remote_start; j < remote_end; ++j) {
+      if (this->_remote_cols[j] >= rend) {
+        this->_remote_cols[remote_pos] = this->_remote_cols[j];
+        this->_remote_vals[remote_pos] = this->_remote_vals[j];
+        ++remote_pos;
+      }
+    }
+  }
+  this->_local_row_ptr[nrows] = local_pos;
+  this->_remote_row_ptr[nrows] = remote_pos;
+  this->_local_cols.resize(local_pos);
+  this->_local_vals.resize(local_pos);
+  this->_remote_cols.resize(remote_pos);
+  this->_remote_vals.resize(remote_pos);
+
+  this->_compress_remote_cols();
+
+  _scatter.setup(this->_ghost_cols, this->_col_partitions);
+  _ghost_vals.resize(this->_ghost_cols.size());
+
+  /* the remote columns are exactly the entries of y we add into */
+  this->_setup_transpose();
+}
+
+/* Mat-vector product y = A*x */
+template <typename I, typename D>
+void SymCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-vector sum product y = A*x + y */
+template <typename I, typename D>
+void SymCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+  _plusdot(x, y, false);
 }
 
+/* Mat-transpose-vector product y = A^T*x */
 template <typename I, typename D>
-void Mat<I, D>::get_diag_cols(I& start, I& end) const
+void SymCSRMat<I, D>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
 {
-  start = _col_partitions[upcxx::rank_me()];
-  end = _col_partitions[upcxx::rank_me() + 1];
+  y.set_all(0);
+  plusdot_transpose(x, y);
 }
 
+/* Mat-transpose-vector sum product y = A^T*x + y */
 template <typename I, typename D>
-I Mat<I, D>::get_local_rows_size() const
+void SymCSRMat<I,D>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
 {
-  I start, end;
-  get_local_rows(start, end);
-  return end-start;
+  this->check_transpose_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
+  _plusdot(x, y, true);
 }
 
-/*=========================================*/
-/*** value setting and memory allocation ***/
-
 template <typename I, typename D>
-void Mat<I, D>::set_value(I row, I col, D value)
+void SymCSRMat<I,D>::_plusdot(Vec<I,D>& x, Vec<I,D>& y, bool transpose) const
 {
-#ifdef DEBUG
-  I rstart, rend;
-  get_local_rows(rstart, rend);
-  assert(row >= rstart && row < rend);
-  assert(col >= 0 && col < _N);
-#endif
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  I nrows = this->get_local_rows_size();
+
+  /* request the ghost values */
+  _scatter.begin(x, _ghost_vals.data());
 
-  _elements.push_back(std::make_pair( std::make_pair(row, col), value ));
+  /* the diagonal and the diagonal block, while those values are on their way */
+  for (I i = 0; i < nrows; ++i) {
+    y_array[i] += (transpose ? _conj(_diag[i]) : _diag[i]) * x_array[i];
+  }
+
+  _sym_csr_plusdot(nrows, this->_local_row_ptr.data(), this->_local_cols.data(),
+                   this->_local_vals.data(), x_array, x_array, y_array, y_array, transpose);
+
+  /* the remote part gives our rows, and the sums for the higher ranks' rows */
+  _scatter.complete();
+
+  std::fill(this->_add_vals.begin(), this->_add_vals.end(), D(0));
+  _sym_csr_plusdot(nrows, this->_remote_row_ptr.data(), this->_remote_cols.data(),
+                   this->_remote_vals.data(), x_array, _ghost_vals.data(), y_array,
+                   this->_add_vals.data(), transpose);
+
+  this->_add_scatter.begin(this->_add_vals.data());
+  this->_add_scatter.complete(y);
 }
 
 /*=====================*/
-/* CSR MATRIX          */
+/* BCSR MATRIX         */
 /*=====================*/
 
-template <typename I, typename D>
-void CSRMat<I, D>::setup(I dnz, I onz)
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::setup(I, I)
 {
   if (!this->size_set) {
     throw std::logic_error("Must set size before calling setup()");
@@ -340,6 +3819,11 @@ void CSRMat<I, D>::setup(I dnz, I onz)
   if (is_set_up) {
     throw std::logic_error("Matrix already set up");
   }
+  if (this->get_reordering()) {
+    throw std::logic_error("Cannot reorder a block matrix");
+  }
+
+  this->_assemble();
 
   I rstart, rend;
   I cstart, cend;
@@ -347,259 +3831,205 @@ void CSRMat<I, D>::setup(I dnz, I onz)
   this->get_local_rows(rstart, rend);
   this->get_diag_cols(cstart, cend);
 
-  _local.resize(rend-rstart);
-  _remote.resize(rend-rstart);
+  I nbrows = (rend - rstart + R - 1) / R;
+
+  /* is block column bc entirely in our part of x? */
+  auto is_local = [&] (I bc) { return bc*C >= cstart && bc*C + C <= cend; };
+
+  /* sort the elements into blocks, by block row and then block column */
+  auto block_of = [&] (const std::pair<std::pair<I,I>,D>& e) {
+    return std::make_pair((e.first.first - rstart) / R, e.first.second / C);
+  };
+  _parallel_sort(this->_get_pool(), this->_elements.begin(), this->_elements.end(),
+                 [&] (std::pair<std::pair<I,I>,D> const& a, std::pair<std::pair<I,I>,D> const& b)
+                    { return block_of(a) < block_of(b); });
+
+  _local_brow_ptr.assign(nbrows + 1, 0);
+  _remote_brow_ptr.assign(nbrows + 1, 0);
+
+  /* remote columns are block columns until they are renumbered below */
+  std::pair<I,I> cur_block;
+  bool cur_local = false;
+  for (size_t i = 0; i < this->_elements.size(); ++i) {
+    const auto& e = this->_elements[i];
+    auto blk = block_of(e);
+
+    if (i == 0 || blk != cur_block) {
+      cur_block = blk;
+      cur_local = is_local(blk.second);
+      if (cur_local) {
+        _local_brow_ptr[blk.first + 1]++;
+        _local_cols.push_back(blk.second*C - cstart);
+        _local_vals.resize(_local_vals.size() + R*C, D(0));
+      }
+      else {
+        _remote_brow_ptr[blk.first + 1]++;
+        _remote_cols.push_back(blk.second);
+        _remote_vals.resize(_remote_vals.size() + R*C, D(0));
+      }
+    }
 
-  for (auto& row: _local) {
-    row.reserve(dnz);
+    I r = (e.first.first - rstart) % R;
+    I c = e.first.second % C;
+    std::vector<D>& vals = cur_local ? _local_vals : _remote_vals;
+    vals[vals.size() - R*C + r*C + c] += e.second;
   }
-  for (auto& row: _remote) {
-    row.reserve(onz);
+
+  for (I b = 0; b < nbrows; ++b) {
+    _local_brow_ptr[b+1] += _local_brow_ptr[b];
+    _remote_brow_ptr[b+1] += _remote_brow_ptr[b];
   }
 
-  /* the plan: put the elements into _local and _remote, then sort the rows */
-  /* this is more efficient than sorting first */
+  /* the COO copy is not needed anymore */
+  std::vector< std::pair< std::pair<I,I>, D> >().swap(this->_elements);
 
-  for (auto& e: this->_elements) {
-    I row = e.first.first, col = e.first.second;
-    D val = e.second;
-    if (col >= cstart && col < cend) {
-      _local[row-rstart].push_back( std::make_pair(col-cstart, val) );
-    }
-    else {
-      _remote[row-rstart].push_back( std::make_pair(col, val) );
+  /* the ghost values are all the columns of the remote block columns */
+  std::vector<I> ghost_bcols = _remote_cols;
+  std::sort(ghost_bcols.begin(), ghost_bcols.end());
+  ghost_bcols.erase(std::unique(ghost_bcols.begin(), ghost_bcols.end()), ghost_bcols.end());
+
+  std::vector<I> ghost_starts(ghost_bcols.size());
+  for (size_t g = 0; g < ghost_bcols.size(); ++g) {
+    ghost_starts[g] = _ghost_cols.size();
+    for (I col = ghost_bcols[g]*C; col < std::min(ghost_bcols[g]*C + C, this->_N); ++col) {
+      _ghost_cols.push_back(col);
     }
   }
 
-  /* now sort them */
-  for (auto& row: _local) {
-    row.shrink_to_fit();
-    std::sort(row.begin(), row.end(),
-              [] (std::pair<I,D> const& a, std::pair<I,D> const& b) { return a.first < b.first; });
-  }
-  for (auto& row: _remote) {
-    row.shrink_to_fit();
-    std::sort(row.begin(), row.end(),
-              [] (std::pair<I,D> const& a, std::pair<I,D> const& b) { return a.first < b.first; });
+  for (auto& col : _remote_cols) {
+    col = ghost_starts[std::lower_bound(ghost_bcols.begin(), ghost_bcols.end(), col) - ghost_bcols.begin()];
   }
 
+  _scatter.setup(_ghost_cols, this->_col_partitions);
+
+  /* the last block column may run past N; those entries are zero, but we
+   * still read the x values for them, so pad the buffer */
+  _ghost_vals.assign(_ghost_cols.size() + C, D(0));
+
   is_set_up = true;
 }
 
-/*=====================*/
-/* CSRNAIVE MATRIX     */
-/*=====================*/
+template <typename I, typename D, int R, int C>
+I BCSRMat<I, D, R, C>::get_num_blocks() const
+{
+  return _local_cols.size() + _remote_cols.size();
+}
 
 /* Mat-vector product y = A*x */
-template <typename I, typename D>
-void NaiveCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::dot(Vec<I,D>& x, Vec<I,D>& y) const
 {
   y.set_all(0);
   plusdot(x, y);
 }
 
 /* Mat-vector sum product y = A*x + y */
-template <typename I, typename D>
-void NaiveCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
 {
 
   this->check_dimensions(x, y);
-  if (!this->is_set_up) {
+  if (!is_set_up) {
     throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
   }
 
-  /* first do the local matvec */
   auto x_array = x.get_local_array_read();
   auto y_array = y.get_local_array();
 
-  I local_size = this->get_local_rows_size();
+  I nrows = this->get_local_rows_size();
 
-  for (I i = 0; i < local_size; ++i) {
-    for (const auto& p : this->_local[i]) {
-      y_array[i] += p.second * x_array[p.first];
-    }
-  }
+  /* request the ghost values */
+  _scatter.begin(x, _ghost_vals.data());
 
-  /* now remote part */
-  for (I i = 0; i < local_size; ++i) {
-    for (const auto& p : this->_remote[i]) {
-      /* x[p.first] implicitly gets the remote value */
-      y_array[i] += p.second * x[p.first].get();
-    }
-  }
+  /* do the local matvec while those values are on their way */
+  _bcsr_plusdot_threaded<R, C>(this->_get_pool(), nrows, _local_brow_ptr.data(),
+                               _local_cols.data(), _local_vals.data(), x_array, y_array);
 
-}
+  /* now remote part, all out of the ghost buffer */
+  _scatter.complete();
 
-/*=====================*/
-/* CSRBLOCK MATRIX     */
-/*=====================*/
+  _bcsr_plusdot_threaded<R, C>(this->_get_pool(), nrows, _remote_brow_ptr.data(),
+                               _remote_cols.data(), _remote_vals.data(), _ghost_vals.data(),
+                               y_array);
+}
 
-/* Mat-vector product y = A*x */
-template <typename I, typename D>
-void BlockCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+/* Mat-transpose-vector product y = A^T*x */
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
 {
   y.set_all(0);
-  plusdot(x, y);
+  plusdot_transpose(x, y);
 }
 
-/* Mat-vector sum product y = A*x + y */
-template <typename I, typename D>
-void BlockCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+/* Mat-transpose-vector sum product y = A^T*x + y */
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
 {
+  this->check_transpose_dimensions(x, y);
+  if (!is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
 
-  this->check_dimensions(x, y);
+  if (!_add_scatter.is_set_up()) {
+    _add_scatter.setup(_ghost_cols, this->_col_partitions);
+  }
 
   auto x_array = x.get_local_array_read();
   auto y_array = y.get_local_array();
 
-  I local_size = this->get_local_rows_size();
-
-  std::vector< std::vector<D> > bufs(NBUFS, std::vector<D>(DOT_BLOCK_SIZE));
-
-  /* TODO: could probably come up with a better way to do this */
-  std::vector<I> row_starts(this->_M, 0);
-  I buf_start_idx = 0;
-  int which_buf = 0;
-
-  /* get the first block */
-  x.read_range_begin(buf_start_idx, std::min(this->_N, buf_start_idx + DOT_BLOCK_SIZE), bufs[which_buf].data());
-
-  /* do the local matvec while those values are on their way */
-  for (I i = 0; i < local_size; ++i) {
-    for (const auto& p : this->_local[i]) {
-      y_array[i] += p.second * x_array[p.first];
-    }
-  }
-
-  /* now remote part */
-  while (buf_start_idx < this->_N) {
-
-    /* finish getting previous */
-    x.read_range_complete();
+  I nrows = this->get_local_rows_size();
 
-    /* fetch next block */
-    if (buf_start_idx+DOT_BLOCK_SIZE < this->_N) {
-      x.read_range_begin(buf_start_idx+DOT_BLOCK_SIZE,
-        std::min(this->_N, buf_start_idx + 2*DOT_BLOCK_SIZE), bufs[(which_buf+1)%NBUFS].data());
-    }
-
-    /* our data is in bufs[which_buf] */
-
-    for (I i = 0; i < local_size; ++i) {
-      while (row_starts[i] < I(this->_remote[i].size()) && \
-             this->_remote[i][row_starts[i]].first < buf_start_idx + DOT_BLOCK_SIZE) {
-        I buf_idx = this->_remote[i][row_starts[i]].first - buf_start_idx;
-        y_array[i] += this->_remote[i][row_starts[i]].second * bufs[which_buf][buf_idx];
-        row_starts[i]++;
-      }
-    }
+  /* the columns past the end of the matrix only ever get zeros, in the padding */
+  _add_vals.assign(_ghost_cols.size() + C, D(0));
+  _bcsr_plusdot_transpose<R, C>(nrows, _remote_brow_ptr.data(), _remote_cols.data(),
+                                _remote_vals.data(), x_array, _add_vals.data());
 
-    which_buf++;
-    which_buf %= NBUFS;
+  _add_scatter.begin(_add_vals.data());
 
-    buf_start_idx += DOT_BLOCK_SIZE;
+  _bcsr_plusdot_transpose<R, C>(nrows, _local_brow_ptr.data(), _local_cols.data(),
+                                _local_vals.data(), x_array, y_array);
 
-  }
+  _add_scatter.complete(y);
 }
 
-/*=====================*/
-/* CSRSINGLE MATRIX    */
-/*=====================*/
-
-/* Mat-vector product y = A*x */
-template <typename I, typename D>
-void SingleCSRMat<I, D>::dot(Vec<I,D>& x, Vec<I,D>& y) const
+/* Mat-multivector product y = A*x */
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
 {
   y.set_all(0);
   plusdot(x, y);
 }
 
-/* find the next value to prefetch, for BlockCSRMat::dot */
-template <typename I, typename D>
-static bool _prefetch_seek_next(I& pfch_row, I& pfch_row_idx, I local_size,
-                 const std::vector< std::vector< std::pair<I, D>>>& _remote)
-{
-  bool done = false;
-
-  pfch_row_idx++;
-
-  /* move on to the next row when we hit the end of one */
-  while (pfch_row_idx >= I(_remote[pfch_row].size())) {
-    pfch_row++;
-    if (pfch_row >= local_size) {
-      done = true;
-      break;
-    }
-
-    pfch_row_idx = 0;
-  }
-
-  return done;
-}
-
-/* Mat-vector sum product y = A*x + y */
-template <typename I, typename D>
-void SingleCSRMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D, int R, int C>
+void BCSRMat<I, D, R, C>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
 {
 
   this->check_dimensions(x, y);
-
-  bool prefetch_done = false;
+  if (!is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
 
   auto x_array = x.get_local_array_read();
   auto y_array = y.get_local_array();
 
-  I local_size = this->get_local_rows_size();
-
-  /* start fetching the x values for the first row of mat */
-  std::vector<RData<I,D>> prefetched;
-  I pfch_idx, pfch_read_idx = 0, pfch_row = 0, pfch_row_idx = -1;
-
-  prefetched.resize(DOT_BLOCK_SIZE);
-  for (pfch_idx = 0; pfch_idx < DOT_BLOCK_SIZE; ++pfch_idx) {
-    prefetch_done = _prefetch_seek_next(pfch_row, pfch_row_idx, local_size, this->_remote);
-    if (prefetch_done) break;
-
-    prefetched[pfch_idx].update(x[this->_remote[pfch_row][pfch_row_idx].first].get_address());
-    prefetched[pfch_idx].prefetch();
-  }
-  pfch_idx %= DOT_BLOCK_SIZE;
-
-  /* do the local matvec while those values are on their way */
+  I nrows = this->get_local_rows_size();
+  int k = x.get_num_vecs();
 
-  for (I i = 0; i < local_size; ++i) {
-    for (const auto& p : this->_local[i]) {
-      y_array[i] += p.second * x_array[p.first];
-    }
+  /* with the same padding as for one vector */
+  if (_ghost_vals.size() < (_ghost_cols.size() + C) * k) {
+    _ghost_vals.assign((_ghost_cols.size() + C) * k, D(0));
   }
 
-  /* now remote part */
-  D val;
-  for (I i = 0; i < local_size; ++i) {
-    I max_idx = this->_remote[i].size();
-    for (I j = 0; j < max_idx; ++j) {
-
-      /* get the prefetched value */
-      val = prefetched[pfch_read_idx].get();
+  _scatter.begin(x, _ghost_vals.data());
 
-      /* prefetch the next one */
-      if (!prefetch_done) {
-        prefetch_done = _prefetch_seek_next(pfch_row, pfch_row_idx, local_size, this->_remote);
-        if (!prefetch_done) {
-          /* update it to point at the new address */
-          prefetched[pfch_idx].update(x[this->_remote[pfch_row][pfch_row_idx].first].get_address());
-          prefetched[pfch_idx].prefetch();
-        }
-      }
+  _bcsr_plusdot_multi<R, C>(nrows, _local_brow_ptr.data(), _local_cols.data(),
+                            _local_vals.data(), x_array, y_array, k);
 
-      y_array[i] += this->_remote[i][j].second * val;
+  _scatter.complete();
 
-      ++pfch_idx;
-      ++pfch_read_idx;
-      pfch_idx %= DOT_BLOCK_SIZE;
-      pfch_read_idx %= DOT_BLOCK_SIZE;
-    }
-  }
+  _bcsr_plusdot_multi<R, C>(nrows, _remote_brow_ptr.data(), _remote_cols.data(),
+                            _remote_vals.data(), _ghost_vals.data(), y_array, k);
 }
 
 /*=====================*/
@@ -616,6 +4046,8 @@ void RCMat<I, D>::setup(I nnz)
     throw std::logic_error("Matrix already set up");
   }
 
+  this->_assemble();
+
   I rstart, rend;
   I cstart, cend;
 
@@ -628,10 +4060,10 @@ void RCMat<I, D>::setup(I nnz)
   /* we need to sort all the accumulated elements first */
   /* sort by column, then by row, BUT shifted by the column start for this process */
   /* that way all the processes don't spam process 0 with requests at once */
-  std::sort(this->_elements.begin(), this->_elements.end(),
-            [&] (std::pair<std::pair<I,I>,D> const& a, std::pair<std::pair<I,I>,D> const& b)
-               { return ((a.first.second+cstart)%this->_N) < ((b.first.second+cstart)%this->_N) || \
-                 (a.first.second == b.first.second && a.first.first < b.first.first); });
+  _parallel_sort(this->_get_pool(), this->_elements.begin(), this->_elements.end(),
+                 [&] (std::pair<std::pair<I,I>,D> const& a, std::pair<std::pair<I,I>,D> const& b)
+                    { return ((a.first.second+cstart)%this->_N) < ((b.first.second+cstart)%this->_N) || \
+                      (a.first.second == b.first.second && a.first.first < b.first.first); });
 
   /* now they're sorted, so we can fill our thing */
   I cur_col = -1;
@@ -654,9 +4086,14 @@ void RCMat<I, D>::setup(I nnz)
       _cols[col_idx].second.reserve(nnz/upcxx::rank_n());
     }
 
-    /* TODO: if the user adds two identical elements, sum them */
-
-    _cols[col_idx].second.push_back(std::make_pair(row-rstart, val));
+    /* the same element set twice is adjacent now, so sum it */
+    auto& entries = _cols[col_idx].second;
+    if (!entries.empty() && entries.back().first == row-rstart) {
+      entries.back().second += val;
+    }
+    else {
+      entries.push_back(std::make_pair(row-rstart, val));
+    }
 
   }
 
@@ -665,6 +4102,19 @@ void RCMat<I, D>::setup(I nnz)
   }
   _cols.shrink_to_fit();
 
+  /* the COO copy is not needed anymore */
+  std::vector< std::pair< std::pair<I,I>, D> >().swap(this->_elements);
+
+  _row_nnz_ptr.assign(rend - rstart + 1, 0);
+  for (const auto& c : _cols) {
+    for (const auto& p : c.second) {
+      _row_nnz_ptr[p.first + 1]++;
+    }
+  }
+  for (I i = 0; i < rend - rstart; ++i) {
+    _row_nnz_ptr[i+1] += _row_nnz_ptr[i];
+  }
+
   is_set_up = true;
 }
 
@@ -686,21 +4136,43 @@ void RCMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
     throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
   }
 
+  this->_tune_start();
+
   auto y_array = y.get_local_array();
-  I local_size = this->get_local_rows_size();
+  I block_size = this->_block_size;
+
+  if (this->_get_progress_pool() != nullptr) {
+    this->_progress_stream(x, I(_cols.size()),
+      [&] (I j) { return _cols[j].first; },
+      [] {},
+      [&] (I j, D val) {
+        for (const auto& p : _cols[j].second) {
+          y_array[p.first] += p.second * val;
+        }
+      });
+
+    this->_tune_stop();
+    return;
+  }
+
+  if (this->_get_pool() != nullptr) {
+    _threaded_plusdot(x, y_array);
+    this->_tune_stop();
+    return;
+  }
 
   /* keep an array of prefetched values */
-  std::vector<RData<I,D>> prefetched(DOT_BLOCK_SIZE);
+  std::vector<RData<I,D>> prefetched(block_size);
   I pfch_idx, get_idx = 0;
   bool prefetch_done = false;
 
   /* get the initial set of prefetch values */
-  for (pfch_idx = 0; pfch_idx < std::min(I(_cols.size()), I(DOT_BLOCK_SIZE)); ++pfch_idx) {
+  for (pfch_idx = 0; pfch_idx < std::min(I(_cols.size()), block_size); ++pfch_idx) {
     prefetched[pfch_idx].update(x[_cols[pfch_idx].first].get_address());
     prefetched[pfch_idx].prefetch();
   }
 
-  if (_cols.size() <= DOT_BLOCK_SIZE) {
+  if (I(_cols.size()) <= block_size) {
     prefetch_done = true;
   }
 
@@ -708,7 +4180,7 @@ void RCMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
 
     D val = prefetched[get_idx].get();
     get_idx++;
-    get_idx %= DOT_BLOCK_SIZE;
+    get_idx %= block_size;
 
     if (!prefetch_done) {
       /* prefetch the next one */
@@ -716,8 +4188,8 @@ void RCMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
         prefetch_done = true;
       }
       else {
-        prefetched[pfch_idx % DOT_BLOCK_SIZE].update(x[_cols[pfch_idx].first].get_address());
-        prefetched[pfch_idx % DOT_BLOCK_SIZE].prefetch();
+        prefetched[pfch_idx % block_size].update(x[_cols[pfch_idx].first].get_address());
+        prefetched[pfch_idx % block_size].prefetch();
       }
       pfch_idx++;
     }
@@ -728,4 +4200,203 @@ void RCMat<I,D>::plusdot(Vec<I,D>& x, Vec<I,D>& y) const
     }
   }
 
+  this->_tune_stop();
+}
+
+/*
+ * fetch x for a batch of block_size columns, then the threads apply the
+ * batch, each to its own range of rows. the next batch is on its way while
+ * they work
+ */
+template <typename I, typename D>
+void RCMat<I,D>::_threaded_plusdot(Vec<I,D>& x, D* y_array) const
+{
+  ThreadPool* pool = this->_get_pool();
+  int nthreads = pool->get_num_threads();
+  I block_size = this->_block_size;
+  I ncols = _cols.size();
+
+  /* rows [row_split[t], row_split[t+1]) belong to thread t */
+  std::vector<I> row_split(nthreads + 1);
+  for (int t = 0; t < nthreads; ++t) {
+    _balanced_range(_row_nnz_ptr.data(), this->get_local_rows_size(), t, nthreads,
+                    row_split[t], row_split[t+1]);
+  }
+
+  std::vector<RData<I,D>> prefetched(block_size);
+  std::vector<D> batch(block_size);
+
+  auto fetch = [&] (I start) {
+    for (I c = start; c < std::min(ncols, start + block_size); ++c) {
+      prefetched[c - start].update(x[_cols[c].first].get_address());
+      prefetched[c - start].prefetch();
+    }
+  };
+
+  fetch(0);
+
+  for (I start = 0; start < ncols; start += block_size) {
+    I n = std::min(ncols - start, block_size);
+    for (I c = 0; c < n; ++c) {
+      batch[c] = prefetched[c].get();
+    }
+
+    fetch(start + block_size);
+
+    pool->run([&] (int t) {
+      for (I c = 0; c < n; ++c) {
+        /* the entries of each column are sorted by row */
+        const auto& e = _cols[start + c].second;
+        auto it = std::lower_bound(e.begin(), e.end(), row_split[t],
+                                   [] (const std::pair<I,D>& p, I row) { return p.first < row; });
+        for (; it != e.end() && it->first < row_split[t+1]; ++it) {
+          y_array[it->first] += it->second * batch[c];
+        }
+      }
+    });
+  }
+}
+
+template <typename I, typename D>
+void RCMat<I, D>::_setup_transpose() const
+{
+  I cstart, cend;
+  this->get_diag_cols(cstart, cend);
+
+  /* _cols is not sorted by global column, so sort the remote ones */
+  std::vector<I> ghost_cols;
+  for (const auto& c : _cols) {
+    if (c.first < cstart || c.first >= cend) {
+      ghost_cols.push_back(c.first);
+    }
+  }
+  std::sort(ghost_cols.begin(), ghost_cols.end());
+
+  _transpose_slots.resize(_cols.size());
+  for (size_t c = 0; c < _cols.size(); ++c) {
+    I col = _cols[c].first;
+    if (col >= cstart && col < cend) {
+      _transpose_slots[c] = I(-1);
+    }
+    else {
+      _transpose_slots[c] = std::lower_bound(ghost_cols.begin(), ghost_cols.end(), col)
+                            - ghost_cols.begin();
+    }
+  }
+
+  _add_scatter.setup(ghost_cols, this->_col_partitions);
+  _add_vals.resize(ghost_cols.size());
+}
+
+/* Mat-transpose-vector product y = A^T*x */
+template <typename I, typename D>
+void RCMat<I, D>::dot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot_transpose(x, y);
+}
+
+/* Mat-transpose-vector sum product y = A^T*x + y */
+template <typename I, typename D>
+void RCMat<I,D>::plusdot_transpose(Vec<I,D>& x, Vec<I,D>& y) const
+{
+  this->check_transpose_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot_transpose");
+  }
+
+  if (!_add_scatter.is_set_up()) {
+    _setup_transpose();
+  }
+
+  I cstart, cend;
+  this->get_diag_cols(cstart, cend);
+
+  auto x_array = x.get_local_array_read();
+  auto y_array = y.get_local_array();
+
+  /* each column is a dot product with our part of x. the remote ones go out first */
+  for (size_t c = 0; c < _cols.size(); ++c) {
+    if (_transpose_slots[c] == I(-1)) {
+      continue;
+    }
+    D sum = 0;
+    for (const auto& p : _cols[c].second) {
+      sum += p.second * x_array[p.first];
+    }
+    _add_vals[_transpose_slots[c]] = sum;
+  }
+
+  _add_scatter.begin(_add_vals.data());
+
+  for (size_t c = 0; c < _cols.size(); ++c) {
+    if (_transpose_slots[c] != I(-1)) {
+      continue;
+    }
+    D sum = 0;
+    for (const auto& p : _cols[c].second) {
+      sum += p.second * x_array[p.first];
+    }
+    y_array[_cols[c].first - cstart] += sum;
+  }
+
+  _add_scatter.complete(y);
+}
+
+/* Mat-multivector product y = A*x */
+template <typename I, typename D>
+void RCMat<I, D>::dot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+  y.set_all(0);
+  plusdot(x, y);
+}
+
+/* Mat-multivector sum product y = A*x + y */
+template <typename I, typename D>
+void RCMat<I,D>::plusdot(MultiVec<I,D>& x, MultiVec<I,D>& y) const
+{
+
+  this->check_dimensions(x, y);
+  if (!this->is_set_up) {
+    throw std::logic_error("Must set up matrix with ::setup() before calling ::plusdot");
+  }
+
+  this->_tune_start();
+
+  auto y_array = y.get_local_array();
+  I block_size = this->_block_size;
+  int k = x.get_num_vecs();
+  I ncols = _cols.size();
+
+  /* prefetch the rows of x for the next block_size columns, k values each */
+  std::vector<D> prefetched(block_size * k);
+  std::vector< upcxx::future<> > futs(block_size);
+  I pfch_idx;
+
+  for (pfch_idx = 0; pfch_idx < std::min(ncols, block_size); ++pfch_idx) {
+    I col = _cols[pfch_idx].first;
+    futs[pfch_idx] = x.read_range_async(col, col+1, prefetched.data() + pfch_idx*k);
+  }
+
+  for (I c = 0; c < ncols; ++c) {
+
+    I slot = c % block_size;
+    futs[slot].wait();
+    const D* x_row = prefetched.data() + slot*k;
+
+    for (const auto& p : _cols[c].second) {
+      for (int t = 0; t < k; ++t) {
+        y_array[p.first*k + t] += p.second * x_row[t];
+      }
+    }
+
+    /* prefetch the next one into the slot we just emptied */
+    if (pfch_idx < ncols) {
+      I col = _cols[pfch_idx].first;
+      futs[slot] = x.read_range_async(col, col+1, prefetched.data() + slot*k);
+      ++pfch_idx;
+    }
+  }
+
+  this->_tune_stop();
 }
@@ -0,0 +1,392 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <upcxx/upcxx.hpp>
+#include <stdexcept>
+#include <sstream>
+#include "utils.hpp"
+#include "vector.hpp"
+
+/*
+ * MultiVec is a set of k distributed vectors of the same size, partitioned
+ * like Vec. The entries are stored row-major: the k values for global index
+ * i are next to each other, so that a matrix entry A(i,j) is applied to all
+ * k vectors at once, and fetching row j of a remote part is one transfer.
+ */
+
+template <typename I, typename D>
+class MultiVec {
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+  MultiVec() {};
+  MultiVec(I size, int k);
+
+  /* with the ranks' portions chosen by partitioner */
+  MultiVec(I size, int k, const Partitioner<I>& partitioner);
+  ~MultiVec();
+
+  /* rule of three/five: since we have an explicit destructor we also
+   * need copy/move methods */
+  MultiVec(const MultiVec& v);
+  MultiVec(MultiVec&& v) noexcept;
+  MultiVec& operator= (const MultiVec& v);
+  MultiVec& operator= (MultiVec&& v) noexcept;
+
+  /*
+   * allocate memory for the MultiVec: k vectors of dimension size. this only
+   * needs to be called if it was initialized using the default constructor
+   */
+  void allocate_elements(I size, int k, const Partitioner<I>& partitioner = Partitioner<I>());
+
+  /* return true if MultiVec's memory has already been allocated */
+  bool allocated() const;
+
+  /*===================================*/
+  /*** vector dimensions and indices ***/
+
+  /* get the global dimension of the vectors */
+  I get_size() const;
+
+  /* get the number of vectors */
+  int get_num_vecs() const;
+
+  /* get the number of rows stored locally (each of which holds k values) */
+  I get_local_size() const;
+
+  /* get the start and end indices of the locally stored rows */
+  I get_local_start() const;
+  I get_local_end() const;
+  void get_local_range(I &start, I &end) const;
+
+  /* the start of each rank's portion, and then the size */
+  const std::vector<I>& get_partitions() const;
+
+  /* throw an exception if the dimensions or partitions of this and v do not match */
+  void validate_dims(const MultiVec& v) const;
+
+  /*================================*/
+  /*** getting and setting values ***/
+
+  /* set every entry of every vector to the same value */
+  void set_all(D value);
+
+  /* get a pointer to the local rows. entry j of local row i is at [i*k + j] */
+  D* get_local_array();
+
+  /* get a pointer to the local rows (read-only) */
+  const D* get_local_array_read() const;
+
+  /* get the global pointer to the start of the rows stored on rank */
+  upcxx::global_ptr<D> get_global_ptr(int rank) const;
+
+  /* copy vector j into v, or v into vector j. v must have the same size */
+  void get_column(int j, Vec<I,D>& v) const;
+  void set_column(int j, const Vec<I,D>& v);
+
+  /*
+   * fetch rows [start, end) (k values each) into buf, which must have room
+   * for (end-start)*k values. one transfer per owning rank. the future is
+   * ready once buf is filled
+   */
+  upcxx::future<> read_range_async(I start, I end, D* buf) const;
+
+private:
+  I _size = 0;
+  int _k = 0;
+  I _local_size = 0;
+  bool _allocated = false;
+
+  std::vector<I> _partitions;
+  OwnerLookup<I> _owner;
+  std::vector<upcxx::global_ptr<D>> _gptrs;
+  upcxx::global_ptr<D> _local_gptr;
+  D* _local_data = nullptr;
+
+};
+
+/*########################*/
+/***** implementation *****/
+
+/*==================================*/
+/*** constructors and destructors ***/
+
+template <typename I, typename D>
+MultiVec<I, D>::MultiVec(I size, int k)
+{
+  allocate_elements(size, k);
+}
+
+template <typename I, typename D>
+MultiVec<I, D>::MultiVec(I size, int k, const Partitioner<I>& partitioner)
+{
+  allocate_elements(size, k, partitioner);
+}
+
+/* copy constructor */
+template <typename I, typename D>
+MultiVec<I, D>::MultiVec(const MultiVec& v)
+{
+  if (v.allocated()) {
+    allocate_elements(v.get_size(), v.get_num_vecs(), Partitioner<I>::offsets(v._partitions));
+    std::copy(v._local_data, v._local_data + _local_size*_k, _local_data);
+  }
+}
+
+/* move constructor */
+template <typename I, typename D>
+MultiVec<I, D>::MultiVec(MultiVec&& v) noexcept
+: _size(v._size)
+, _k(v._k)
+, _local_size(v._local_size)
+, _allocated(v._allocated)
+, _partitions( std::move(v._partitions) )
+, _owner( std::move(v._owner) )
+, _gptrs( std::move(v._gptrs) )
+, _local_gptr(v._local_gptr)
+, _local_data(v._local_data)
+{
+  /* make sure we don't free the memory we just gave to our new MultiVec */
+  v._local_gptr = nullptr;
+  v._allocated = false;
+}
+
+template <typename I, typename D>
+MultiVec<I, D>& MultiVec<I, D>::operator= (const MultiVec& v)
+{
+  MultiVec tmp(v); /* reuse copy constructor */
+  *this = std::move(tmp);
+  return *this;
+}
+
+template <typename I, typename D>
+MultiVec<I, D>& MultiVec<I, D>::operator= (MultiVec&& v) noexcept
+{
+  if (this == &v) return *this;
+
+  /* if we already are allocated, need to free memory */
+  if (allocated()) {
+    upcxx::delete_array(_local_gptr);
+  }
+
+  if (v.allocated()) {
+    _size = v._size;
+    _k = v._k;
+    _local_size = v._local_size;
+    _partitions = std::move(v._partitions);
+    _owner = std::move(v._owner);
+    _gptrs = std::move(v._gptrs);
+
+    _local_gptr = v._local_gptr;
+    v._local_gptr = nullptr;
+    v._allocated = false;
+
+    _local_data = v._local_data;
+
+    _allocated = true;
+  }
+  else {
+    _allocated = false;
+  }
+
+  return *this;
+}
+
+template <typename I, typename D>
+MultiVec<I, D>::~MultiVec() {
+  /* other ranks may still be reading from us */
+  upcxx::barrier();
+
+  if (allocated()) {
+    upcxx::delete_array(_local_gptr);
+  }
+}
+
+template <typename I, typename D>
+void MultiVec<I, D>::allocate_elements(I size, int k, const Partitioner<I>& partitioner) {
+
+  /* can only set the size once */
+  if (allocated()) {
+    throw std::logic_error("Called allocate_elements after size has already been set.");
+  }
+
+  if (size <= 0) {
+    throw std::length_error("size must be > 0");
+  }
+
+  if (k <= 0) {
+    throw std::length_error("number of vectors must be > 0");
+  }
+
+  _size = size;
+  _k = k;
+  _partitions = partitioner.partition(get_size());
+  _owner = OwnerLookup<I>(_partitions);
+  _local_size = _partitions[upcxx::rank_me()+1] - _partitions[upcxx::rank_me()];
+
+  /* allocate shared global memory and broadcast the pointers */
+  _gptrs.resize(upcxx::rank_n());
+
+  _local_gptr = upcxx::new_array<D>(_local_size * _k);
+  _allocated = true;
+  _gptrs[upcxx::rank_me()] = _local_gptr;
+  _local_data = _local_gptr.local();
+
+  for (int i = 0; i < upcxx::rank_n(); i++) {
+    _gptrs[i] = upcxx::broadcast(_gptrs[i], i).wait();
+  }
+
+}
+
+template <typename I, typename D>
+bool MultiVec<I, D>::allocated() const
+{
+  return _allocated;
+}
+
+/*===================================*/
+/*** vector dimensions and indices ***/
+
+template <typename I, typename D>
+I MultiVec<I, D>::get_size() const {
+  return _size;
+}
+
+template <typename I, typename D>
+int MultiVec<I, D>::get_num_vecs() const {
+  return _k;
+}
+
+template <typename I, typename D>
+I MultiVec<I, D>::get_local_size() const {
+  return _local_size;
+}
+
+template <typename I, typename D>
+I MultiVec<I, D>::get_local_start() const {
+  return _partitions[upcxx::rank_me()];
+}
+
+template <typename I, typename D>
+I MultiVec<I, D>::get_local_end() const {
+  return _partitions[upcxx::rank_me() + 1];
+}
+
+template <typename I, typename D>
+void MultiVec<I, D>::get_local_range(I &start, I &end) const {
+  start = get_local_start();
+  end = get_local_end();
+}
+
+template <typename I, typename D>
+const std::vector<I>& MultiVec<I, D>::get_partitions() const {
+  return _partitions;
+}
+
+template <typename I, typename D>
+void MultiVec<I, D>::validate_dims(const MultiVec& v) const {
+  if (get_size() != v.get_size() || get_num_vecs() != v.get_num_vecs()) {
+    std::ostringstream out;
+    out << "multivector dimensions " << get_size() << "x" << get_num_vecs() << " ";
+    out << v.get_size() << "x" << v.get_num_vecs() << " do not match.";
+    throw std::invalid_argument(out.str());
+  }
+  if (_partitions != v._partitions) {
+    throw std::invalid_argument("multivectors are partitioned differently");
+  }
+}
+
+/*================================*/
+/*** getting and setting values ***/
+
+template <typename I, typename D>
+void MultiVec<I, D>::set_all(D value) {
+  std::fill(_local_data, _local_data + _local_size*_k, value);
+}
+
+template <typename I, typename D>
+D* MultiVec<I, D>::get_local_array() {
+  return _local_data;
+}
+
+template <typename I, typename D>
+const D* MultiVec<I, D>::get_local_array_read() const {
+  return _local_data;
+}
+
+template <typename I, typename D>
+upcxx::global_ptr<D> MultiVec<I, D>::get_global_ptr(int rank) const {
+  return _gptrs[rank];
+}
+
+template <typename I, typename D>
+void MultiVec<I, D>::get_column(int j, Vec<I,D>& v) const {
+  if (v.get_size() != get_size()) {
+    throw std::invalid_argument("vector size does not match multivector size");
+  }
+  if (v.get_partitions() != _partitions) {
+    throw std::invalid_argument("vector is partitioned differently from the multivector");
+  }
+  if (j < 0 || j >= _k) {
+    throw std::out_of_range("column index out of range");
+  }
+
+  D* dest = v.get_local_array();
+  for (I i = 0; i < _local_size; ++i) {
+    dest[i] = _local_data[i*_k + j];
+  }
+}
+
+template <typename I, typename D>
+void MultiVec<I, D>::set_column(int j, const Vec<I,D>& v) {
+  if (v.get_size() != get_size()) {
+    throw std::invalid_argument("vector size does not match multivector size");
+  }
+  if (v.get_partitions() != _partitions) {
+    throw std::invalid_argument("vector is partitioned differently from the multivector");
+  }
+  if (j < 0 || j >= _k) {
+    throw std::out_of_range("column index out of range");
+  }
+
+  const D* src = v.get_local_array_read();
+  for (I i = 0; i < _local_size; ++i) {
+    _local_data[i*_k + j] = src[i];
+  }
+}
+
+template <typename I, typename D>
+upcxx::future<> MultiVec<I, D>::read_range_async(I start, I end, D* buf) const
+{
+  /* check bounds */
+  if (start < 0 || end > get_size() || start > end) {
+    std::ostringstream out;
+    out << "row range " << start << " to " << end << " out of range.";
+    throw std::out_of_range(out.str());
+  }
+
+  upcxx::future<> fut = upcxx::make_future();
+  if (start == end) {
+    return fut;
+  }
+
+  I proc = _owner(start);
+  I row = start;
+  while (row < end) {
+    I stop = std::min(_partitions[proc+1], end);
+    fut = upcxx::when_all(fut,
+      upcxx::rget(_gptrs[proc] + (row - _partitions[proc])*_k, buf + (row - start)*_k,
+                  (stop - row)*_k)
+    );
+
+    proc++;
+    row = stop;
+  }
+
+  return fut;
+}
@@ -0,0 +1,402 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "utils.hpp"
+
+/*
+ * Graph orderings, used by the matrices to renumber their rows and columns.
+ *
+ * _rcm_ordering gives the reverse Cuthill-McKee ordering, which numbers
+ * neighbouring vertices close together, so that a matrix renumbered with it
+ * has its nonzeros in a narrow band around the diagonal. it is serial, and
+ * needs the whole graph. _rcm_ordering_distributed computes the same
+ * ordering with the graph split between the ranks, without gathering it.
+ */
+
+/*
+ * reverse Cuthill-McKee ordering of the graph on vertices [0, n) with the
+ * given edges. an edge may be given in one or both directions, and more than
+ * once. returns the new index of each vertex. vertices without edges come
+ * last, and ties are broken by the lower vertex
+ */
+template <typename I>
+std::vector<I> _rcm_ordering(I n, const std::vector< std::pair<I,I> >& edges)
+{
+  /* adjacency lists, in both directions, without repeats or self loops */
+  std::vector<I> ptr(n+1, 0);
+  for (const auto& e: edges) {
+    if (e.first != e.second) {
+      ++ptr[e.first+1];
+      ++ptr[e.second+1];
+    }
+  }
+  for (I i = 0; i < n; ++i) {
+    ptr[i+1] += ptr[i];
+  }
+
+  std::vector<I> adj(ptr[n]);
+  std::vector<I> fill(ptr.begin(), ptr.end() - 1);
+  for (const auto& e: edges) {
+    if (e.first != e.second) {
+      adj[fill[e.first]++] = e.second;
+      adj[fill[e.second]++] = e.first;
+    }
+  }
+
+  I pos = 0;
+  for (I i = 0; i < n; ++i) {
+    I start = ptr[i], end = ptr[i+1];
+    std::sort(adj.begin() + start, adj.begin() + end);
+    ptr[i] = pos;
+    for (I j = start; j < end; ++j) {
+      if (j == start || adj[j] != adj[j-1]) {
+        adj[pos++] = adj[j];
+      }
+    }
+  }
+  ptr[n] = pos;
+  adj.resize(pos);
+
+  auto degree = [&ptr] (I v) { return ptr[v+1] - ptr[v]; };
+
+  /* breadth-first search from root, which fills order and returns where its last level starts */
+  std::vector<I> mark(n, -1);
+  I stamp = 0;
+  auto bfs = [&] (I root, std::vector<I>& order, I& nlevels) {
+    order.clear();
+    order.push_back(root);
+    mark[root] = stamp;
+    I level_start = 0;
+    nlevels = 0;
+    while (level_start < I(order.size())) {
+      I level_end = order.size();
+      for (I k = level_start; k < level_end; ++k) {
+        I v = order[k];
+        for (I j = ptr[v]; j < ptr[v+1]; ++j) {
+          if (mark[adj[j]] != stamp) {
+            mark[adj[j]] = stamp;
+            order.push_back(adj[j]);
+          }
+        }
+      }
+      ++nlevels;
+      if (I(order.size()) == level_end) {
+        break;
+      }
+      level_start = level_end;
+    }
+    ++stamp;
+    return level_start;
+  };
+
+  std::vector<I> order, level;
+  std::vector<bool> visited(n, false);
+  order.reserve(n);
+
+  /* lone vertices first, so that reversed they end up last */
+  for (I i = 0; i < n; ++i) {
+    if (degree(i) == 0) {
+      visited[i] = true;
+      order.push_back(i);
+    }
+  }
+
+  for (I i = 0; i < n; ++i) {
+    if (visited[i]) {
+      continue;
+    }
+
+    /*
+     * start from a pseudo-peripheral vertex of i's component (George and
+     * Liu): move to the least-degree vertex of the last level (the lowest,
+     * of equals) for as long as that makes the search deeper
+     */
+    I root = i, nlevels, deeper;
+    I last = bfs(root, level, nlevels);
+    while (true) {
+      I candidate = level[last];
+      for (I k = last; k < I(level.size()); ++k) {
+        I v = level[k];
+        if (degree(v) < degree(candidate) || (degree(v) == degree(candidate) && v < candidate)) {
+          candidate = v;
+        }
+      }
+      std::vector<I> candidate_level;
+      I candidate_last = bfs(candidate, candidate_level, deeper);
+      if (deeper <= nlevels) {
+        break;
+      }
+      root = candidate;
+      nlevels = deeper;
+      last = candidate_last;
+      level.swap(candidate_level);
+    }
+
+    /* Cuthill-McKee: breadth first, taking each vertex's new neighbours by increasing degree */
+    I head = order.size();
+    order.push_back(root);
+    visited[root] = true;
+    while (head < I(order.size())) {
+      I v = order[head++];
+      I first = order.size();
+      for (I j = ptr[v]; j < ptr[v+1]; ++j) {
+        if (!visited[adj[j]]) {
+          visited[adj[j]] = true;
+          order.push_back(adj[j]);
+        }
+      }
+      std::sort(order.begin() + first, order.end(), [&degree] (I a, I b) {
+        return degree(a) < degree(b) || (degree(a) == degree(b) && a < b);
+      });
+    }
+  }
+
+  /* reversed */
+  std::vector<I> perm(n);
+  for (I k = 0; k < n; ++k) {
+    perm[order[n-1-k]] = k;
+  }
+  return perm;
+}
+
+/* a vertex with a value, and the (parent, degree, vertex) key that orders a level */
+template <typename I>
+struct _rcm_pair
+{
+  I vertex, value;
+
+  bool operator<(const _rcm_pair& o) const {
+    return vertex < o.vertex || (vertex == o.vertex && value < o.value);
+  }
+  bool operator==(const _rcm_pair& o) const {
+    return vertex == o.vertex && value == o.value;
+  }
+};
+
+template <typename I>
+struct _rcm_key
+{
+  I parent, degree, vertex;
+
+  bool operator<(const _rcm_key& o) const {
+    if (parent != o.parent) return parent < o.parent;
+    if (degree != o.degree) return degree < o.degree;
+    return vertex < o.vertex;
+  }
+};
+
+/*
+ * the same ordering as _rcm_ordering, computed by all ranks together on a
+ * graph whose vertices [offsets[r], offsets[r+1]) belong to rank r. each rank
+ * passes the edges it knows of, and gets back the new index of each of its own
+ * vertices. no rank holds more than its vertices' adjacency: the searches go
+ * one level at a time, with one exchange between the ranks per level, so the
+ * number of rounds grows with the diameter and the number of components of
+ * the graph. collective
+ */
+template <typename I>
+std::vector<I> _rcm_ordering_distributed(const std::vector<I>& offsets,
+                                         const std::vector< std::pair<I,I> >& edges)
+{
+  int nranks = upcxx::rank_n(), me = upcxx::rank_me();
+  I n = offsets[nranks];
+
+  if (nranks == 1) {
+    return _rcm_ordering(n, edges);
+  }
+
+  const I none = std::numeric_limits<I>::max();
+  I start = offsets[me], local_n = offsets[me+1] - start;
+  OwnerLookup<I> owner(offsets);
+
+  /* adjacency lists of our vertices, from the edges in both directions */
+  std::vector< std::vector< _rcm_pair<I> > > arc_batches(nranks);
+  for (const auto& e: edges) {
+    if (e.first != e.second) {
+      arc_batches[owner(e.first)].push_back({e.first, e.second});
+      arc_batches[owner(e.second)].push_back({e.second, e.first});
+    }
+  }
+  auto arcs = _exchange(std::move(arc_batches));
+  std::sort(arcs.begin(), arcs.end());
+  arcs.erase(std::unique(arcs.begin(), arcs.end()), arcs.end());
+
+  std::vector<I> ptr(local_n+1, 0), adj(arcs.size());
+  for (size_t k = 0; k < arcs.size(); ++k) {
+    ++ptr[arcs[k].vertex - start + 1];
+    adj[k] = arcs[k].value;
+  }
+  std::vector< _rcm_pair<I> >().swap(arcs);
+  for (I i = 0; i < local_n; ++i) {
+    ptr[i+1] += ptr[i];
+  }
+
+  /* of one of our vertices, by its global index */
+  auto degree = [&] (I v) { return ptr[v - start + 1] - ptr[v - start]; };
+
+  /*
+   * breadth-first search from root, which leaves our part of the last level
+   * in last and returns the number of levels
+   */
+  std::vector<I> mark(local_n, none);
+  I stamp = 0;
+  auto bfs = [&] (I root, std::vector<I>& last) {
+    std::vector<I> frontier;
+    if (owner(root) == me) {
+      mark[root - start] = stamp;
+      frontier.push_back(root);
+    }
+
+    I nlevels = 0;
+    while (upcxx::reduce_all(static_cast<long long>(frontier.size()), upcxx::op_fast_add).wait() > 0) {
+      ++nlevels;
+      std::vector< std::vector<I> > reached(nranks);
+      for (I v: frontier) {
+        for (I j = ptr[v - start]; j < ptr[v - start + 1]; ++j) {
+          reached[owner(adj[j])].push_back(adj[j]);
+        }
+      }
+      last.swap(frontier);
+      frontier.clear();
+      for (I u: _exchange(std::move(reached))) {
+        if (mark[u - start] != stamp) {
+          mark[u - start] = stamp;
+          frontier.push_back(u);
+        }
+      }
+    }
+    ++stamp;
+    return nlevels;
+  };
+
+  /* the Cuthill-McKee number of each of our vertices */
+  std::vector<I> cm(local_n, none), parent(local_n, none);
+
+  /* lone vertices first, in order */
+  long long lone = 0, nlone;
+  for (I i = 0; i < local_n; ++i) {
+    lone += (ptr[i+1] == ptr[i]);
+  }
+  I next = static_cast<I>(_exclusive_sum(lone, nlone));
+  for (I i = 0; i < local_n; ++i) {
+    if (ptr[i+1] == ptr[i]) {
+      cm[i] = next++;
+    }
+  }
+  next = static_cast<I>(nlone);
+
+  /* one component at a time, from its lowest vertex */
+  I scan = 0;
+  while (true) {
+    while (scan < local_n && cm[scan] != none) {
+      ++scan;
+    }
+    I seed = upcxx::reduce_all(scan < local_n ? start + scan : none, upcxx::op_fast_min).wait();
+    if (seed == none) {
+      break;
+    }
+
+    /* pseudo-peripheral root, as in _rcm_ordering */
+    std::vector<I> level, candidate_level;
+    I root = seed;
+    I nlevels = bfs(root, level);
+    while (true) {
+      I least = none;
+      for (I v: level) {
+        least = std::min(least, degree(v));
+      }
+      least = upcxx::reduce_all(least, upcxx::op_fast_min).wait();
+      I candidate = none;
+      for (I v: level) {
+        if (degree(v) == least) {
+          candidate = std::min(candidate, v);
+        }
+      }
+      candidate = upcxx::reduce_all(candidate, upcxx::op_fast_min).wait();
+
+      I deeper = bfs(candidate, candidate_level);
+      if (deeper <= nlevels) {
+        break;
+      }
+      root = candidate;
+      nlevels = deeper;
+      level.swap(candidate_level);
+    }
+
+    /*
+     * Cuthill-McKee, a level at a time: each new vertex is taken by its
+     * lowest-numbered neighbour in the level before, and the ones taken by
+     * the same vertex go by increasing degree. so the level is numbered in
+     * (parent, degree, vertex) order, which one exchange sorts, with each
+     * rank sorting a share of the parents
+     */
+    I level_start = next++;
+    std::vector<I> frontier;
+    if (owner(root) == me) {
+      cm[root - start] = level_start;
+      frontier.push_back(root);
+    }
+
+    while (true) {
+      std::vector< std::vector< _rcm_pair<I> > > claims(nranks);
+      for (I v: frontier) {
+        for (I j = ptr[v - start]; j < ptr[v - start + 1]; ++j) {
+          claims[owner(adj[j])].push_back({adj[j], cm[v - start]});
+        }
+      }
+      std::vector<I> children;
+      for (const auto& c: _exchange(std::move(claims))) {
+        I u = c.vertex - start;
+        if (cm[u] != none) {
+          continue;
+        }
+        if (parent[u] == none) {
+          children.push_back(c.vertex);
+        }
+        parent[u] = std::min(parent[u], c.value);
+      }
+
+      long long width = next - level_start;
+      std::vector< std::vector< _rcm_key<I> > > key_batches(nranks);
+      for (I v: children) {
+        I p = parent[v - start];
+        parent[v - start] = none;
+        key_batches[static_cast<long long>(p - level_start) * nranks / width].push_back({p, degree(v), v});
+      }
+      auto keys = _exchange(std::move(key_batches));
+      std::sort(keys.begin(), keys.end());
+
+      long long total;
+      I base = next + static_cast<I>(_exclusive_sum(keys.size(), total));
+      if (total == 0) {
+        break;
+      }
+
+      std::vector< std::vector< _rcm_pair<I> > > numbers(nranks);
+      for (size_t k = 0; k < keys.size(); ++k) {
+        numbers[owner(keys[k].vertex)].push_back({keys[k].vertex, base + static_cast<I>(k)});
+      }
+      frontier.clear();
+      for (const auto& c: _exchange(std::move(numbers))) {
+        cm[c.vertex - start] = c.value;
+        frontier.push_back(c.vertex);
+      }
+      level_start = next;
+      next += static_cast<I>(total);
+    }
+  }
+
+  /* reversed */
+  std::vector<I> perm(local_n);
+  for (I i = 0; i < local_n; ++i) {
+    perm[i] = n - 1 - cm[i];
+  }
+  return perm;
+}
@@ -0,0 +1,840 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <upcxx/upcxx.hpp>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "vector.hpp"
+#include "multivector.hpp"
+#include "utils.hpp"
+
+/*
+ * GhostScatter gathers a fixed set of remote vector entries ("ghost" values)
+ * into a compact local buffer, in the style of PETSc's VecScatter.
+ *
+ * The set of indices is given once, in setup(). Each owning rank is told which
+ * of its entries we need, so that every later fetch is a single request per
+ * owner: the owner packs the requested values and ships them back in one
+ * message, instead of us issuing one rget per value (or fetching entries that
+ * we never use).
+ *
+ * The values can also travel as a narrower type W (say, float for a double
+ * vector), which the owner converts to and we convert back from, to cut the
+ * message sizes when the product can take the lost precision.
+ *
+ * PushScatter does the same exchange in the other direction: the owners of the
+ * values push them with one-sided puts straight into our ghost buffer as soon
+ * as they enter the product, so no request round trip sits on the critical
+ * path. Each put carries a remote completion RPC that we count to know when
+ * the buffer is full, and we hand the owners a credit once we are done
+ * reading it, so that the next product cannot overwrite values still in use.
+ *
+ * AddScatter is the reverse of GhostScatter, for the transpose products: we
+ * have contributions to a fixed set of remote entries, and each owner gets
+ * all of ours in one RPC that adds them in. Since the owners already know
+ * which entries we send (from setup()), only the values travel.
+ */
+
+template <typename I, typename D, typename W = D>
+class GhostScatter
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  GhostScatter() {};
+  ~GhostScatter();
+
+  /*=============*/
+  /*** set up ***/
+
+  /*
+   * set up the scatter to fetch the entries with global indices ghost_idxs
+   * (sorted and unique) from vectors partitioned by partitions. they are
+   * normally not stored locally, but any that are get copied like the rest.
+   * collective: must be called on all ranks.
+   */
+  void setup(const std::vector<I>& ghost_idxs, const std::vector<I>& partitions);
+
+  /* return true if setup() has been called */
+  bool is_set_up() const;
+
+  /* number of ghost values, i.e. the size of the buffer passed to begin() */
+  I get_ghost_size() const;
+
+  /* number of ranks that we fetch values from */
+  int get_num_owners() const;
+
+  /*=================*/
+  /*** scattering ***/
+
+  /*
+   * start fetching the ghost values of x into buf, which must have room for
+   * get_ghost_size() values. buf[k] will hold x[ghost_idxs[k]].
+   */
+  void begin(const Vec<I,D>& x, D* buf);
+
+  /*
+   * the same for the k vectors of a MultiVec: buf needs room for
+   * get_ghost_size()*k values, and buf[n*k + t] will hold entry t of row
+   * ghost_idxs[n]. each owner still sends all of its rows in one message
+   */
+  void begin(const MultiVec<I,D>& x, D* buf);
+
+  /* wait for the values requested by begin() to arrive */
+  void complete();
+
+private:
+  I _ghost_size = 0;
+
+  /* ranks we fetch from, and where their values start in the ghost buffer */
+  std::vector<int> _owners;
+  std::vector<I> _owner_starts;
+
+  /* for each requesting rank, the local offsets of the values it needs from us */
+  typedef std::vector< std::vector<I> > send_list_t;
+  std::unique_ptr< upcxx::dist_object<send_list_t> > _send_idxs;
+
+  upcxx::future<> _fut = upcxx::make_future();
+
+  bool _is_set_up = false;
+
+};
+
+/*########################*/
+/***** implementation *****/
+
+template <typename I, typename D, typename W>
+GhostScatter<I, D, W>::~GhostScatter()
+{
+  /* other ranks may still be asking us for values */
+  if (_is_set_up) {
+    upcxx::barrier();
+  }
+}
+
+template <typename I, typename D, typename W>
+void GhostScatter<I, D, W>::setup(const std::vector<I>& ghost_idxs, const std::vector<I>& partitions)
+{
+  if (_is_set_up) {
+    throw std::logic_error("GhostScatter already set up");
+  }
+
+  _ghost_size = ghost_idxs.size();
+  _send_idxs.reset(new upcxx::dist_object<send_list_t>(send_list_t(upcxx::rank_n())));
+
+  /* group the indices by owner. they are sorted, so each owner's are contiguous */
+  _owners.clear();
+  _owner_starts.clear();
+
+  upcxx::future<> fut = upcxx::make_future();
+
+  OwnerLookup<I> owner_of(partitions);
+  I start = 0;
+  while (start < _ghost_size) {
+    int owner = owner_of(ghost_idxs[start]);
+
+    I end = start;
+    std::vector<I> offsets;
+    while (end < _ghost_size && ghost_idxs[end] < partitions[owner+1]) {
+      offsets.push_back(ghost_idxs[end] - partitions[owner]);
+      ++end;
+    }
+
+    _owners.push_back(owner);
+    _owner_starts.push_back(start);
+
+    /* tell the owner which of its values we will be asking for */
+    fut = upcxx::when_all(fut,
+      upcxx::rpc(owner,
+                 [] (upcxx::dist_object<send_list_t>& sends, int requester, const std::vector<I>& offsets) {
+                   (*sends)[requester] = offsets;
+                 }, *_send_idxs, upcxx::rank_me(), offsets)
+    );
+
+    start = end;
+  }
+  _owner_starts.push_back(_ghost_size);
+
+  /* once everyone's lists have been delivered, the plan is complete */
+  fut.wait();
+  upcxx::barrier();
+
+  _is_set_up = true;
+}
+
+template <typename I, typename D, typename W>
+bool GhostScatter<I, D, W>::is_set_up() const
+{
+  return _is_set_up;
+}
+
+template <typename I, typename D, typename W>
+I GhostScatter<I, D, W>::get_ghost_size() const
+{
+  return _ghost_size;
+}
+
+template <typename I, typename D, typename W>
+int GhostScatter<I, D, W>::get_num_owners() const
+{
+  return _owners.size();
+}
+
+template <typename I, typename D, typename W>
+void GhostScatter<I, D, W>::begin(const Vec<I,D>& x, D* buf)
+{
+  if (!_is_set_up) {
+    throw std::logic_error("Must set up GhostScatter with ::setup() before calling ::begin");
+  }
+
+  _fut = upcxx::make_future();
+
+  for (size_t k = 0; k < _owners.size(); ++k) {
+    int owner = _owners[k];
+    D* dest = buf + _owner_starts[k];
+
+    /* the owner packs the values we asked for in setup() */
+    auto f = upcxx::rpc(owner,
+               [] (upcxx::dist_object<send_list_t>& sends, int requester, upcxx::global_ptr<D> x_gptr) {
+                 const D* x_local = x_gptr.local();
+                 const std::vector<I>& offsets = (*sends)[requester];
+                 std::vector<W> vals(offsets.size());
+                 for (size_t i = 0; i < offsets.size(); ++i) {
+                   vals[i] = W(x_local[offsets[i]]);
+                 }
+                 return vals;
+               }, *_send_idxs, upcxx::rank_me(), x.get_global_ptr(owner)
+             ).then(
+               [dest] (const std::vector<W>& vals) {
+                 for (size_t i = 0; i < vals.size(); ++i) {
+                   dest[i] = D(vals[i]);
+                 }
+               }
+             );
+
+    _fut = upcxx::when_all(_fut, f);
+  }
+}
+
+template <typename I, typename D, typename W>
+void GhostScatter<I, D, W>::begin(const MultiVec<I,D>& x, D* buf)
+{
+  if (!_is_set_up) {
+    throw std::logic_error("Must set up GhostScatter with ::setup() before calling ::begin");
+  }
+
+  _fut = upcxx::make_future();
+
+  int k = x.get_num_vecs();
+
+  for (size_t n = 0; n < _owners.size(); ++n) {
+    int owner = _owners[n];
+    D* dest = buf + _owner_starts[n]*k;
+
+    /* the owner packs the rows we asked for in setup() */
+    auto f = upcxx::rpc(owner,
+               [] (upcxx::dist_object<send_list_t>& sends, int requester, upcxx::global_ptr<D> x_gptr, int k) {
+                 const D* x_local = x_gptr.local();
+                 const std::vector<I>& offsets = (*sends)[requester];
+                 std::vector<W> vals(offsets.size()*k);
+                 for (size_t i = 0; i < offsets.size(); ++i) {
+                   for (int t = 0; t < k; ++t) {
+                     vals[i*k + t] = W(x_local[offsets[i]*k + t]);
+                   }
+                 }
+                 return vals;
+               }, *_send_idxs, upcxx::rank_me(), x.get_global_ptr(owner), k
+             ).then(
+               [dest] (const std::vector<W>& vals) {
+                 for (size_t i = 0; i < vals.size(); ++i) {
+                   dest[i] = D(vals[i]);
+                 }
+               }
+             );
+
+    _fut = upcxx::when_all(_fut, f);
+  }
+}
+
+template <typename I, typename D, typename W>
+void GhostScatter<I, D, W>::complete()
+{
+  _fut.wait();
+  _fut = upcxx::make_future();
+}
+
+/*=====================*/
+/* PUSH SCATTER        */
+/*=====================*/
+
+template <typename I, typename D>
+class PushScatter
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  PushScatter() {};
+  ~PushScatter();
+
+  /*=============*/
+  /*** set up ***/
+
+  /*
+   * set up the scatter to receive the entries with global indices ghost_idxs
+   * (sorted, unique, and not stored locally) from vectors partitioned by
+   * partitions. collective: must be called on all ranks.
+   */
+  void setup(const std::vector<I>& ghost_idxs, const std::vector<I>& partitions);
+
+  /* return true if setup() has been called */
+  bool is_set_up() const;
+
+  /* number of ghost values */
+  I get_ghost_size() const;
+
+  /* number of ranks that push values to us */
+  int get_num_owners() const;
+
+  /*
+   * the buffer the ghost values are pushed into. entry g holds x[ghost_idxs[g]],
+   * or for a MultiVec of k vectors, entry g*k + j holds vector j's
+   */
+  const D* get_ghost_array() const;
+
+  /*=================*/
+  /*** scattering ***/
+
+  /*
+   * push our local values of x to the ranks that need them. collective: the
+   * values we receive are pushed by the other ranks' calls to begin().
+   */
+  void begin(const Vec<I,D>& x);
+
+  /*
+   * the same, for all the vectors of a MultiVec at once. the first time more
+   * vectors are pushed than before, the ghost buffers grow and the owners
+   * learn the new ones, so every rank must use the same number of vectors
+   */
+  void begin(const MultiVec<I,D>& x);
+
+  /* wait until all our values have been sent, and all ghost values have arrived */
+  void complete();
+
+  /* tell the owners that we are done reading the ghost buffer */
+  void release();
+
+private:
+  struct push_state_t {
+    /*
+     * ranks that we push to, with the local offsets they need, their ghost
+     * buffers, and the ghost index our values start at in them
+     */
+    std::vector<int> consumers;
+    std::vector< std::vector<I> > offsets;
+    std::vector< upcxx::global_ptr<D> > bufs;
+    std::vector<I> starts;
+
+    /* number of times each consumer has freed its buffer for us to write to */
+    std::vector<long> credits;
+
+    /* number of pushes into our ghost buffer that have landed */
+    long recv_count = 0;
+  };
+
+  void _push(size_t k);
+  void _push_all();
+  void _grow(int width);
+
+  I _ghost_size = 0;
+  std::vector<int> _owners;
+  /* where we are in each owner's list of consumers, so credits go straight to us */
+  std::vector<size_t> _owner_slots;
+
+  upcxx::global_ptr<D> _ghost_gptr;
+  /* the number of values per ghost index the buffers have room for */
+  int _capacity = 1;
+
+  std::unique_ptr< upcxx::dist_object<push_state_t> > _state;
+
+  /* values packed for each consumer, and the consumers still waiting on a credit */
+  std::vector< std::vector<D> > _send_bufs;
+  std::vector<size_t> _pending;
+  /* the values being pushed are the _x_width values at _x_local[offset*_x_width] */
+  const D* _x_local = nullptr;
+  int _x_width = 1;
+
+  upcxx::future<> _send_fut = upcxx::make_future();
+  upcxx::future<> _credit_fut = upcxx::make_future();
+
+  bool _is_set_up = false;
+
+};
+
+template <typename I, typename D>
+PushScatter<I, D>::~PushScatter()
+{
+  if (_is_set_up) {
+    /* make sure nobody is still writing to us or handing us credits */
+    _credit_fut.wait();
+    upcxx::barrier();
+    upcxx::delete_array(_ghost_gptr);
+  }
+}
+
+template <typename I, typename D>
+void PushScatter<I, D>::setup(const std::vector<I>& ghost_idxs, const std::vector<I>& partitions)
+{
+  if (_is_set_up) {
+    throw std::logic_error("PushScatter already set up");
+  }
+
+  _ghost_size = ghost_idxs.size();
+  _ghost_gptr = upcxx::new_array<D>(_ghost_size);
+  _state.reset(new upcxx::dist_object<push_state_t>(push_state_t()));
+
+  _owners.clear();
+  _owner_slots.clear();
+
+  std::vector< upcxx::future<size_t> > slots;
+
+  /* group the indices by owner, and tell each owner where to put its values */
+  OwnerLookup<I> owner_of(partitions);
+  I start = 0;
+  while (start < _ghost_size) {
+    int owner = owner_of(ghost_idxs[start]);
+
+    I end = start;
+    std::vector<I> offsets;
+    while (end < _ghost_size && ghost_idxs[end] < partitions[owner+1]) {
+      offsets.push_back(ghost_idxs[end] - partitions[owner]);
+      ++end;
+    }
+
+    _owners.push_back(owner);
+
+    slots.push_back(
+      upcxx::rpc(owner,
+                 [] (upcxx::dist_object<push_state_t>& st, int consumer,
+                     const std::vector<I>& offsets, upcxx::global_ptr<D> buf, I start) {
+                   st->consumers.push_back(consumer);
+                   st->offsets.push_back(offsets);
+                   st->bufs.push_back(buf);
+                   st->starts.push_back(start);
+                   /* the buffer starts out free */
+                   st->credits.push_back(1);
+                   return st->consumers.size() - 1;
+                 }, *_state, upcxx::rank_me(), offsets, _ghost_gptr, start)
+    );
+
+    start = end;
+  }
+
+  for (auto& slot : slots) {
+    _owner_slots.push_back(slot.wait());
+  }
+  upcxx::barrier();
+
+  _send_bufs.resize((*_state)->consumers.size());
+  for (size_t k = 0; k < _send_bufs.size(); ++k) {
+    _send_bufs[k].resize((*_state)->offsets[k].size());
+  }
+
+  _capacity = 1;
+  _is_set_up = true;
+}
+
+template <typename I, typename D>
+bool PushScatter<I, D>::is_set_up() const
+{
+  return _is_set_up;
+}
+
+template <typename I, typename D>
+I PushScatter<I, D>::get_ghost_size() const
+{
+  return _ghost_size;
+}
+
+template <typename I, typename D>
+int PushScatter<I, D>::get_num_owners() const
+{
+  return _owners.size();
+}
+
+template <typename I, typename D>
+const D* PushScatter<I, D>::get_ghost_array() const
+{
+  return _ghost_gptr.local();
+}
+
+/* pack and put the values for consumer k */
+template <typename I, typename D>
+void PushScatter<I, D>::_push(size_t k)
+{
+  push_state_t& st = **_state;
+
+  st.credits[k]--;
+
+  const std::vector<I>& offsets = st.offsets[k];
+  D* buf = _send_bufs[k].data();
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    const D* x = _x_local + size_t(offsets[i]) * _x_width;
+    for (int j = 0; j < _x_width; ++j) {
+      buf[i*_x_width + j] = x[j];
+    }
+  }
+
+  _send_fut = upcxx::when_all(_send_fut,
+    upcxx::rput(buf, st.bufs[k] + size_t(st.starts[k]) * _x_width, offsets.size() * _x_width,
+                upcxx::operation_cx::as_future() |
+                upcxx::remote_cx::as_rpc(
+                  [] (upcxx::dist_object<push_state_t>& st) {
+                    st->recv_count++;
+                  }, *_state))
+  );
+}
+
+/* push to every consumer with a free buffer, and hold the rest back for complete() */
+template <typename I, typename D>
+void PushScatter<I, D>::_push_all()
+{
+  push_state_t& st = **_state;
+
+  _pending.clear();
+  for (size_t k = 0; k < st.consumers.size(); ++k) {
+    if (st.credits[k] > 0) {
+      _push(k);
+    }
+    else {
+      /* still reading the last values we sent; try again in complete() */
+      _pending.push_back(k);
+    }
+  }
+}
+
+/*
+ * make room for width values per ghost index, and tell our owners where the
+ * new buffer is. collective, since every rank grows at the same product
+ */
+template <typename I, typename D>
+void PushScatter<I, D>::_grow(int width)
+{
+  /* everyone is past complete(), so all the puts into the old buffers have landed */
+  upcxx::barrier();
+
+  upcxx::delete_array(_ghost_gptr);
+  _ghost_gptr = upcxx::new_array<D>(size_t(_ghost_size) * width);
+  _capacity = width;
+
+  upcxx::future<> fut = upcxx::make_future();
+  for (size_t n = 0; n < _owners.size(); ++n) {
+    fut = upcxx::when_all(fut,
+      upcxx::rpc(_owners[n],
+                 [] (upcxx::dist_object<push_state_t>& st, size_t slot, upcxx::global_ptr<D> buf) {
+                   st->bufs[slot] = buf;
+                 }, *_state, _owner_slots[n], _ghost_gptr)
+    );
+  }
+  fut.wait();
+
+  push_state_t& st = **_state;
+  for (size_t k = 0; k < _send_bufs.size(); ++k) {
+    _send_bufs[k].resize(st.offsets[k].size() * width);
+  }
+
+  upcxx::barrier();
+}
+
+template <typename I, typename D>
+void PushScatter<I, D>::begin(const Vec<I,D>& x)
+{
+  if (!_is_set_up) {
+    throw std::logic_error("Must set up PushScatter with ::setup() before calling ::begin");
+  }
+
+  _x_local = x.get_local_array_read();
+  _x_width = 1;
+  _push_all();
+}
+
+template <typename I, typename D>
+void PushScatter<I, D>::begin(const MultiVec<I,D>& x)
+{
+  if (!_is_set_up) {
+    throw std::logic_error("Must set up PushScatter with ::setup() before calling ::begin");
+  }
+
+  if (x.get_num_vecs() > _capacity) {
+    _grow(x.get_num_vecs());
+  }
+
+  _x_local = x.get_local_array_read();
+  _x_width = x.get_num_vecs();
+  _push_all();
+}
+
+template <typename I, typename D>
+void PushScatter<I, D>::complete()
+{
+  push_state_t& st = **_state;
+
+  /* send whatever was held back waiting on a credit */
+  while (!_pending.empty()) {
+    upcxx::progress();
+    for (size_t p = 0; p < _pending.size(); ) {
+      if (st.credits[_pending[p]] > 0) {
+        _push(_pending[p]);
+        _pending[p] = _pending.back();
+        _pending.pop_back();
+      }
+      else {
+        ++p;
+      }
+    }
+  }
+
+  /* once the puts are complete at the source, x can be changed again */
+  _send_fut.wait();
+  _send_fut = upcxx::make_future();
+
+  /* wait for every owner's values to land */
+  long n_owners = _owners.size();
+  while (st.recv_count < n_owners) {
+    upcxx::progress();
+  }
+  st.recv_count -= n_owners;
+}
+
+template <typename I, typename D>
+void PushScatter<I, D>::release()
+{
+  /* start a new chain once the old credits have all arrived, so it doesn't grow forever */
+  if (_credit_fut.ready()) {
+    _credit_fut = upcxx::make_future();
+  }
+
+  for (size_t n = 0; n < _owners.size(); ++n) {
+    _credit_fut = upcxx::when_all(_credit_fut,
+      upcxx::rpc(_owners[n],
+                 [] (upcxx::dist_object<push_state_t>& st, size_t slot) {
+                   st->credits[slot]++;
+                 }, *_state, _owner_slots[n])
+    );
+  }
+}
+
+/*=====================*/
+/* ADD SCATTER         */
+/*=====================*/
+
+template <typename I, typename D>
+class AddScatter
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  AddScatter() {};
+  ~AddScatter();
+
+  /*=============*/
+  /*** set up ***/
+
+  /*
+   * set up the scatter to add into the entries with global indices idxs
+   * (sorted and unique) of vectors partitioned by partitions.
+   * collective: must be called on all ranks.
+   */
+  void setup(const std::vector<I>& idxs, const std::vector<I>& partitions);
+
+  /* return true if setup() has been called */
+  bool is_set_up() const;
+
+  /* number of entries we add into, i.e. the size of the array passed to begin() */
+  I get_size() const;
+
+  /* number of ranks that we send contributions to */
+  int get_num_owners() const;
+
+  /*=================*/
+  /*** scattering ***/
+
+  /*
+   * send vals to the owners, where vals[k] is to be added to entry idxs[k].
+   * vals must not change until complete() returns
+   */
+  void begin(const D* vals);
+
+  /*
+   * wait for every rank's contributions to our entries, and add them into
+   * the local part of y. collective, since we only know that everyone's
+   * have arrived once every rank has sent its own
+   */
+  void complete(Vec<I,D>& y);
+
+private:
+  struct recv_state_t {
+    /* for each sending rank, the local offsets that its values go to */
+    std::vector< std::vector<I> > offsets;
+
+    /*
+     * the incoming sums. a rank that is ahead of us can start sending its
+     * next product's values before we are done with this one, so alternate
+     * between two buffers
+     */
+    std::vector<D> sums[2];
+  };
+
+  I _size = 0;
+
+  /* ranks we send to, and where their values start in the array passed to begin() */
+  std::vector<int> _owners;
+  std::vector<I> _owner_starts;
+
+  std::unique_ptr< upcxx::dist_object<recv_state_t> > _state;
+
+  /* which of the receive buffers this product uses */
+  int _parity = 0;
+
+  upcxx::future<> _fut = upcxx::make_future();
+
+  bool _is_set_up = false;
+
+};
+
+template <typename I, typename D>
+AddScatter<I, D>::~AddScatter()
+{
+  /* other ranks may still be sending to us */
+  if (_is_set_up) {
+    _fut.wait();
+    upcxx::barrier();
+  }
+}
+
+template <typename I, typename D>
+void AddScatter<I, D>::setup(const std::vector<I>& idxs, const std::vector<I>& partitions)
+{
+  if (_is_set_up) {
+    throw std::logic_error("AddScatter already set up");
+  }
+
+  _size = idxs.size();
+
+  recv_state_t init;
+  init.offsets.resize(upcxx::rank_n());
+  I local_size = partitions[upcxx::rank_me()+1] - partitions[upcxx::rank_me()];
+  init.sums[0].assign(local_size, D(0));
+  init.sums[1].assign(local_size, D(0));
+  _state.reset(new upcxx::dist_object<recv_state_t>(std::move(init)));
+
+  /* group the indices by owner. they are sorted, so each owner's are contiguous */
+  _owners.clear();
+  _owner_starts.clear();
+
+  upcxx::future<> fut = upcxx::make_future();
+
+  OwnerLookup<I> owner_of(partitions);
+  I start = 0;
+  while (start < _size) {
+    int owner = owner_of(idxs[start]);
+
+    I end = start;
+    std::vector<I> offsets;
+    while (end < _size && idxs[end] < partitions[owner+1]) {
+      offsets.push_back(idxs[end] - partitions[owner]);
+      ++end;
+    }
+
+    _owners.push_back(owner);
+    _owner_starts.push_back(start);
+
+    /* tell the owner where the values we send will go */
+    fut = upcxx::when_all(fut,
+      upcxx::rpc(owner,
+                 [] (upcxx::dist_object<recv_state_t>& st, int sender, const std::vector<I>& offsets) {
+                   st->offsets[sender] = offsets;
+                 }, *_state, upcxx::rank_me(), offsets)
+    );
+
+    start = end;
+  }
+  _owner_starts.push_back(_size);
+
+  fut.wait();
+  upcxx::barrier();
+
+  _is_set_up = true;
+}
+
+template <typename I, typename D>
+bool AddScatter<I, D>::is_set_up() const
+{
+  return _is_set_up;
+}
+
+template <typename I, typename D>
+I AddScatter<I, D>::get_size() const
+{
+  return _size;
+}
+
+template <typename I, typename D>
+int AddScatter<I, D>::get_num_owners() const
+{
+  return _owners.size();
+}
+
+template <typename I, typename D>
+void AddScatter<I, D>::begin(const D* vals)
+{
+  if (!_is_set_up) {
+    throw std::logic_error("Must set up AddScatter with ::setup() before calling ::begin");
+  }
+
+  _fut = upcxx::make_future();
+
+  for (size_t k = 0; k < _owners.size(); ++k) {
+    _fut = upcxx::when_all(_fut,
+      upcxx::rpc(_owners[k],
+                 [] (upcxx::dist_object<recv_state_t>& st, int sender, int parity,
+                     upcxx::view<D> vals) {
+                   const std::vector<I>& offsets = st->offsets[sender];
+                   D* sums = st->sums[parity].data();
+                   size_t i = 0;
+                   for (const D& v : vals) {
+                     sums[offsets[i++]] += v;
+                   }
+                 }, *_state, upcxx::rank_me(), _parity,
+                 upcxx::make_view(vals + _owner_starts[k], vals + _owner_starts[k+1]))
+    );
+  }
+}
+
+template <typename I, typename D>
+void AddScatter<I, D>::complete(Vec<I,D>& y)
+{
+  /* once our RPCs are done, and everyone else's, all our sums are in */
+  _fut.wait();
+  _fut = upcxx::make_future();
+  upcxx::barrier();
+
+  std::vector<D>& sums = (*_state)->sums[_parity];
+  D* y_array = y.get_local_array();
+  for (size_t i = 0; i < sums.size(); ++i) {
+    y_array[i] += sums[i];
+    sums[i] = D(0);
+  }
+
+  _parity ^= 1;
+}
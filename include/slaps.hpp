@@ -6,4 +6,11 @@
 #pragma once
 
 #include "vector.hpp"
+#include "multivector.hpp"
+#include "scatter.hpp"
+#include "threads.hpp"
+#include "ordering.hpp"
+#include "kernels.hpp"
 #include "matrix.hpp"
+#include "spgemm.hpp"
+#include "io.hpp"
@@ -0,0 +1,502 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <upcxx/upcxx.hpp>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+#include "utils.hpp"
+#include "threads.hpp"
+#include "matrix.hpp"
+
+/*
+ * Sparse matrix-matrix products C = A*B, for the CSRMat types.
+ *
+ * Row i of C is a sum of the rows of B picked out by row i of A, so each rank
+ * needs the rows of B for its rows' columns of A. The ones other ranks own
+ * are asked for once per owner: in the symbolic phase, one RPC per owner
+ * brings back where those rows are kept and their columns. In the numeric
+ * phase, each owner puts its values of B in shared memory, and the values
+ * of the rows we need come with one-sided rgets, one per run of neighbouring
+ * rows.
+ *
+ * Each row of C is gathered in a hash table keyed by column, one table per
+ * thread. The symbolic phase finds the columns of each row of C, and the
+ * numeric phase only sums into them. So a product repeated with new values
+ * but the same patterns, like the Galerkin product R*A*P of a multigrid
+ * setup with changing coefficients, only needs the numeric phase again.
+ */
+
+template <typename I, typename D>
+class SpGEMM
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  SpGEMM() {};
+  ~SpGEMM();
+
+  SpGEMM(const SpGEMM&) = delete;
+  SpGEMM& operator= (const SpGEMM&) = delete;
+
+  /*==============*/
+  /*** products ***/
+
+  /*
+   * the symbolic phase: find the pattern of A*B, and where the rows of B
+   * we need are. A and B must be set up, of types that keep their CSR arrays
+   * (see CSRMat::get_local_csr()), and the columns of A must be partitioned
+   * like the rows of B. collective
+   */
+  void setup(const CSRMat<I,D>& A, const CSRMat<I,D>& B);
+
+  /*
+   * the numeric phase: C = A*B, for A and B with the patterns they had in
+   * setup(). C gets the rows of A and the columns of B, partitioned as
+   * they are, and its rows with set_local_csr(), so it must be a new
+   * matrix, and C.setup() comes next. collective
+   */
+  void multiply(const CSRMat<I,D>& A, const CSRMat<I,D>& B, CSRMat<I,D>& C);
+
+  /* the number of nonzeros in our rows of C */
+  I get_local_nnz() const;
+
+  /*===============*/
+  /*** threading ***/
+
+  /* set how many threads each rank uses for the local products (default 1) */
+  void set_num_threads(int nthreads);
+  int get_num_threads() const;
+
+private:
+  bool _set_up = false;
+
+  /* the dimensions of C and its partitions */
+  I _M, _N;
+  std::vector<I> _row_partitions, _col_partitions;
+
+  /* our rows of A, with their columns, and the slots of the rows of B below they pick */
+  std::vector<I> _a_row_ptr;
+  std::vector<I> _a_cols;
+  std::vector<I> _a_slots;
+
+  /*
+   * the rows of B we use, with global columns: first our own, then the ones
+   * fetched, in order of their global indices
+   */
+  std::vector<I> _b_row_ptr;
+  std::vector<I> _b_cols;
+  std::vector<D> _b_vals;
+  I _b_local_rows = 0;
+
+  /* the pattern of our rows of C */
+  std::vector<I> _c_row_ptr;
+  std::vector<I> _c_cols;
+
+  /* a run of neighbouring rows of B on owner: count values at offset there, for _b_vals[dest] */
+  struct _Fetch
+  {
+    int owner;
+    I offset, count, dest;
+  };
+  std::vector<_Fetch> _fetches;
+
+  /* the values of our rows of B, and everyone's, where the others can get them */
+  upcxx::global_ptr<D> _shared_vals;
+  std::vector< upcxx::global_ptr<D> > _shared_ptrs;
+
+  std::shared_ptr<ThreadPool> _pool;
+
+  /* run f(start, end, t) over ranges of our rows, split by their nonzeros in A */
+  template <typename F>
+  void _on_rows(F f) const;
+};
+
+/* C = A*B, with both phases at once. collective */
+template <typename I, typename D>
+void spgemm(const CSRMat<I,D>& A, const CSRMat<I,D>& B, CSRMat<I,D>& C);
+
+/*########################*/
+/***** implementation *****/
+
+/*
+ * an open addressing hash table of the columns of one row of C, each with an
+ * index (its place in the row, once known). it remembers the places it has
+ * filled, so that emptying it for the next row costs only as much as the row
+ */
+template <typename I>
+class _ColumnHash
+{
+
+public:
+  /* make room for rows of up to n columns */
+  void reserve(size_t n)
+  {
+    size_t size = 16;
+    while (size < 2*n) {
+      size *= 2;
+    }
+    if (size > _keys.size()) {
+      _keys.assign(size, _empty());
+      _idx.resize(size);
+      _mask = size - 1;
+    }
+  }
+
+  /* the index of col, with col put in with index idx if it is new. returns true if it was new */
+  bool insert(I col, I idx)
+  {
+    size_t h = _find(col);
+    if (_keys[h] == col) {
+      return false;
+    }
+    _keys[h] = col;
+    _idx[h] = idx;
+    _used.push_back(h);
+    return true;
+  }
+
+  /* the index of col, which must be in */
+  I index(I col) const
+  {
+    return _idx[_find(col)];
+  }
+
+  /* take everything out */
+  void clear()
+  {
+    for (size_t h: _used) {
+      _keys[h] = _empty();
+    }
+    _used.clear();
+  }
+
+private:
+  std::vector<I> _keys, _idx;
+  std::vector<size_t> _used;
+  size_t _mask = 0;
+
+  static I _empty() { return std::numeric_limits<I>::max(); }
+
+  /* where col is, or the empty place it would go */
+  size_t _find(I col) const
+  {
+    size_t h = size_t((uint64_t(col) * 0x9E3779B97F4A7C15ull) >> 32) & _mask;
+    while (_keys[h] != col && _keys[h] != _empty()) {
+      h = (h + 1) & _mask;
+    }
+    return h;
+  }
+};
+
+template <typename I, typename D>
+SpGEMM<I, D>::~SpGEMM()
+{
+  if (_shared_vals) {
+    upcxx::delete_array(_shared_vals);
+  }
+}
+
+template <typename I, typename D>
+void SpGEMM<I, D>::setup(const CSRMat<I,D>& A, const CSRMat<I,D>& B)
+{
+  I AM, AN, BM, BN;
+  A.get_dimensions(AM, AN);
+  B.get_dimensions(BM, BN);
+  if (AN != BM) {
+    throw std::invalid_argument("the columns of A must match the rows of B");
+  }
+  if (A.get_col_partitions() != B.get_row_partitions()) {
+    throw std::invalid_argument("the columns of A must be partitioned like the rows of B");
+  }
+
+  _M = AM;
+  _N = BN;
+  _row_partitions = A.get_row_partitions();
+  _col_partitions = B.get_col_partitions();
+
+  std::vector<D> a_vals;
+  A.get_local_csr(_a_row_ptr, _a_cols, a_vals);
+  B.get_local_csr(_b_row_ptr, _b_cols, _b_vals);
+
+  I bstart, bend;
+  B.get_local_rows(bstart, bend);
+  _b_local_rows = bend - bstart;
+  I b_local_nnz = _b_row_ptr.back();
+
+  /* the rows of B that others own, each once, in order */
+  std::vector<I> ghost_rows;
+  for (I col: _a_cols) {
+    if (col < bstart || col >= bend) {
+      ghost_rows.push_back(col);
+    }
+  }
+  std::sort(ghost_rows.begin(), ghost_rows.end());
+  ghost_rows.erase(std::unique(ghost_rows.begin(), ghost_rows.end()), ghost_rows.end());
+
+  _a_slots.resize(_a_cols.size());
+  for (size_t j = 0; j < _a_cols.size(); ++j) {
+    I col = _a_cols[j];
+    _a_slots[j] = (col >= bstart && col < bend) ? col - bstart :
+      _b_local_rows + (std::lower_bound(ghost_rows.begin(), ghost_rows.end(), col) - ghost_rows.begin());
+  }
+
+  /*
+   * ask each owner where its rows are kept and what their columns are. the
+   * answer is the offset of each row among the owner's values, the length
+   * of each, and then all their columns
+   */
+  upcxx::dist_object< SpGEMM<I,D>* > obj(this);
+  OwnerLookup<I> owner_of(B.get_row_partitions());
+  const auto& partitions = B.get_row_partitions();
+
+  std::vector< std::pair< int, std::pair<size_t, size_t> > > groups;
+  std::vector< upcxx::future< std::vector<I> > > requests;
+  for (size_t k = 0; k < ghost_rows.size(); ) {
+    int proc = owner_of(ghost_rows[k]);
+    size_t first = k;
+    std::vector<I> rows;
+    for (; k < ghost_rows.size() && ghost_rows[k] < partitions[proc+1]; ++k) {
+      rows.push_back(ghost_rows[k] - partitions[proc]);
+    }
+    groups.push_back(std::make_pair(proc, std::make_pair(first, k)));
+    requests.push_back(
+      upcxx::rpc(proc,
+                 [] (upcxx::dist_object< SpGEMM<I,D>* >& obj, upcxx::view<I> rows) {
+                   const SpGEMM<I,D>& self = **obj;
+                   std::vector<I> answer(2 * rows.size());
+                   size_t k = 0;
+                   for (I row: rows) {
+                     answer[k] = self._b_row_ptr[row];
+                     answer[rows.size() + k] = self._b_row_ptr[row+1] - self._b_row_ptr[row];
+                     ++k;
+                   }
+                   for (I row: rows) {
+                     answer.insert(answer.end(), self._b_cols.begin() + self._b_row_ptr[row],
+                                   self._b_cols.begin() + self._b_row_ptr[row+1]);
+                   }
+                   return answer;
+                 }, obj, upcxx::make_view(rows.begin(), rows.end()))
+    );
+  }
+
+  /* the fetched rows go after ours, and neighbouring ones are fetched together */
+  _fetches.clear();
+  for (size_t g = 0; g < groups.size(); ++g) {
+    std::vector<I> answer = requests[g].wait();
+    size_t nrows = groups[g].second.second - groups[g].second.first;
+    const I* offsets = answer.data();
+    const I* lengths = answer.data() + nrows;
+
+    _b_cols.insert(_b_cols.end(), answer.begin() + 2*nrows, answer.end());
+    for (size_t k = 0; k < nrows; ++k) {
+      I dest = _b_row_ptr.back();
+      _b_row_ptr.push_back(dest + lengths[k]);
+
+      if (lengths[k] == 0) {
+        continue;
+      }
+      if (!_fetches.empty() && _fetches.back().owner == groups[g].first &&
+          _fetches.back().offset + _fetches.back().count == offsets[k]) {
+        _fetches.back().count += lengths[k];
+      }
+      else {
+        _fetches.push_back({groups[g].first, offsets[k], lengths[k], dest});
+      }
+    }
+  }
+  _b_vals.resize(_b_cols.size());
+
+  /* the other ranks may still be asking us */
+  upcxx::barrier();
+
+  /* the columns of each row of C, for a slice of the rows on each thread */
+  I local_rows = _a_row_ptr.size() - 1;
+  int nthreads = get_num_threads();
+  std::vector< std::vector<I> > thread_cols(nthreads);
+  std::vector<I> row_len(local_rows);
+
+  _on_rows([&] (I start, I end, int t) {
+    /* the most columns a row can have */
+    size_t most = 0;
+    for (I i = start; i < end; ++i) {
+      size_t n = 0;
+      for (I j = _a_row_ptr[i]; j < _a_row_ptr[i+1]; ++j) {
+        n += _b_row_ptr[_a_slots[j]+1] - _b_row_ptr[_a_slots[j]];
+      }
+      most = std::max(most, std::min(n, size_t(_N)));
+    }
+
+    _ColumnHash<I> hash;
+    hash.reserve(most);
+    auto& cols = thread_cols[t];
+    for (I i = start; i < end; ++i) {
+      size_t row_start = cols.size();
+      for (I j = _a_row_ptr[i]; j < _a_row_ptr[i+1]; ++j) {
+        I slot = _a_slots[j];
+        for (I k = _b_row_ptr[slot]; k < _b_row_ptr[slot+1]; ++k) {
+          if (hash.insert(_b_cols[k], 0)) {
+            cols.push_back(_b_cols[k]);
+          }
+        }
+      }
+      hash.clear();
+      std::sort(cols.begin() + row_start, cols.end());
+      row_len[i] = cols.size() - row_start;
+    }
+  });
+
+  _c_row_ptr.assign(local_rows + 1, 0);
+  for (I i = 0; i < local_rows; ++i) {
+    _c_row_ptr[i+1] = _c_row_ptr[i] + row_len[i];
+  }
+  _c_cols.clear();
+  _c_cols.reserve(_c_row_ptr[local_rows]);
+  for (const auto& cols: thread_cols) {
+    _c_cols.insert(_c_cols.end(), cols.begin(), cols.end());
+  }
+
+  /* somewhere to share our values of B, and everyone's pointers to theirs */
+  if (_shared_vals) {
+    upcxx::delete_array(_shared_vals);
+  }
+  _shared_vals = upcxx::new_array<D>(std::max(b_local_nnz, I(1)));
+  _shared_ptrs.resize(upcxx::rank_n());
+  for (int r = 0; r < upcxx::rank_n(); ++r) {
+    _shared_ptrs[r] = upcxx::broadcast(_shared_vals, r).wait();
+  }
+
+  _set_up = true;
+}
+
+template <typename I, typename D>
+void SpGEMM<I, D>::multiply(const CSRMat<I,D>& A, const CSRMat<I,D>& B, CSRMat<I,D>& C)
+{
+  if (!_set_up) {
+    throw std::logic_error("Must call setup() before multiply()");
+  }
+
+  std::vector<I> a_row_ptr, a_cols, b_row_ptr, b_cols;
+  std::vector<D> a_vals, b_vals;
+  A.get_local_csr(a_row_ptr, a_cols, a_vals);
+  B.get_local_csr(b_row_ptr, b_cols, b_vals);
+
+  /*
+   * check that the patterns of our rows are the ones setup() saw, agreed on
+   * so that everyone throws together. our rows of B come first in _b_row_ptr
+   * and _b_cols
+   */
+  bool changed = (a_row_ptr != _a_row_ptr) || (a_cols != _a_cols) ||
+                 (I(b_row_ptr.size()) != _b_local_rows + 1) ||
+                 !std::equal(b_row_ptr.begin(), b_row_ptr.end(), _b_row_ptr.begin()) ||
+                 !std::equal(b_cols.begin(), b_cols.end(), _b_cols.begin());
+  if (upcxx::allreduce(int(changed), [] (int a, int b) { return std::max(a, b); }).wait()) {
+    throw std::invalid_argument("the patterns of A and B changed since setup()");
+  }
+
+  /* share our values of B, and once everyone has, get the ones we need */
+  std::copy(b_vals.begin(), b_vals.end(), _shared_vals.local());
+  std::copy(b_vals.begin(), b_vals.end(), _b_vals.begin());
+  upcxx::barrier();
+
+  upcxx::future<> fetched = upcxx::make_future();
+  for (const auto& f: _fetches) {
+    fetched = upcxx::when_all(fetched,
+      upcxx::rget(_shared_ptrs[f.owner] + f.offset, _b_vals.data() + f.dest, f.count));
+  }
+  fetched.wait();
+
+  /* the others may be getting ours, until everyone has all theirs */
+  upcxx::barrier();
+
+  std::vector<D> c_vals(_c_cols.size(), D(0));
+  _on_rows([&] (I start, I end, int) {
+    I most = 0;
+    for (I i = start; i < end; ++i) {
+      most = std::max(most, _c_row_ptr[i+1] - _c_row_ptr[i]);
+    }
+
+    _ColumnHash<I> hash;
+    hash.reserve(most);
+    for (I i = start; i < end; ++i) {
+      const I* cols = _c_cols.data() + _c_row_ptr[i];
+      D* vals = c_vals.data() + _c_row_ptr[i];
+      I len = _c_row_ptr[i+1] - _c_row_ptr[i];
+      for (I k = 0; k < len; ++k) {
+        hash.insert(cols[k], k);
+      }
+      for (I j = _a_row_ptr[i]; j < _a_row_ptr[i+1]; ++j) {
+        D a = a_vals[j];
+        I slot = _a_slots[j];
+        for (I k = _b_row_ptr[slot]; k < _b_row_ptr[slot+1]; ++k) {
+          vals[hash.index(_b_cols[k])] += a * _b_vals[k];
+        }
+      }
+      hash.clear();
+    }
+  });
+
+  C.set_dimensions(_M, _N, Partitioner<I>::offsets(_row_partitions),
+                   Partitioner<I>::offsets(_col_partitions));
+  C.set_local_csr(_c_row_ptr.data(), _c_cols.data(), c_vals.data());
+}
+
+template <typename I, typename D>
+I SpGEMM<I, D>::get_local_nnz() const
+{
+  return _c_cols.size();
+}
+
+template <typename I, typename D>
+void SpGEMM<I, D>::set_num_threads(int nthreads)
+{
+  if (nthreads <= 0) {
+    throw std::invalid_argument("number of threads must be > 0");
+  }
+
+  if (nthreads == 1) {
+    _pool.reset();
+  }
+  else if (nthreads != get_num_threads()) {
+    _pool = std::make_shared<ThreadPool>(nthreads);
+  }
+}
+
+template <typename I, typename D>
+int SpGEMM<I, D>::get_num_threads() const
+{
+  return _pool ? _pool->get_num_threads() : 1;
+}
+
+template <typename I, typename D>
+template <typename F>
+void SpGEMM<I, D>::_on_rows(F f) const
+{
+  I local_rows = _a_row_ptr.size() - 1;
+  if (!_pool) {
+    f(0, local_rows, 0);
+    return;
+  }
+  _pool->run([&] (int t) {
+    I start, end;
+    _balanced_range(_a_row_ptr.data(), local_rows, t, _pool->get_num_threads(), start, end);
+    f(start, end, t);
+  });
+}
+
+template <typename I, typename D>
+void spgemm(const CSRMat<I,D>& A, const CSRMat<I,D>& B, CSRMat<I,D>& C)
+{
+  SpGEMM<I,D> product;
+  product.setup(A, B);
+  product.multiply(A, B, C);
+}
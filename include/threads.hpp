@@ -0,0 +1,295 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/*
+ * ThreadPool runs the compute loops of a product on several threads within
+ * a rank. Only the thread that calls run() ever talks to UPC++; the other
+ * threads just work on local arrays, so this needs no thread support from
+ * the UPC++ library.
+ */
+
+class ThreadPool
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  /* a pool of nthreads threads in total, counting the one calling run() */
+  ThreadPool(int nthreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator= (const ThreadPool&) = delete;
+
+  /* the number of threads, counting the one calling run() */
+  int get_num_threads() const;
+
+  /*
+   * call f(t) for each t in [0, nthreads), each on its own thread (t = 0 on
+   * the calling thread). returns once they have all finished
+   */
+  void run(const std::function<void(int)>& f);
+
+private:
+  void _worker(int t);
+
+  std::vector<std::thread> _threads;
+
+  std::mutex _mutex;
+  std::condition_variable _start_cv, _done_cv;
+
+  /* the current task, which run() bumps _generation to start */
+  const std::function<void(int)>* _task = nullptr;
+  long _generation = 0;
+  int _remaining = 0;
+  bool _stop = false;
+
+};
+
+/*
+ * SlotHandoff passes fetch buffers between the thread that drives
+ * communication and a thread that computes, without locks. Each slot is
+ * EMPTY (the communication thread may start a fetch into it), IN_FLIGHT,
+ * or READY (the compute thread may use it, then sets it back to EMPTY).
+ * Setting a state publishes everything the setting thread wrote to the slot
+ * before it.
+ */
+
+class SlotHandoff
+{
+
+public:
+  enum state_t {EMPTY, IN_FLIGHT, READY};
+
+  /* make nslots slots, all EMPTY */
+  void reset(size_t nslots);
+
+  size_t get_num_slots() const;
+
+  state_t get(size_t slot) const;
+  void set(size_t slot, state_t state);
+
+  /* spin until the slot is READY */
+  void wait_ready(size_t slot) const;
+
+private:
+  std::unique_ptr<std::atomic<int>[]> _states;
+  size_t _nslots = 0;
+
+};
+
+/*########################*/
+/***** implementation *****/
+
+inline ThreadPool::ThreadPool(int nthreads)
+{
+  if (nthreads < 1) {
+    throw std::invalid_argument("number of threads must be positive");
+  }
+
+  for (int t = 1; t < nthreads; ++t) {
+    _threads.emplace_back(&ThreadPool::_worker, this, t);
+  }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _start_cv.notify_all();
+
+  for (auto& th : _threads) {
+    th.join();
+  }
+}
+
+inline int ThreadPool::get_num_threads() const
+{
+  return _threads.size() + 1;
+}
+
+inline void ThreadPool::run(const std::function<void(int)>& f)
+{
+  if (_threads.empty()) {
+    f(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _task = &f;
+    _remaining = _threads.size();
+    _generation++;
+  }
+  _start_cv.notify_all();
+
+  f(0);
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done_cv.wait(lock, [this] { return _remaining == 0; });
+  _task = nullptr;
+}
+
+inline void ThreadPool::_worker(int t)
+{
+  long seen = 0;
+
+  while (true) {
+    const std::function<void(int)>* task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _start_cv.wait(lock, [&] { return _stop || _generation != seen; });
+      if (_stop) {
+        return;
+      }
+      seen = _generation;
+      task = _task;
+    }
+
+    (*task)(t);
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _remaining--;
+    }
+    _done_cv.notify_one();
+  }
+}
+
+inline void SlotHandoff::reset(size_t nslots)
+{
+  if (nslots != _nslots) {
+    _states.reset(new std::atomic<int>[nslots]);
+    _nslots = nslots;
+  }
+  for (size_t s = 0; s < nslots; ++s) {
+    _states[s].store(EMPTY, std::memory_order_relaxed);
+  }
+}
+
+inline size_t SlotHandoff::get_num_slots() const
+{
+  return _nslots;
+}
+
+inline SlotHandoff::state_t SlotHandoff::get(size_t slot) const
+{
+  return static_cast<state_t>(_states[slot].load(std::memory_order_acquire));
+}
+
+inline void SlotHandoff::set(size_t slot, state_t state)
+{
+  _states[slot].store(state, std::memory_order_release);
+}
+
+inline void SlotHandoff::wait_ready(size_t slot) const
+{
+  while (get(slot) != READY) {
+    std::this_thread::yield();
+  }
+}
+
+/*===========================*/
+/*** splitting up the work ***/
+
+/*
+ * merge-path partitioning of a CSR matrix: walking the rows and the nonzeros
+ * together is a path of nrows + nnz steps, and each thread takes an equal
+ * share of the steps. so a thread gets the same amount of work whether its
+ * rows are long or short, and a long row can be shared by several threads.
+ *
+ * find where the path crosses diagonal d: row is the number of rows finished,
+ * and nz the number of nonzeros consumed, with row + nz = d.
+ */
+template <typename I>
+inline void _merge_path_search(I d, I nrows, const I* row_ptr, I& row, I& nz)
+{
+  I nnz = row_ptr[nrows] - row_ptr[0];
+
+  I lo = d > nnz ? d - nnz : 0;
+  I hi = std::min(d, nrows);
+
+  /* the first row whose end is not reached by d */
+  while (lo < hi) {
+    I pivot = lo + (hi - lo) / 2;
+    if (row_ptr[pivot+1] - row_ptr[0] <= d - pivot - 1) {
+      lo = pivot + 1;
+    }
+    else {
+      hi = pivot;
+    }
+  }
+
+  row = lo;
+  nz = row_ptr[0] + (d - lo);
+}
+
+/*
+ * the range of items [start, end) for thread t of nthreads, splitting n items
+ * whose work is given by the prefix sums ptr[0..n] into roughly equal shares.
+ * items are not split, so this is for when no single item is too big
+ */
+template <typename I>
+inline void _balanced_range(const I* ptr, I n, int t, int nthreads, I& start, I& end)
+{
+  auto split = [&] (int k) -> I {
+    if (k == 0) return 0;
+    if (k == nthreads) return n;
+    double target = ptr[0] + double(ptr[n] - ptr[0]) * k / nthreads;
+    return std::lower_bound(ptr, ptr + n, target, [] (I a, double b) { return a < b; }) - ptr;
+  };
+  start = split(t);
+  end = split(t+1);
+}
+
+/*
+ * sort [first, last) on the threads of pool, or on this one if pool is
+ * nullptr. each thread sorts an equal slice, and then the sorted slices are
+ * merged pairwise, with the merges of each round spread over the threads
+ */
+template <typename It, typename Compare>
+inline void _parallel_sort(ThreadPool* pool, It first, It last, Compare comp)
+{
+  int nthreads = pool ? pool->get_num_threads() : 1;
+  size_t n = last - first;
+
+  if (nthreads == 1 || n < size_t(2*nthreads)) {
+    std::sort(first, last, comp);
+    return;
+  }
+
+  std::vector<size_t> bounds(nthreads + 1);
+  for (int t = 0; t <= nthreads; ++t) {
+    bounds[t] = n * t / nthreads;
+  }
+
+  pool->run([&] (int t) {
+    std::sort(first + bounds[t], first + bounds[t+1], comp);
+  });
+
+  for (int width = 1; width < nthreads; width *= 2) {
+    pool->run([&] (int t) {
+      if (t % (2*width) == 0 && t + width < nthreads) {
+        std::inplace_merge(first + bounds[t], first + bounds[t + width],
+                           first + bounds[std::min(t + 2*width, nthreads)], comp);
+      }
+    });
+  }
+}
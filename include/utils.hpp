@@ -7,6 +7,10 @@
 
 #include <upcxx/upcxx.hpp>
 #include <assert.h>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
 
 /*
 Compute the number of elements to be stored locally. Simply gives an equal number
@@ -16,8 +20,6 @@ which defines this function in PetscSplitOwnership (see
 http://www.mcs.anl.gov/petsc/petsc-current/docs/manualpages/Sys/PetscSplitOwnership.html).
 */
 
-/* TODO: turn partitioner into a class? */
-
 /* isolate this function from upc++ */
 template <typename idx_t>
 std::vector<idx_t> _partition_array(const idx_t size, unsigned int nranks) {
@@ -58,7 +60,269 @@ idx_t _idx_to_proc(const idx_t idx, const idx_t size, const unsigned int nranks)
   }
 }
 
+/* the owner of idx under the even split. OwnerLookup below works for any partition */
 template <typename idx_t>
 idx_t idx_to_proc(const idx_t idx, const idx_t size) {
   return _idx_to_proc(idx, size, upcxx::rank_n());
 }
+
+/*
+ * the sum of local over the ranks before ours, with the sum over all of
+ * them in total. collective
+ */
+inline long long _exclusive_sum(long long local, long long& total)
+{
+  /* everyone's value in its own slot, gathered by a single reduction */
+  std::vector<long long> mine(upcxx::rank_n(), 0), all(upcxx::rank_n());
+  mine[upcxx::rank_me()] = local;
+  upcxx::reduce_all(mine.data(), all.data(), all.size(), upcxx::op_fast_add).wait();
+
+  long long base = 0;
+  total = 0;
+  for (int r = 0; r < upcxx::rank_n(); ++r) {
+    if (r < upcxx::rank_me()) {
+      base += all[r];
+    }
+    total += all[r];
+  }
+  return base;
+}
+
+/*
+ * send batches[r] to rank r, for every r, and return everything the ranks
+ * sent us, in no particular order. T must be trivially copyable. collective
+ */
+template <typename T>
+std::vector<T> _exchange(std::vector< std::vector<T> > batches)
+{
+  /* our own batch goes straight in */
+  upcxx::dist_object< std::vector<T> > inbox(std::move(batches[upcxx::rank_me()]));
+
+  upcxx::future<> fut = upcxx::make_future();
+  for (int proc = 0; proc < upcxx::rank_n(); ++proc) {
+    if (proc == upcxx::rank_me() || batches[proc].empty()) {
+      continue;
+    }
+    fut = upcxx::when_all(fut,
+      upcxx::rpc(proc,
+                 [] (upcxx::dist_object< std::vector<T> >& box, upcxx::view<T> items) {
+                   box->insert(box->end(), items.begin(), items.end());
+                 }, inbox, upcxx::make_view(batches[proc].begin(), batches[proc].end()))
+    );
+  }
+  fut.wait();
+
+  /* until everyone's batches have landed, the inbox is not complete */
+  upcxx::barrier();
+
+  std::vector<T> received;
+  received.swap(*inbox);
+  return received;
+}
+
+/*
+ * Split [0, n) by weight: row r goes to the rank its weight's midpoint falls
+ * in, when the prefix sum of the weights is cut into nranks equal pieces.
+ * local_weights holds the weights of rows [start, start + local_n), whose
+ * rows before them weigh base in total, out of total. fills in, for each
+ * rank k, the first local row that goes to rank k or later (or end, if none).
+ */
+template <typename idx_t>
+std::vector<idx_t> _weighted_split(const idx_t* local_weights, idx_t start, idx_t local_n,
+                                   long long base, long long total, unsigned int nranks)
+{
+  std::vector<idx_t> firsts(nranks + 1, start + local_n);
+  unsigned int k = 0;
+  long long before = base;
+  for (idx_t i = 0; i < local_n; ++i) {
+    /* 2*nranks*midpoint/total, without the halves */
+    unsigned int rank = (unsigned int)(((2*before + local_weights[i]) * (long long)nranks) / (2*total));
+    rank = std::min(rank, nranks - 1);
+    while (k <= rank) {
+      firsts[k++] = start + i;
+    }
+    before += local_weights[i];
+  }
+  return firsts;
+}
+
+/*
+ * A Partitioner decides which contiguous range of indices each rank owns, as
+ * offsets: rank r owns [offsets[r], offsets[r+1]). Vec, MultiVec and
+ * Mat::set_dimensions take one; the default splits evenly, like
+ * partition_array. The others are
+ *  - offsets(o): the ranges given by o, which has rank_n()+1 entries from 0
+ *    up to the size
+ *  - balanced(size, weights): about equal weights per rank, such as the
+ *    nonzeros of a matrix's rows, so that no rank gets most of the work
+ */
+template <typename I>
+class Partitioner
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  /* an even split */
+  Partitioner() {};
+
+  /* the given offsets */
+  static Partitioner offsets(std::vector<I> offsets);
+
+  /*
+   * split [0, size) so that the ranks' rows weigh about the same. each rank
+   * passes the weights of its rows under the even split of size (so that
+   * they can come straight from a file or a generator). collective
+   */
+  static Partitioner balanced(I size, const I* local_weights);
+
+  /*=================*/
+  /*** the ranges ***/
+
+  /* the offsets for size indices, on rank_n() ranks */
+  std::vector<I> partition(I size) const;
+
+private:
+  /* empty for an even split */
+  std::vector<I> _offsets;
+};
+
+/*
+ * finds the rank owning an index under any partition. the indices are cut
+ * into about as many equal buckets as ranks, each remembering its first
+ * owner, so that the search only runs over the ranks inside one bucket: one
+ * step for an even split, and few for most others
+ */
+template <typename I>
+class OwnerLookup
+{
+
+public:
+  /*==================================*/
+  /*** constructors and destructors ***/
+
+  OwnerLookup() {};
+  explicit OwnerLookup(const std::vector<I>& offsets);
+
+  /*===============*/
+  /*** lookups ***/
+
+  /* the owner of idx, which must be in [0, size) */
+  int operator()(I idx) const;
+
+private:
+  std::vector<I> _offsets;
+  I _width = 1;
+  std::vector<int> _first;
+};
+
+/*########################*/
+/***** implementation *****/
+
+/*==================*/
+/*** Partitioner ***/
+
+template <typename I>
+Partitioner<I> Partitioner<I>::offsets(std::vector<I> offsets)
+{
+  if (offsets.size() != size_t(upcxx::rank_n()) + 1 || offsets.front() != 0) {
+    throw std::invalid_argument("offsets must have one more entry than there are ranks, starting at 0");
+  }
+  for (size_t r = 0; r + 1 < offsets.size(); ++r) {
+    if (offsets[r+1] < offsets[r]) {
+      throw std::invalid_argument("offsets must not decrease");
+    }
+  }
+
+  Partitioner p;
+  p._offsets = std::move(offsets);
+  return p;
+}
+
+template <typename I>
+Partitioner<I> Partitioner<I>::balanced(I size, const I* local_weights)
+{
+  int nranks = upcxx::rank_n();
+  auto even = partition_array(size);
+  I start = even[upcxx::rank_me()], end = even[upcxx::rank_me() + 1];
+
+  long long local_total = 0;
+  for (I i = 0; i < end - start; ++i) {
+    local_total += local_weights[i];
+  }
+
+  /* where our rows start in the prefix sum, and the whole sum */
+  long long total;
+  long long base = _exclusive_sum(local_total, total);
+
+  /* nothing to balance */
+  if (total == 0) {
+    return Partitioner();
+  }
+
+  /* each boundary is the first row past it on any rank, all in one reduction */
+  auto firsts = _weighted_split(local_weights, start, end - start, base, total, nranks);
+  for (int k = 1; k < nranks; ++k) {
+    if (firsts[k] == end) firsts[k] = size;
+  }
+  std::vector<I> bounds(nranks + 1);
+  bounds[0] = 0;
+  bounds[nranks] = size;
+  upcxx::reduce_all(firsts.data() + 1, bounds.data() + 1, nranks - 1, upcxx::op_fast_min).wait();
+
+  return offsets(std::move(bounds));
+}
+
+template <typename I>
+std::vector<I> Partitioner<I>::partition(I size) const
+{
+  if (_offsets.empty()) {
+    return partition_array(size);
+  }
+
+  if (_offsets.back() != size || _offsets.size() != size_t(upcxx::rank_n()) + 1) {
+    std::ostringstream out;
+    out << "partition of size " << _offsets.back() << " on " << _offsets.size() - 1;
+    out << " ranks does not fit size " << size << " on " << upcxx::rank_n();
+    throw std::invalid_argument(out.str());
+  }
+  return _offsets;
+}
+
+/*==================*/
+/*** OwnerLookup ***/
+
+template <typename I>
+OwnerLookup<I>::OwnerLookup(const std::vector<I>& offsets)
+: _offsets(offsets)
+{
+  int nranks = offsets.size() - 1;
+  I size = offsets.back();
+
+  I nbuckets = std::max(I(1), std::min(size, I(2*nranks)));
+  _width = (size + nbuckets - 1) / nbuckets;
+  if (_width == 0) {
+    _width = 1;
+  }
+
+  /* the owner of each bucket's first index, and of the last index */
+  _first.resize(nbuckets + 1);
+  for (I b = 0; b <= nbuckets; ++b) {
+    I idx = std::min(b * _width, size > 0 ? size - 1 : I(0));
+    _first[b] = std::upper_bound(_offsets.begin(), _offsets.end() - 1, idx) - _offsets.begin() - 1;
+    _first[b] = std::max(_first[b], 0);
+  }
+}
+
+template <typename I>
+int OwnerLookup<I>::operator()(I idx) const
+{
+  I b = idx / _width;
+  int lo = _first[b], hi = _first[b+1];
+  if (lo == hi) {
+    return lo;
+  }
+  return std::upper_bound(_offsets.begin() + lo + 1, _offsets.begin() + hi + 1, idx)
+         - _offsets.begin() - 1;
+}
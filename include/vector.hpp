@@ -20,6 +20,9 @@ public:
   /*** constructors and destructors ***/
   Vec() : _put_fut(upcxx::make_future<>()) {};
   Vec(I size);
+
+  /* with the ranks' portions chosen by partitioner */
+  Vec(I size, const Partitioner<I>& partitioner);
   ~Vec();
 
   /* rule of three/five: since we have an explicit destructor we also
@@ -33,7 +36,7 @@ public:
    * allocate memory for the Vec. this only needs to be called if the vector
    * was initialized using the default constructor
    */
-  void allocate_elements(I size);
+  void allocate_elements(I size, const Partitioner<I>& partitioner = Partitioner<I>());
 
   /* return true if Vec's memory has already been allocated */
   bool allocated() const;
@@ -52,7 +55,10 @@ public:
   I get_local_end() const;
   void get_local_range(I &start, I &end) const;
 
-  /* throw an exception if the vector sizes of this and v do not match */
+  /* the start of each rank's portion, and then the size */
+  const std::vector<I>& get_partitions() const;
+
+  /* throw an exception if the vector sizes or partitions of this and v do not match */
   void validate_dims(const Vec& v) const;
 
   /*================================*/
@@ -76,9 +82,21 @@ public:
   /* get a pointer to the local array holding local values (read-only) */
   const D* get_local_array_read() const;
 
+  /* get the global pointer to the start of the portion of the vector stored on rank */
+  upcxx::global_ptr<D> get_global_ptr(int rank) const;
+
   /* copy all values from this vector to another vector v */
   void copy(Vec& v) const;
 
+  /*
+   * copy the values into y under a renumbering, y[perm[i]] = x[i], where
+   * each rank's perm holds the new index of each of its local indices, in
+   * order (as Mat::get_permutation() does). unpermute() undoes it,
+   * y[i] = x[perm[i]]. collective
+   */
+  void permute(const std::vector<I>& perm, Vec& y) const;
+  void unpermute(const std::vector<I>& perm, Vec& y) const;
+
   /*
    * get a range of local or remote values by index, and write them into buf.
    * buf must be already allocated with room for end-start values!
@@ -89,6 +107,9 @@ public:
   void read_range_begin(I start, I end, D* buf);
   void read_range_complete();
 
+  /* asynchronous, with any number in flight. the future is ready once buf is filled */
+  upcxx::future<> read_range_async(I start, I end, D* buf) const;
+
   /*======================*/
   /*** vector functions ***/
 
@@ -104,6 +125,7 @@ private:
   I _allocated = false;
 
   std::vector<I> _partitions;
+  OwnerLookup<I> _owner;
   std::vector<upcxx::global_ptr<D>> _gptrs;
   upcxx::global_ptr<D> _local_gptr;
   D* _local_data;
@@ -126,13 +148,20 @@ Vec<I, D>::Vec(I size)
   allocate_elements(size);
 }
 
+template <typename I, typename D>
+Vec<I, D>::Vec(I size, const Partitioner<I>& partitioner)
+: _put_fut(upcxx::make_future())
+{
+  allocate_elements(size, partitioner);
+}
+
 /* copy constructor */
 template <typename I, typename D>
 Vec<I, D>::Vec(const Vec& v)
 : _put_fut(v.get_put_future())
 {
   if (v.allocated()) {
-    allocate_elements(v.get_size());
+    allocate_elements(v.get_size(), Partitioner<I>::offsets(v._partitions));
     v.copy(*this);
   }
 }
@@ -144,6 +173,7 @@ Vec<I, D>::Vec(Vec&& v) noexcept
 , _local_size(v._local_size)
 , _allocated(v._allocated)
 , _partitions( std::move(v._partitions) )
+, _owner( std::move(v._owner) )
 , _gptrs( std::move(v._gptrs) )
 , _local_gptr(v._local_gptr)
 , _local_data(v._local_data)
@@ -176,6 +206,7 @@ Vec<I, D>& Vec<I, D>::operator= (Vec&& v) noexcept
     _size = v._size;
     _local_size = v._local_size;
     _partitions = std::move(v._partitions);
+    _owner = std::move(v._owner);
     _gptrs = std::move(v._gptrs);
 
     _local_gptr = v._local_gptr;
@@ -206,7 +237,7 @@ Vec<I, D>::~Vec() {
 }
 
 template <typename I, typename D>
-void Vec<I, D>::allocate_elements(I size) {
+void Vec<I, D>::allocate_elements(I size, const Partitioner<I>& partitioner) {
 
   /* can only set the size once */
   if (allocated()) {
@@ -218,7 +249,8 @@ void Vec<I, D>::allocate_elements(I size) {
   }
 
   _size = size;
-  _partitions = partition_array<I>(get_size());
+  _partitions = partitioner.partition(get_size());
+  _owner = OwnerLookup<I>(_partitions);
   _local_size = _partitions[upcxx::rank_me()+1] - _partitions[upcxx::rank_me()];
 
   /* allocate shared global memory and broadcast the pointers */
@@ -272,6 +304,11 @@ void Vec<I, D>::get_local_range(I &start, I &end) const {
   end = get_local_end();
 }
 
+template <typename I, typename D>
+const std::vector<I>& Vec<I, D>::get_partitions() const {
+  return _partitions;
+}
+
 template <typename I, typename D>
 void Vec<I, D>::validate_dims(const Vec& v) const {
   if (get_size() != v.get_size()) {
@@ -280,6 +317,9 @@ void Vec<I, D>::validate_dims(const Vec& v) const {
     out << " do not match.";
     throw std::invalid_argument(out.str());
   }
+  if (_partitions != v._partitions) {
+    throw std::invalid_argument("vectors are partitioned differently");
+  }
 }
 
 /*================================*/
@@ -306,7 +346,7 @@ RData<I, D> Vec<I, D>::operator[](I index) {
   }
 #endif
 
-  auto source_proc = idx_to_proc(index, get_size());
+  auto source_proc = _owner(index);
 
   return RData<I, D>(_gptrs[source_proc] + (index-_partitions[source_proc]), _put_fut);
 }
@@ -336,6 +376,11 @@ const D* Vec<I, D>::get_local_array_read() const {
   return _local_data;
 }
 
+template <typename I, typename D>
+upcxx::global_ptr<D> Vec<I, D>::get_global_ptr(int rank) const {
+  return _gptrs[rank];
+}
+
 template <typename I, typename D>
 void Vec<I, D>::copy(Vec& v) const {
 
@@ -353,6 +398,108 @@ void Vec<I, D>::copy(Vec& v) const {
 
 }
 
+template <typename I, typename D>
+void Vec<I, D>::permute(const std::vector<I>& perm, Vec& y) const
+{
+  validate_dims(y);
+  /* on every rank, so that none is left waiting for the others */
+  int wrong = perm.size() != size_t(_local_size);
+  if (upcxx::reduce_all(wrong, upcxx::op_fast_max).wait()) {
+    throw std::invalid_argument("permutation does not match the local size of the vector");
+  }
+
+  /* the values may still be in use by other ranks' products */
+  upcxx::barrier();
+
+  I start, end;
+  get_local_range(start, end);
+  auto mine = get_local_array_read();
+
+  /* one batch of (offset, value) pairs per owner of the new indices */
+  std::vector< std::vector< std::pair<I,D> > > batches(upcxx::rank_n());
+  for (I i = start; i < end; ++i) {
+    I p = perm[i - start];
+    I proc = y._owner(p);
+    batches[proc].push_back(std::make_pair(p - y._partitions[proc], mine[i - start]));
+  }
+
+  upcxx::future<> fut = upcxx::make_future();
+  for (int proc = 0; proc < upcxx::rank_n(); ++proc) {
+    if (batches[proc].empty()) {
+      continue;
+    }
+    fut = upcxx::when_all(fut,
+      upcxx::rpc(proc,
+                 [] (upcxx::global_ptr<D> base, upcxx::view< std::pair<I,D> > values) {
+                   D* data = base.local();
+                   for (const auto& v: values) {
+                     data[v.first] = v.second;
+                   }
+                 }, y._gptrs[proc], upcxx::make_view(batches[proc].begin(), batches[proc].end()))
+    );
+  }
+  fut.wait();
+
+  /* until everyone's batches have landed, y is not complete */
+  upcxx::barrier();
+}
+
+template <typename I, typename D>
+void Vec<I, D>::unpermute(const std::vector<I>& perm, Vec& y) const
+{
+  validate_dims(y);
+  /* on every rank, so that none is left waiting for the others */
+  int wrong = perm.size() != size_t(_local_size);
+  if (upcxx::reduce_all(wrong, upcxx::op_fast_max).wait()) {
+    throw std::invalid_argument("permutation does not match the local size of the vector");
+  }
+
+  /* the values may still be in use, or on their way, on other ranks */
+  upcxx::barrier();
+
+  I start, end;
+  y.get_local_range(start, end);
+  auto other = y.get_local_array();
+
+  /* one request per owner of the values we need, which sends back the values */
+  std::vector< std::vector<I> > offsets(upcxx::rank_n()), slots(upcxx::rank_n());
+  for (I i = start; i < end; ++i) {
+    I p = perm[i - start];
+    I proc = _owner(p);
+    offsets[proc].push_back(p - _partitions[proc]);
+    slots[proc].push_back(i - start);
+  }
+
+  std::vector< std::pair< int, upcxx::future< std::vector<D> > > > requests;
+  for (int proc = 0; proc < upcxx::rank_n(); ++proc) {
+    if (offsets[proc].empty()) {
+      continue;
+    }
+    requests.push_back(std::make_pair(proc,
+      upcxx::rpc(proc,
+                 [] (upcxx::global_ptr<D> base, upcxx::view<I> offsets) {
+                   const D* data = base.local();
+                   std::vector<D> values;
+                   values.reserve(offsets.size());
+                   for (I offset: offsets) {
+                     values.push_back(data[offset]);
+                   }
+                   return values;
+                 }, _gptrs[proc], upcxx::make_view(offsets[proc].begin(), offsets[proc].end()))
+    ));
+  }
+
+  for (auto& r: requests) {
+    std::vector<D> values = r.second.wait();
+    for (size_t k = 0; k < values.size(); ++k) {
+      other[slots[r.first][k]] = values[k];
+    }
+  }
+
+  /* the other ranks may still be reading from us */
+  upcxx::barrier();
+}
+
 /*
  * get a range of local or remote values by index, and write them into buf.
  * buf must be already allocated with room for end-start values!
@@ -367,6 +514,13 @@ void Vec<I, D>::read_range(I start, I end, D* buf)
 /* asynchronous */
 template <typename I, typename D>
 void Vec<I, D>::read_range_begin(I start, I end, D* buf)
+{
+  _range_get_fut = read_range_async(start, end, buf);
+  getting = true;
+}
+
+template <typename I, typename D>
+upcxx::future<> Vec<I, D>::read_range_async(I start, I end, D* buf) const
 {
   I vend;
   vend = get_size();
@@ -388,17 +542,21 @@ void Vec<I, D>::read_range_begin(I start, I end, D* buf)
     throw std::out_of_range(out.str());
   }
 
+  if (start == end) {
+    return upcxx::make_future();
+  }
+
   /* find starting process to get from */
-  I proc = idx_to_proc(start, vend);
+  I proc = _owner(start);
   I tmp_start = start;
 
   /* set up a future to conjoin to */
-  _range_get_fut = upcxx::make_future();
+  upcxx::future<> fut = upcxx::make_future();
   auto gptr = _gptrs[proc] + (start - _partitions[proc]);
 
   while (tmp_start < end) {
 
-    _range_get_fut = upcxx::when_all(_range_get_fut,
+    fut = upcxx::when_all(fut,
       upcxx::rget(gptr, buf + (tmp_start-start),
                   std::min(_partitions[proc+1], end) - tmp_start)
     );
@@ -408,7 +566,7 @@ void Vec<I, D>::read_range_begin(I start, I end, D* buf)
     gptr = _gptrs[proc];
   }
 
-  getting = true;
+  return fut;
 }
 
 template <typename I, typename D>
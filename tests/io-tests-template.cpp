@@ -0,0 +1,174 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+/*
+ * This file gives a generic set of tests that is
+ * oblivious to the data types. The data types are #define'd
+ * and then this file is included in io-tests.cpp to generate
+ * the actual test cases.
+ */
+
+/* macros to turn the data types into strings for the test case name */
+#define _STR(x) #x
+#define TO_STR(x) _STR(x)
+#define TYPE_STR " \tmat_t=" TO_STR(MAT_T) " \tidx_t=" TO_STR(IDX_T) " \tdata_t=" TO_STR(DATA_T)
+
+TEST_CASE( "read matrix market" TYPE_STR, "" ) {
+
+  /* one file for each symmetry, checked against its own full matrix */
+  for (std::string symmetry : {"general", "symmetric", "skew-symmetric", "pattern"}) {
+
+    IDX_T M = 53, N = (symmetry == "general") ? 41 : 53;
+    bool pattern = (symmetry == "pattern");
+    std::vector<DATA_T> full(M*N, DATA_T(0));
+
+    std::string text = "%%MatrixMarket matrix coordinate ";
+    text += pattern ? "pattern symmetric" : "real " + symmetry;
+    text += "\n% a comment\n%\n\n  " + std::to_string(M) + " " + std::to_string(N) + " ";
+
+    std::string body;
+    IDX_T nnz = 0;
+    for (IDX_T i = 0; i < M; ++i) {
+      for (IDX_T j = 0; j < N; ++j) {
+        if ((i*7 + j*3) % 5 != 0) continue;
+        if (symmetry != "general" && j > i) continue;
+        if (symmetry == "skew-symmetric" && j == i) continue;
+
+        double v = pattern ? 1 : (double(i) - double(j)/4) * ((i + j) % 2 ? 1e-2 : 3e1);
+        char line[80];
+        if (pattern) {
+          snprintf(line, sizeof(line), "%d %d\n", int(i+1), int(j+1));
+        }
+        else {
+          snprintf(line, sizeof(line), (i % 3) ? "%d\t%d %.17g\n" : "%d %d  %.6e\r\n", int(i+1), int(j+1), v);
+        }
+        body += line;
+        if (i % 11 == 0) body += "% a comment between entries\n";
+        ++nnz;
+
+        /* what the file holds, after rounding to its digits */
+        double stored = pattern ? 1 : std::strtod(strrchr(line, ' '), nullptr);
+        full[i*N + j] += stored;
+        if (symmetry != "general" && i != j) {
+          full[j*N + i] += (symmetry == "skew-symmetric") ? -stored : stored;
+        }
+      }
+    }
+    text += std::to_string(nnz) + "\n" + body;
+
+    std::string name = "io-test-" + symmetry + ".mtx";
+    write_test_file(name, text);
+
+    MAT_T<IDX_T, DATA_T> m;
+    read_matrix_market(name, m);
+    remove_test_file(name);
+    m.setup();
+
+    IDX_T MM, NN;
+    m.get_dimensions(MM, NN);
+    REQUIRE(MM == M);
+    REQUIRE(NN == N);
+
+    Vec<IDX_T, DATA_T> x(N), y(M);
+    IDX_T xstart, xend;
+    x.get_local_range(xstart, xend);
+    auto xarr = x.get_local_array();
+    for (IDX_T i = xstart; i < xend; ++i) {
+      xarr[i - xstart] = DATA_T(i % 7) - DATA_T(3);
+    }
+    upcxx::barrier();
+
+    m.dot(x, y);
+
+    IDX_T start, end;
+    m.get_local_rows(start, end);
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = 0;
+      for (IDX_T j = 0; j < N; ++j) {
+        correct += full[i*N + j] * (DATA_T(j % 7) - DATA_T(3));
+      }
+      CHECK(std::abs(yarr[i - start] - correct) <= 1e-9 * (1 + std::abs(correct)));
+    }
+  }
+}
+
+TEST_CASE( "binary matrices" TYPE_STR, "" ) {
+
+  IDX_T M = 47, N = 39;
+  std::vector<DATA_T> full(M*N, DATA_T(0));
+
+  /* saved from a matrix assembled from everywhere */
+  NaiveCSRMat<IDX_T, DATA_T> a(M, N);
+  for (IDX_T i = upcxx::rank_me(); i < M; i += upcxx::rank_n()) {
+    for (IDX_T j = 0; j < N; ++j) {
+      if ((i*5 + j*3) % 7 != 0) continue;
+      a.set_value(i, j, DATA_T(double(i) - double(j)/8));
+    }
+  }
+  for (IDX_T i = 0; i < M; ++i) {
+    for (IDX_T j = 0; j < N; ++j) {
+      if ((i*5 + j*3) % 7 == 0) full[i*N + j] = DATA_T(double(i) - double(j)/8);
+    }
+  }
+  a.setup();
+  save_binary("io-test-mat.bin", a);
+
+  /* loaded with the saved partitions */
+  {
+    MAT_T<IDX_T, DATA_T> b;
+    load_binary("io-test-mat.bin", b);
+    b.setup();
+    REQUIRE(b.get_row_partitions() == a.get_row_partitions());
+    check_dense_dot(b, M, N, full);
+  }
+
+  /* and with uneven ones */
+  {
+    int nranks = upcxx::rank_n();
+    std::vector<IDX_T> row_offsets(nranks + 1), col_offsets(nranks + 1);
+    for (int r = 0; r <= nranks; ++r) {
+      row_offsets[r] = size_t(M) * r * r / (nranks * nranks);
+      col_offsets[r] = size_t(N) * r / nranks;
+    }
+    MAT_T<IDX_T, DATA_T> b;
+    load_binary("io-test-mat.bin", b, Partitioner<IDX_T>::offsets(row_offsets),
+                Partitioner<IDX_T>::offsets(col_offsets));
+    b.setup();
+    REQUIRE(b.get_row_partitions() == row_offsets);
+    check_dense_dot(b, M, N, full);
+  }
+
+  remove_test_file("io-test-mat.bin");
+}
+
+TEST_CASE( "petsc binary matrices" TYPE_STR, "" ) {
+
+  int M = 41, N = 41;
+  std::vector<DATA_T> full(M*N, DATA_T(0));
+  std::vector< std::vector< std::pair<int, double> > > rows(M);
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < N; ++j) {
+      if ((i*3 + j*2) % 5 != 0) continue;
+      rows[i].push_back(std::make_pair(j, 0.5 * i - j));
+      full[i*N + j] += DATA_T(0.5 * i - j);
+    }
+  }
+
+  /* PETSc sorts its rows, but one that isn't, with a repeat, still works */
+  std::reverse(rows[17].begin(), rows[17].end());
+  rows[17].push_back(std::make_pair(7, 1.0));
+  full[17*N + 7] += DATA_T(1);
+
+  write_petsc_file("io-test-mat.petsc", M, N, rows);
+
+  MAT_T<IDX_T, DATA_T> m;
+  read_petsc_binary("io-test-mat.petsc", m);
+  remove_test_file("io-test-mat.petsc");
+  m.setup();
+  check_dense_dot(m, static_cast<IDX_T>(M), static_cast<IDX_T>(N), full);
+}
+
+#undef TYPE_STR
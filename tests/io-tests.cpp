@@ -0,0 +1,342 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#include "slaps.hpp"
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <complex>
+#include <iterator>
+
+/* the block matrices, with the block dimensions fixed so the tests can use them */
+template <typename I, typename D>
+using BCSRMat_2x2 = BCSRMat<I, D, 2, 2>;
+
+/* rank 0 writes the file, and everyone can read it once this returns */
+void write_test_file(const std::string& name, const std::string& text)
+{
+  if (upcxx::rank_me() == 0) {
+    std::ofstream out(name);
+    out << text;
+  }
+  upcxx::barrier();
+}
+
+/* and removes it once everyone is done */
+void remove_test_file(const std::string& name)
+{
+  upcxx::barrier();
+  if (upcxx::rank_me() == 0) {
+    std::remove(name.c_str());
+  }
+}
+
+/* rank 0 cuts the last bytes off the file, and everyone sees it once this returns */
+void truncate_test_file(const std::string& name, size_t bytes)
+{
+  upcxx::barrier();
+  if (upcxx::rank_me() == 0) {
+    std::string text;
+    {
+      std::ifstream in(name, std::ios::binary);
+      text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    out.write(text.data(), text.size() - std::min(bytes, text.size()));
+  }
+  upcxx::barrier();
+}
+
+/* rank 0 overwrites the big-endian 32-bit integer at offset, and everyone sees it once this returns */
+void patch_test_file(const std::string& name, size_t offset, int32_t value)
+{
+  upcxx::barrier();
+  if (upcxx::rank_me() == 0) {
+    char bytes[4];
+    for (int k = 0; k < 4; ++k) {
+      bytes[k] = char((uint32_t(value) >> (24 - 8*k)) & 0xff);
+    }
+    std::fstream f(name, std::ios::binary | std::ios::in | std::ios::out);
+    f.seekp(offset);
+    f.write(bytes, 4);
+  }
+  upcxx::barrier();
+}
+
+/*
+ * rank 0 writes a matrix in PETSc's binary format: big-endian 32-bit
+ * integers and doubles, with each row's entries in the order given
+ */
+void write_petsc_file(const std::string& name, int M, int N,
+                      const std::vector< std::vector< std::pair<int, double> > >& rows)
+{
+  if (upcxx::rank_me() == 0) {
+    std::string bytes;
+    auto put = [&bytes] (const void* p, int n) {
+      for (int k = n - 1; k >= 0; --k) {
+        bytes += _big_endian_host() ? static_cast<const char*>(p)[n - 1 - k]
+                                    : static_cast<const char*>(p)[k];
+      }
+    };
+    auto put_int = [&put] (int32_t v) { put(&v, 4); };
+
+    int32_t nz = 0;
+    for (const auto& row: rows) nz += row.size();
+    put_int(1211216);
+    put_int(M);
+    put_int(N);
+    put_int(nz);
+    for (const auto& row: rows) put_int(row.size());
+    for (const auto& row: rows) for (const auto& e: row) put_int(e.first);
+    for (const auto& row: rows) for (const auto& e: row) put(&e.second, 8);
+
+    std::ofstream out(name, std::ios::binary);
+    out << bytes;
+  }
+  upcxx::barrier();
+}
+
+/* check y = m*x against the dense matrix full, with x[j] = j%7 - 3 */
+template <typename MatT, typename I, typename D>
+void check_dense_dot(MatT& m, I M, I N, const std::vector<D>& full)
+{
+  Vec<I,D> x(N, Partitioner<I>::offsets(m.get_col_partitions()));
+  Vec<I,D> y(M, Partitioner<I>::offsets(m.get_row_partitions()));
+
+  I xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+  for (I i = xstart; i < xend; ++i) {
+    xarr[i - xstart] = D(i % 7) - D(3);
+  }
+  upcxx::barrier();
+
+  m.dot(x, y);
+
+  I start, end;
+  m.get_local_rows(start, end);
+  auto yarr = y.get_local_array();
+  for (I i = start; i < end; ++i) {
+    D correct = 0;
+    for (I j = 0; j < N; ++j) {
+      correct += full[i*N + j] * (D(j % 7) - D(3));
+    }
+    CHECK(std::abs(yarr[i - start] - correct) <= 1e-12 * (1 + std::abs(correct)));
+  }
+}
+
+TEST_CASE( "real number parser", "" ) {
+
+  const char* cases[] = {
+    "0", "1", "-1", "+2.5", "3.", ".25", "-0.0", "1e3", "1E-3", "-2.5e+10",
+    "0.1", "0.3", "123456789.123456789", "1.7976931348623157e308", "4.9e-324",
+    "2.2250738585072014e-308", "12345678901234567890123", "0.000000000000000000001234",
+    "9007199254740993", "1e22", "1e23", "-7.0000000000000000001"
+  };
+
+  for (const char* c : cases) {
+    std::string text = std::string("  ") + c + " tail";
+    double v;
+    const char* end = _mm_parse_real(text.data(), text.data() + text.size(), v);
+    INFO(c);
+    REQUIRE(end != nullptr);
+    REQUIRE(std::string(end) == " tail");
+    REQUIRE(v == std::strtod(c, nullptr));
+  }
+
+  /* and random ones, round trip through printf */
+  srand(5);
+  for (int k = 0; k < 10000; ++k) {
+    double x = (double(rand()) / RAND_MAX - 0.5) * std::pow(10., rand() % 40 - 20);
+    char buf[64];
+    snprintf(buf, sizeof(buf), (k % 2) ? "%.17g" : "%.6e", x);
+    double v;
+    _mm_parse_real(buf, buf + strlen(buf), v);
+    REQUIRE(v == std::strtod(buf, nullptr));
+  }
+
+  const char* bad = "  x1";
+  double v;
+  REQUIRE(_mm_parse_real(bad, bad + 4, v) == nullptr);
+}
+
+TEST_CASE( "matrix market errors", "" ) {
+
+  CSRMat<int, double> m;
+  REQUIRE_THROWS_AS( read_matrix_market("no-such-file.mtx", m), std::runtime_error );
+
+  write_test_file("io-test-array.mtx", "%%MatrixMarket matrix array real general\n2 2\n1\n2\n3\n4\n");
+  REQUIRE_THROWS_AS( read_matrix_market("io-test-array.mtx", m), std::runtime_error );
+  remove_test_file("io-test-array.mtx");
+
+  write_test_file("io-test-complex.mtx", "%%MatrixMarket matrix coordinate complex general\n1 1 1\n1 1 1 2\n");
+  REQUIRE_THROWS_AS( read_matrix_market("io-test-complex.mtx", m), std::runtime_error );
+  remove_test_file("io-test-complex.mtx");
+
+  /* a bad line in someone's range makes everyone throw */
+  std::string text = "%%MatrixMarket matrix coordinate real general\n20 20 40\n";
+  for (int i = 1; i <= 40; ++i) {
+    if (i == 23) text += "21 1 1.0\n";
+    else text += std::to_string((i % 20) + 1) + " " + std::to_string(i / 2 + 1) + " 1.0\n";
+  }
+  write_test_file("io-test-bad.mtx", text);
+  REQUIRE_THROWS_AS( read_matrix_market("io-test-bad.mtx", m), std::runtime_error );
+  remove_test_file("io-test-bad.mtx");
+}
+
+TEST_CASE( "binary vectors", "" ) {
+
+  int nranks = upcxx::rank_n();
+  Vec<int, double> v(1000);
+  auto varr = v.get_local_array();
+  for (int i = v.get_local_start(); i < v.get_local_end(); ++i) {
+    varr[i - v.get_local_start()] = 0.1 * i - 7;
+  }
+  save_binary("io-test-vec.bin", v);
+
+  /* with the saved partition */
+  Vec<int, double> w;
+  load_binary("io-test-vec.bin", w);
+  REQUIRE(w.get_partitions() == v.get_partitions());
+  for (int i = w.get_local_start(); i < w.get_local_end(); ++i) {
+    REQUIRE(w.get_local_array()[i - w.get_local_start()] == 0.1 * i - 7);
+  }
+
+  /* with another one, and converted to another type */
+  std::vector<int> offsets(nranks + 1);
+  for (int r = 0; r <= nranks; ++r) {
+    offsets[r] = 1000 * r * r / (nranks * nranks);
+  }
+  Vec<long, std::complex<float> > u(1000, Partitioner<long>::offsets(std::vector<long>(offsets.begin(), offsets.end())));
+  load_binary("io-test-vec.bin", u);
+  for (long i = u.get_local_start(); i < u.get_local_end(); ++i) {
+    REQUIRE(u.get_local_array()[i - u.get_local_start()] == std::complex<float>(float(0.1 * i - 7)));
+  }
+
+  Vec<int, double> wrong(999);
+  REQUIRE_THROWS_AS( load_binary("io-test-vec.bin", wrong), std::invalid_argument );
+
+  /* a vector file is not a matrix file */
+  CSRMat<int, double> m;
+  REQUIRE_THROWS_AS( load_binary("io-test-vec.bin", m), std::runtime_error );
+
+  /* and a complex file does not go into a real vector */
+  Vec<int, std::complex<double> > c(10);
+  c.set_all(std::complex<double>(1, 2));
+  upcxx::barrier();
+  save_binary("io-test-complex.bin", c);
+  Vec<int, double> r;
+  REQUIRE_THROWS_AS( load_binary("io-test-complex.bin", r), std::runtime_error );
+
+  /* a truncated file makes everyone throw, not just the ranks whose part is missing */
+  truncate_test_file("io-test-vec.bin", 8);
+  Vec<int, double> t;
+  REQUIRE_THROWS_AS( load_binary("io-test-vec.bin", t), std::runtime_error );
+
+  remove_test_file("io-test-vec.bin");
+  remove_test_file("io-test-complex.bin");
+}
+
+TEST_CASE( "binary matrix errors", "" ) {
+
+  /* the formats that don't keep their CSR arrays can't be saved */
+  SELLMat<int, double> s(10, 10);
+  s.set_value(0, 0, 1);
+  s.setup();
+  REQUIRE_THROWS_AS( save_binary("io-test-sell.bin", s), std::logic_error );
+
+  MixedCSRMat<int, double> x(10, 10);
+  x.set_value(0, 0, 1);
+  x.setup();
+  REQUIRE_THROWS_AS( save_binary("io-test-mixed.bin", x), std::logic_error );
+
+  /* nor can anything before setup */
+  CSRMat<int, double> a(10, 10);
+  REQUIRE_THROWS_AS( save_binary("io-test-sell.bin", a), std::logic_error );
+
+  /* a column out of range, in someone's rows, makes everyone throw */
+  std::vector< std::vector< std::pair<int, double> > > rows(20);
+  for (int i = 0; i < 20; ++i) {
+    rows[i].push_back(std::make_pair(i, 1.0));
+  }
+  rows[13].push_back(std::make_pair(20, 1.0));
+  write_petsc_file("io-test-bad.petsc", 20, 20, rows);
+  CSRMat<int, double> b;
+  REQUIRE_THROWS_AS( read_petsc_binary("io-test-bad.petsc", b), std::runtime_error );
+  remove_test_file("io-test-bad.petsc");
+
+  /* a truncated file makes everyone throw too */
+  CSRMat<int, double> d(20, 20);
+  int dstart, dend;
+  d.get_local_rows(dstart, dend);
+  for (int i = dstart; i < dend; ++i) {
+    d.set_value(i, i, 1.0);
+  }
+  d.setup();
+  save_binary("io-test-trunc.bin", d);
+  truncate_test_file("io-test-trunc.bin", 8);
+  CSRMat<int, double> e;
+  REQUIRE_THROWS_AS( load_binary("io-test-trunc.bin", e), std::runtime_error );
+  remove_test_file("io-test-trunc.bin");
+
+  /*
+   * a negative row length makes the rank that reads it think it has a huge
+   * number of nonzeros, unless everyone checks first. the lengths still add up
+   */
+  rows[13].pop_back();
+  write_petsc_file("io-test-bad.petsc", 20, 20, rows);
+  patch_test_file("io-test-bad.petsc", 16 + 4*13, -5);
+  patch_test_file("io-test-bad.petsc", 16, 7);
+  CSRMat<int, double> f;
+  REQUIRE_THROWS_AS( read_petsc_binary("io-test-bad.petsc", f), std::runtime_error );
+
+  /* and so do negative dimensions */
+  write_petsc_file("io-test-bad.petsc", 20, 20, rows);
+  patch_test_file("io-test-bad.petsc", 4, -20);
+  CSRMat<int, double> g;
+  REQUIRE_THROWS_AS( read_petsc_binary("io-test-bad.petsc", g), std::runtime_error );
+  remove_test_file("io-test-bad.petsc");
+
+  /* and a PETSc file that isn't */
+  write_test_file("io-test-bad.petsc", "not a matrix at all");
+  REQUIRE_THROWS_AS( read_petsc_binary("io-test-bad.petsc", b), std::runtime_error );
+  remove_test_file("io-test-bad.petsc");
+}
+
+#define IDX_T int
+#define DATA_T double
+
+#define MAT_T NaiveCSRMat
+#include "io-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T GhostCSRMat
+#include "io-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T SELLMat
+#include "io-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T BCSRMat_2x2
+#include "io-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T RCMat
+#include "io-tests-template.cpp"
+#undef MAT_T
+
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T unsigned long
+#define DATA_T std::complex<double>
+
+#define MAT_T NaiveCSRMat
+#include "io-tests-template.cpp"
+#undef MAT_T
+
+#undef IDX_T
+#undef DATA_T
@@ -0,0 +1,375 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+/*
+ * This file gives a generic set of tests that is
+ * oblivious to the data types. The data types are #define'd
+ * and then this file is included in kernel-tests.cpp to generate
+ * the actual test cases.
+ */
+
+/* macros to turn the data types into strings for the test case name */
+#define _STR(x) #x
+#define TO_STR(x) _STR(x)
+#define TYPE_STR " \tidx_t=" TO_STR(IDX_T) " \tdata_t=" TO_STR(DATA_T)
+
+TEST_CASE( "csr kernel" TYPE_STR, "" ) {
+
+  /* rows of every length up to a few times the widest vector */
+  IDX_T nrows = 200;
+  IDX_T ncols = 500;
+
+  srand(42);
+
+  std::vector<IDX_T> row_ptr(1, 0);
+  std::vector<IDX_T> cols;
+  std::vector<DATA_T> vals;
+  for (IDX_T i = 0; i < nrows; ++i) {
+    IDX_T len = i % 40;
+    for (IDX_T j = 0; j < len; ++j) {
+      cols.push_back(rand() % ncols);
+      vals.push_back(random_value<DATA_T>());
+    }
+    row_ptr.push_back(cols.size());
+  }
+
+  std::vector<DATA_T> x(ncols);
+  for (IDX_T i = 0; i < ncols; ++i) {
+    x[i] = random_value<DATA_T>();
+  }
+
+  std::vector<DATA_T> y_init(nrows);
+  for (IDX_T i = 0; i < nrows; ++i) {
+    y_init[i] = random_value<DATA_T>();
+  }
+
+  std::vector<DATA_T> ref = y_init;
+  _csr_plusdot_scalar(nrows, row_ptr.data(), cols.data(), vals.data(), x.data(), ref.data());
+
+  simd_level_t orig = get_simd_level();
+
+  SECTION( "set level" ) {
+    REQUIRE(orig == get_host_simd_level());
+    if (get_host_simd_level() < SIMD_AVX512) {
+      REQUIRE_THROWS_AS(set_simd_level(SIMD_AVX512), std::invalid_argument);
+    }
+    set_simd_level(SIMD_SCALAR);
+    REQUIRE(get_simd_level() == SIMD_SCALAR);
+  }
+
+  SECTION( "each level matches scalar" ) {
+    for (int level = SIMD_SCALAR; level <= get_host_simd_level(); ++level) {
+      set_simd_level(static_cast<simd_level_t>(level));
+
+      std::vector<DATA_T> y = y_init;
+      _csr_plusdot(nrows, row_ptr.data(), cols.data(), vals.data(), x.data(), y.data());
+
+      for (IDX_T i = 0; i < nrows; ++i) {
+        /* the vector kernels sum in a different order */
+        REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+      }
+    }
+  }
+
+  set_simd_level(orig);
+}
+
+TEST_CASE( "sell kernel" TYPE_STR, "" ) {
+
+  /* a partial last chunk, and chunks of every width up to a few vectors */
+  IDX_T nrows = 203;
+  IDX_T ncols = 500;
+
+  srand(7);
+
+  for (IDX_T C : {8, 16, 3}) {
+    IDX_T nchunks = (nrows + C - 1) / C;
+
+    /* rows in reverse order */
+    std::vector<IDX_T> rows(nrows);
+    for (IDX_T i = 0; i < nrows; ++i) {
+      rows[i] = nrows - 1 - i;
+    }
+
+    std::vector<IDX_T> chunk_ptr(1, 0);
+    std::vector<IDX_T> cols;
+    std::vector<DATA_T> vals;
+    /* with some padding, which must not even read x */
+    for (IDX_T c = 0; c < nchunks; ++c) {
+      IDX_T width = c % 7;
+      for (IDX_T j = 0; j < width*C; ++j) {
+        if (rand() % 5 == 0) {
+          cols.push_back(_sell_pad<IDX_T>());
+          vals.push_back(DATA_T(0));
+        }
+        else {
+          cols.push_back(rand() % ncols);
+          vals.push_back(random_value<DATA_T>());
+        }
+      }
+      chunk_ptr.push_back(cols.size());
+    }
+
+    std::vector<DATA_T> x(ncols);
+    for (IDX_T i = 0; i < ncols; ++i) {
+      x[i] = random_value<DATA_T>();
+    }
+
+    std::vector<DATA_T> ref(nrows, DATA_T(1));
+    for (IDX_T c = 0; c < nchunks; ++c) {
+      for (IDX_T r = 0; r < C && c*C + r < nrows; ++r) {
+        for (IDX_T j = chunk_ptr[c] + r; j < chunk_ptr[c+1]; j += C) {
+          if (cols[j] != _sell_pad<IDX_T>()) {
+            ref[rows[c*C + r]] += vals[j] * x[cols[j]];
+          }
+        }
+      }
+    }
+
+    simd_level_t orig = get_simd_level();
+
+    for (int level = SIMD_SCALAR; level <= get_host_simd_level(); ++level) {
+      set_simd_level(static_cast<simd_level_t>(level));
+
+      std::vector<DATA_T> y(nrows, DATA_T(1));
+      _sell_plusdot(nrows, C, chunk_ptr.data(), rows.data(), cols.data(), vals.data(),
+                    x.data(), y.data());
+
+      for (IDX_T i = 0; i < nrows; ++i) {
+        REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+      }
+    }
+
+    set_simd_level(orig);
+  }
+}
+
+TEST_CASE( "bcsr kernel" TYPE_STR, "" ) {
+
+  /* 3x2 blocks, with the last block row cut off */
+  IDX_T nrows = 100;
+  IDX_T ncols = 60;
+  IDX_T nbrows = (nrows + 2) / 3;
+
+  srand(11);
+
+  std::vector<IDX_T> brow_ptr(1, 0);
+  std::vector<IDX_T> cols;
+  std::vector<DATA_T> vals;
+  for (IDX_T b = 0; b < nbrows; ++b) {
+    for (IDX_T k = 0; k < b % 5; ++k) {
+      cols.push_back(rand() % (ncols - 1));
+      for (int v = 0; v < 6; ++v) {
+        vals.push_back(random_value<DATA_T>());
+      }
+    }
+    brow_ptr.push_back(cols.size());
+  }
+
+  std::vector<DATA_T> x(ncols);
+  for (IDX_T i = 0; i < ncols; ++i) {
+    x[i] = random_value<DATA_T>();
+  }
+
+  std::vector<DATA_T> ref(nrows, DATA_T(2));
+  for (IDX_T b = 0; b < nbrows; ++b) {
+    for (IDX_T k = brow_ptr[b]; k < brow_ptr[b+1]; ++k) {
+      for (IDX_T r = 0; r < 3 && b*3 + r < nrows; ++r) {
+        for (IDX_T c = 0; c < 2; ++c) {
+          ref[b*3 + r] += vals[k*6 + r*2 + c] * x[cols[k] + c];
+        }
+      }
+    }
+  }
+
+  std::vector<DATA_T> y(nrows, DATA_T(2));
+  _bcsr_plusdot<3, 2>(nrows, brow_ptr.data(), cols.data(), vals.data(), x.data(), y.data());
+
+  for (IDX_T i = 0; i < nrows; ++i) {
+    REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+  }
+}
+
+TEST_CASE( "threaded kernels" TYPE_STR, "" ) {
+
+  /* mostly short rows, a few very long ones, and empty rows at the end */
+  IDX_T nrows = 300;
+  IDX_T ncols = 500;
+
+  srand(3);
+
+  std::vector<IDX_T> row_ptr(1, 0);
+  std::vector<IDX_T> cols;
+  std::vector<DATA_T> vals;
+  for (IDX_T i = 0; i < nrows; ++i) {
+    IDX_T len = (i >= nrows - 10) ? 0 : (i % 97 == 5) ? 1500 : i % 4;
+    for (IDX_T j = 0; j < len; ++j) {
+      cols.push_back(rand() % ncols);
+      vals.push_back(random_value<DATA_T>());
+    }
+    row_ptr.push_back(cols.size());
+  }
+
+  std::vector<DATA_T> x(ncols);
+  for (IDX_T i = 0; i < ncols; ++i) {
+    x[i] = random_value<DATA_T>();
+  }
+
+  std::vector<DATA_T> ref(nrows, DATA_T(1));
+  _csr_plusdot_scalar(nrows, row_ptr.data(), cols.data(), vals.data(), x.data(), ref.data());
+
+  for (int nthreads = 1; nthreads <= 5; ++nthreads) {
+    ThreadPool pool(nthreads);
+    REQUIRE(pool.get_num_threads() == nthreads);
+
+    SECTION( "csr, " + std::to_string(nthreads) + " threads" ) {
+      std::vector<DATA_T> y(nrows, DATA_T(1));
+      _csr_plusdot_threaded(&pool, nrows, row_ptr.data(), cols.data(), vals.data(),
+                            x.data(), y.data());
+
+      for (IDX_T i = 0; i < nrows; ++i) {
+        REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+      }
+    }
+
+    SECTION( "sell, " + std::to_string(nthreads) + " threads" ) {
+      /* the same rows in chunks of 4, padded */
+      IDX_T C = 4;
+      IDX_T nchunks = (nrows + C - 1) / C;
+
+      std::vector<IDX_T> rows(nrows);
+      std::vector<IDX_T> chunk_ptr(1, 0);
+      std::vector<IDX_T> sell_cols;
+      std::vector<DATA_T> sell_vals;
+      for (IDX_T c = 0; c < nchunks; ++c) {
+        IDX_T width = 0;
+        for (IDX_T r = c*C; r < std::min(nrows, c*C + C); ++r) {
+          rows[r] = r;
+          width = std::max(width, row_ptr[r+1] - row_ptr[r]);
+        }
+        for (IDX_T j = 0; j < width; ++j) {
+          for (IDX_T r = c*C; r < c*C + C; ++r) {
+            bool in_row = r < nrows && j < row_ptr[r+1] - row_ptr[r];
+            sell_cols.push_back(in_row ? cols[row_ptr[r] + j] : _sell_pad<IDX_T>());
+            sell_vals.push_back(in_row ? vals[row_ptr[r] + j] : DATA_T(0));
+          }
+        }
+        chunk_ptr.push_back(sell_cols.size());
+      }
+
+      std::vector<DATA_T> y(nrows, DATA_T(1));
+      _sell_plusdot_threaded(&pool, nrows, C, chunk_ptr.data(), rows.data(), sell_cols.data(),
+                             sell_vals.data(), x.data(), y.data());
+
+      for (IDX_T i = 0; i < nrows; ++i) {
+        REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+      }
+    }
+
+    SECTION( "bcsr, " + std::to_string(nthreads) + " threads" ) {
+      /* the same rows as 1x1 blocks */
+      std::vector<DATA_T> y(nrows, DATA_T(1));
+      _bcsr_plusdot_threaded<1, 1>(&pool, nrows, row_ptr.data(), cols.data(), vals.data(),
+                                   x.data(), y.data());
+
+      for (IDX_T i = 0; i < nrows; ++i) {
+        REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+      }
+    }
+  }
+}
+
+TEST_CASE( "delta kernel" TYPE_STR, "" ) {
+
+  /* columns close together, before and after the row index, and far apart
+   * so that some need the escape */
+  IDX_T nrows = 200;
+  IDX_T ncols = 200000;
+
+  srand(7);
+
+  std::vector<IDX_T> row_ptr(1, 0);
+  std::vector<IDX_T> cols;
+  std::vector<DATA_T> vals;
+  for (IDX_T i = 0; i < nrows; ++i) {
+    IDX_T len = i % 20;
+    std::vector<IDX_T> row;
+    for (IDX_T j = 0; j < len; ++j) {
+      row.push_back((i % 3 == 0) ? rand() % ncols :
+                    (i % 3 == 1) ? (i*50 + j) % ncols : (i + j >= 5 ? i + j - 5 : j));
+    }
+    std::sort(row.begin(), row.end());
+    for (IDX_T col : row) {
+      cols.push_back(col);
+      vals.push_back(random_value<DATA_T>());
+    }
+    row_ptr.push_back(cols.size());
+  }
+
+  std::vector<IDX_T> code_ptr(1, 0);
+  std::vector<uint16_t> codes;
+  for (IDX_T i = 0; i < nrows; ++i) {
+    _delta_encode<uint32_t>(i, row_ptr[i+1] - row_ptr[i], cols.data() + row_ptr[i], codes);
+    code_ptr.push_back(codes.size());
+  }
+  REQUIRE(codes.size() > cols.size());
+  REQUIRE(codes.size() < 2*cols.size());
+
+  std::vector<DATA_T> x(ncols);
+  for (IDX_T i = 0; i < ncols; ++i) {
+    x[i] = random_value<DATA_T>();
+  }
+
+  std::vector<DATA_T> ref(nrows, DATA_T(1));
+  _csr_plusdot_scalar(nrows, row_ptr.data(), cols.data(), vals.data(), x.data(), ref.data());
+
+  SECTION( "plain" ) {
+    std::vector<DATA_T> y(nrows, DATA_T(1));
+    _delta_csr_plusdot<uint32_t>(nrows, row_ptr.data(), code_ptr.data(), codes.data(),
+                                 vals.data(), x.data(), y.data());
+    for (IDX_T i = 0; i < nrows; ++i) {
+      REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+    }
+  }
+
+  SECTION( "threaded" ) {
+    ThreadPool pool(3);
+    std::vector<DATA_T> y(nrows, DATA_T(1));
+    _delta_csr_plusdot_threaded<uint32_t>(&pool, nrows, row_ptr.data(), code_ptr.data(),
+                                          codes.data(), vals.data(), x.data(), y.data());
+    for (IDX_T i = 0; i < nrows; ++i) {
+      REQUIRE(std::abs(y[i] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+    }
+  }
+
+  SECTION( "multi" ) {
+    /* the same vector three times */
+    int k = 3;
+    std::vector<DATA_T> xk(ncols*k), y(nrows*k, DATA_T(1));
+    for (IDX_T i = 0; i < ncols; ++i) {
+      for (int t = 0; t < k; ++t) xk[i*k + t] = x[i];
+    }
+    _delta_csr_plusdot_multi<uint32_t>(nrows, row_ptr.data(), code_ptr.data(), codes.data(),
+                                       vals.data(), xk.data(), y.data(), k);
+    for (IDX_T i = 0; i < nrows; ++i) {
+      for (int t = 0; t < k; ++t) {
+        REQUIRE(std::abs(y[i*k + t] - ref[i]) <= 1E-4 * (1 + std::abs(ref[i])));
+      }
+    }
+  }
+
+  SECTION( "transpose" ) {
+    std::vector<DATA_T> xt(nrows), ref_t(ncols, DATA_T(0)), y(ncols, DATA_T(0));
+    for (IDX_T i = 0; i < nrows; ++i) {
+      xt[i] = random_value<DATA_T>();
+    }
+    _csr_plusdot_transpose(nrows, row_ptr.data(), cols.data(), vals.data(), xt.data(), ref_t.data());
+    _delta_csr_plusdot_transpose<uint32_t>(nrows, row_ptr.data(), code_ptr.data(), codes.data(),
+                                           vals.data(), xt.data(), y.data());
+    for (IDX_T i = 0; i < ncols; ++i) {
+      REQUIRE(std::abs(y[i] - ref_t[i]) <= 1E-4 * (1 + std::abs(ref_t[i])));
+    }
+  }
+}
@@ -0,0 +1,185 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+#include "slaps.hpp"
+#include "catch.hpp"
+#include <complex>
+#include <cstdlib>
+
+/* small random values, with a nonzero imaginary part for complex types */
+template <typename D>
+D random_value()
+{
+  return D(rand() % 100) / D(10);
+}
+
+template <>
+std::complex<float> random_value()
+{
+  return std::complex<float>(random_value<float>(), random_value<float>());
+}
+
+template <>
+std::complex<double> random_value()
+{
+  return std::complex<double>(random_value<double>(), random_value<double>());
+}
+
+TEST_CASE( "thread pool", "" ) {
+
+  REQUIRE_THROWS_AS(ThreadPool(0), std::invalid_argument);
+
+  ThreadPool pool(4);
+
+  /* each thread runs once per call, and the pool can be reused */
+  std::vector<int> counts(4, 0);
+  for (int rep = 0; rep < 100; ++rep) {
+    pool.run([&] (int t) { counts[t]++; });
+  }
+  for (int t = 0; t < 4; ++t) {
+    REQUIRE(counts[t] == 100);
+  }
+}
+
+TEST_CASE( "parallel sort", "" ) {
+
+  for (int nthreads : {1, 2, 3, 5}) {
+    ThreadPool pool(nthreads);
+    for (int n : {0, 1, 7, 1000}) {
+      std::vector<int> v(n);
+      for (int i = 0; i < n; ++i) {
+        v[i] = (i * 7919) % 1013;
+      }
+      std::vector<int> correct = v;
+      std::sort(correct.begin(), correct.end());
+
+      _parallel_sort(&pool, v.begin(), v.end(), std::less<int>());
+      REQUIRE(v == correct);
+    }
+  }
+}
+
+TEST_CASE( "bfloat16", "" ) {
+
+  /* exact for small integers and powers of two */
+  for (float f : {0.f, 1.f, -3.f, 255.f, 0.5f, 1024.f, -0.125f}) {
+    REQUIRE(float(bfloat16(f)) == f);
+  }
+
+  /* otherwise, to 8 bits of mantissa, rounding to nearest even */
+  REQUIRE(float(bfloat16(257.f)) == 256.f);
+  REQUIRE(float(bfloat16(259.f)) == 260.f);
+  REQUIRE(float(bfloat16(3.14159f)) == Approx(3.14159f).epsilon(1./256));
+
+  REQUIRE(std::isinf(float(bfloat16(INFINITY))));
+  REQUIRE(std::isnan(float(bfloat16(NAN))));
+}
+
+TEST_CASE( "mixed precision kernels", "" ) {
+
+  /* float values with double vectors give the same as a double matrix of
+   * the rounded values */
+  int nrows = 50, ncols = 70;
+
+  srand(11);
+
+  std::vector<int> row_ptr(1, 0), cols;
+  std::vector<float> svals;
+  std::vector<double> dvals;
+  for (int i = 0; i < nrows; ++i) {
+    for (int j = 0; j < i % 7; ++j) {
+      cols.push_back(rand() % ncols);
+      svals.push_back(float(rand()) / RAND_MAX);
+      dvals.push_back(svals.back());
+    }
+    row_ptr.push_back(cols.size());
+  }
+
+  std::vector<double> x(ncols);
+  for (int i = 0; i < ncols; ++i) {
+    x[i] = double(rand()) / RAND_MAX;
+  }
+
+  std::vector<double> ref(nrows, 1.), y(nrows, 1.);
+  _csr_plusdot_scalar(nrows, row_ptr.data(), cols.data(), dvals.data(), x.data(), ref.data());
+
+  ThreadPool pool(3);
+  _mixed_csr_plusdot_threaded(&pool, nrows, row_ptr.data(), cols.data(), svals.data(),
+                              x.data(), y.data());
+  for (int i = 0; i < nrows; ++i) {
+    REQUIRE(y[i] == Approx(ref[i]).epsilon(1E-14));
+  }
+
+  std::vector<double> xt(nrows, 0.5), ref_t(ncols, 0.), yt(ncols, 0.);
+  _csr_plusdot_transpose(nrows, row_ptr.data(), cols.data(), dvals.data(), xt.data(), ref_t.data());
+  _mixed_csr_plusdot_transpose(nrows, row_ptr.data(), cols.data(), svals.data(), xt.data(), yt.data());
+  for (int i = 0; i < ncols; ++i) {
+    REQUIRE(yt[i] == Approx(ref_t[i]).epsilon(1E-14));
+  }
+}
+
+TEST_CASE( "slot handoff", "" ) {
+
+  /* pass 1000 values through 3 slots, in order */
+  SlotHandoff handoff;
+  handoff.reset(3);
+  REQUIRE(handoff.get_num_slots() == 3);
+
+  std::vector<int> slots(3);
+  long sum = 0;
+  bool in_order = true;
+
+  ThreadPool pool(2);
+  pool.run([&] (int t) {
+    for (int i = 0; i < 1000; ++i) {
+      if (t == 0) {
+        while (handoff.get(i % 3) != SlotHandoff::EMPTY) {
+          std::this_thread::yield();
+        }
+        slots[i % 3] = i;
+        handoff.set(i % 3, SlotHandoff::READY);
+      }
+      else {
+        handoff.wait_ready(i % 3);
+        in_order = in_order && slots[i % 3] == i;
+        sum += slots[i % 3];
+        handoff.set(i % 3, SlotHandoff::EMPTY);
+      }
+    }
+  });
+
+  REQUIRE(in_order);
+  REQUIRE(sum == 999*1000/2);
+}
+
+#define IDX_T int
+#define DATA_T float
+#include "kernel-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T unsigned long
+#define DATA_T double
+#include "kernel-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T unsigned int
+#define DATA_T std::complex<float>
+#include "kernel-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T long
+#define DATA_T std::complex<double>
+#include "kernel-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T int
+#define DATA_T int
+#include "kernel-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
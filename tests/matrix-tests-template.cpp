@@ -453,3 +453,608 @@ TEST_CASE( "dot exceptions" TYPE_STR, "" ) {
   }
 
 }
+
+TEST_CASE( "autotune" TYPE_STR, "" ) {
+
+  IDX_T M = 13, N = 11;
+
+  MAT_T<IDX_T, DATA_T> m(M, N);
+  Vec<IDX_T, DATA_T> x(N), y(M);
+  IDX_T start, end;
+
+  std::vector<DATA_T> correct;
+
+  m.get_local_rows(start, end);
+
+  IDX_T xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+
+  SECTION( "bad parameters" ) {
+    REQUIRE_THROWS_AS( m.set_block_size(0), std::invalid_argument );
+    REQUIRE_THROWS_AS( m.set_nbufs(0), std::invalid_argument );
+    REQUIRE_THROWS_AS( m.autotune(0), std::invalid_argument );
+  }
+
+  SECTION( "set parameters" ) {
+    m.set_block_size(3);
+    m.set_nbufs(2);
+    REQUIRE(m.get_block_size() == 3);
+    REQUIRE(m.get_nbufs() == 2);
+  }
+
+  SECTION( "products while tuning" ) {
+    for (IDX_T i = 0; i < 45; ++i) {
+      IDX_T idx = i%M;
+      IDX_T idy = (i^5) % N;
+      if (idx >= start && idx < end) {
+        m.set_value(idx, idy, 1);
+      }
+    }
+
+    for (IDX_T i = xstart; i < xend; ++i) {
+      xarr[i - xstart] = i+1;
+    }
+
+    correct.resize(M);
+    for (IDX_T i = start; i < end; ++i) {
+      IDX_T ii = i;
+      correct[i] = 0;
+      while (ii < 45) {
+        correct[i] += ((ii^5) % N)+1;
+        ii += M;
+      }
+    }
+    upcxx::barrier();
+
+    m.setup();
+    m.autotune(2);
+
+    /* more products than there are candidates to try */
+    for (int k = 0; k < 100; ++k) {
+      m.dot(x, y);
+      for (IDX_T i = start; i < end; ++i) {
+        CHECK(y.get_local_array()[i-start] == Approx(correct[i]));
+      }
+    }
+
+    REQUIRE(!m.is_tuning());
+    REQUIRE(m.get_block_size() > 0);
+    REQUIRE(m.get_nbufs() > 0);
+  }
+}
+
+TEST_CASE( "multivector dot" TYPE_STR, "" ) {
+
+  IDX_T M = 13, N = 11;
+
+  MAT_T<IDX_T, DATA_T> m(M, N);
+  IDX_T start, end;
+  m.get_local_rows(start, end);
+
+  /* the same pattern as the autotune test */
+  for (IDX_T i = 0; i < 45; ++i) {
+    IDX_T idx = i%M;
+    IDX_T idy = (i^5) % N;
+    if (idx >= start && idx < end) {
+      m.set_value(idx, idy, 1);
+    }
+  }
+  m.setup();
+
+  /* the generic path, and the ones with a fixed number of vectors, then fewer again */
+  for (int k : {1, 3, 8, 2}) {
+    MultiVec<IDX_T, DATA_T> x(N, k), y(M, k);
+
+    IDX_T xstart, xend;
+    x.get_local_range(xstart, xend);
+    auto xarr = x.get_local_array();
+    for (IDX_T i = xstart; i < xend; ++i) {
+      for (int t = 0; t < k; ++t) {
+        xarr[(i - xstart)*k + t] = (i+1)*(t+1);
+      }
+    }
+    upcxx::barrier();
+
+    y.set_all(1);
+    m.plusdot(x, y);
+
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = 0;
+      for (IDX_T ii = i; ii < 45; ii += M) {
+        correct += ((ii^5) % N)+1;
+      }
+      for (int t = 0; t < k; ++t) {
+        CHECK(yarr[(i-start)*k + t] == Approx(correct*(t+1) + 1));
+      }
+    }
+
+    m.dot(x, y);
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = 0;
+      for (IDX_T ii = i; ii < 45; ii += M) {
+        correct += ((ii^5) % N)+1;
+      }
+      for (int t = 0; t < k; ++t) {
+        CHECK(yarr[(i-start)*k + t] == Approx(correct*(t+1)));
+      }
+    }
+
+    MultiVec<IDX_T, DATA_T> bad(M, k+1);
+    REQUIRE_THROWS_AS( m.dot(x, bad), std::invalid_argument );
+  }
+}
+
+TEST_CASE( "threaded dot" TYPE_STR, "" ) {
+
+  IDX_T M = 113, N = 97;
+
+  MAT_T<IDX_T, DATA_T> m(M, N);
+  Vec<IDX_T, DATA_T> x(N), y(M);
+  IDX_T start, end;
+  m.get_local_rows(start, end);
+
+  REQUIRE(m.get_num_threads() == 1);
+  REQUIRE_THROWS_AS( m.set_num_threads(0), std::invalid_argument );
+
+  /* some long rows, so that the threads share rows */
+  for (IDX_T i = start; i < end; ++i) {
+    IDX_T len = (i % 17 == 0) ? N : 3;
+    for (IDX_T j = 0; j < len; ++j) {
+      m.set_value(i, (i*7 + j*13) % N, 1);
+    }
+  }
+  m.setup();
+
+  IDX_T xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+  for (IDX_T i = xstart; i < xend; ++i) {
+    xarr[i - xstart] = i+1;
+  }
+  upcxx::barrier();
+
+  for (int nthreads : {3, 1, 4}) {
+    m.set_num_threads(nthreads);
+    REQUIRE(m.get_num_threads() == nthreads);
+
+    y.set_all(1);
+    m.plusdot(x, y);
+
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      IDX_T len = (i % 17 == 0) ? N : 3;
+      DATA_T correct = 1;
+      for (IDX_T j = 0; j < len; ++j) {
+        correct += ((i*7 + j*13) % N)+1;
+      }
+      CHECK(yarr[i-start] == Approx(correct));
+    }
+  }
+}
+
+TEST_CASE( "batched and repeated values" TYPE_STR, "" ) {
+
+  IDX_T M = 113, N = 97;
+
+  /* setup() sorts on the threads, if there are any */
+  for (int nthreads : {1, 3}) {
+    MAT_T<IDX_T, DATA_T> m(M, N);
+    Vec<IDX_T, DATA_T> x(N), y(M);
+    IDX_T start, end;
+    m.get_local_rows(start, end);
+    m.set_num_threads(nthreads);
+
+    /* every element is set twice, out of order, in two batches */
+    for (int half = 0; half < 2; ++half) {
+      std::vector<IDX_T> rows, cols;
+      std::vector<DATA_T> vals;
+      for (IDX_T i = start; i < end; ++i) {
+        for (int j = 2; j >= 0; --j) {
+          rows.push_back(i);
+          cols.push_back((i*7 + j*13) % N);
+          vals.push_back(j + 1 + 3*half);
+        }
+      }
+      m.set_values(rows.data(), cols.data(), vals.data(), rows.size());
+    }
+    m.setup();
+
+    IDX_T xstart, xend;
+    x.get_local_range(xstart, xend);
+    auto xarr = x.get_local_array();
+    for (IDX_T i = xstart; i < xend; ++i) {
+      xarr[i - xstart] = i+1;
+    }
+    upcxx::barrier();
+
+    m.dot(x, y);
+
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = 0;
+      for (int j = 0; j < 3; ++j) {
+        correct += (2*j + 5) * (((i*7 + j*13) % N)+1);
+      }
+      CHECK(yarr[i-start] == Approx(correct));
+    }
+  }
+}
+
+TEST_CASE( "off-process values" TYPE_STR, "" ) {
+
+  IDX_T M = 113, N = 97;
+  int rank = upcxx::rank_me(), nranks = upcxx::rank_n();
+
+  /* assembled explicitly, or by setup() */
+  for (bool explicit_assembly : {true, false}) {
+    MAT_T<IDX_T, DATA_T> m(M, N);
+    Vec<IDX_T, DATA_T> x(N), y(M);
+    IDX_T start, end;
+    m.get_local_rows(start, end);
+
+    /* each element is set by some rank, mostly not the owner */
+    for (IDX_T i = 0; i < M; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        if ((int(i) + j) % nranks == rank) {
+          m.set_value(i, (i*7 + j*13) % N, j + 1);
+        }
+      }
+      /* and every rank adds to this one */
+      m.set_value(i, i % N, 1);
+    }
+
+    if (explicit_assembly) {
+      m.assemble_begin();
+      if (nranks > 1) {
+        REQUIRE_THROWS_AS( m.set_value(end % M, 0, 1), std::logic_error );
+      }
+      REQUIRE_THROWS_AS( m.assemble_begin(), std::logic_error );
+      m.assemble_end();
+    }
+    m.setup();
+
+    IDX_T xstart, xend;
+    x.get_local_range(xstart, xend);
+    auto xarr = x.get_local_array();
+    for (IDX_T i = xstart; i < xend; ++i) {
+      xarr[i - xstart] = i+1;
+    }
+    upcxx::barrier();
+
+    m.dot(x, y);
+
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = nranks * ((i % N)+1);
+      for (int j = 0; j < 3; ++j) {
+        correct += (j + 1) * (((i*7 + j*13) % N)+1);
+      }
+      CHECK(yarr[i-start] == Approx(correct));
+    }
+  }
+}
+
+TEST_CASE( "preallocated values" TYPE_STR, "" ) {
+
+  IDX_T M = 113, N = 97;
+  int rank = upcxx::rank_me(), nranks = upcxx::rank_n();
+
+  MAT_T<IDX_T, DATA_T> m(M, N);
+  Vec<IDX_T, DATA_T> x(N), y(M);
+  IDX_T start, end, cstart, cend;
+  m.get_local_rows(start, end);
+  m.get_diag_cols(cstart, cend);
+
+  /* each element is set twice, by some rank that is mostly not the owner */
+  std::vector<IDX_T> dnnz(end - start, 0), onnz(end - start, 0);
+  for (IDX_T i = start; i < end; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      IDX_T col = (i*7 + j*13) % N;
+      if (col >= cstart && col < cend) dnnz[i-start] += 2;
+      else onnz[i-start] += 2;
+    }
+  }
+
+  /* the matrix types that can't preallocate just take the values as usual */
+  bool preallocated = preallocate_if_csr(m, dnnz.data(), onnz.data(), 0);
+
+  for (IDX_T i = 0; i < M; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      if ((int(i) + j) % nranks == rank) {
+        m.set_value(i, (i*7 + j*13) % N, j + 1);
+        m.set_value(i, (i*7 + j*13) % N, 1);
+      }
+    }
+  }
+
+  /* and one more than preallocated doesn't fit */
+  if (preallocated && start < end) {
+    MAT_T<IDX_T, DATA_T> full(M, N);
+    std::vector<IDX_T> zeros(end - start, 0);
+    preallocate_if_csr(full, zeros.data(), zeros.data(), 0);
+    REQUIRE_THROWS_AS( full.set_value(start, 0, 1), std::length_error );
+  }
+
+  m.setup();
+
+  IDX_T xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+  for (IDX_T i = xstart; i < xend; ++i) {
+    xarr[i - xstart] = i+1;
+  }
+  upcxx::barrier();
+
+  m.dot(x, y);
+
+  auto yarr = y.get_local_array();
+  for (IDX_T i = start; i < end; ++i) {
+    DATA_T correct = 0;
+    for (int j = 0; j < 3; ++j) {
+      correct += (j + 2) * (((i*7 + j*13) % N)+1);
+    }
+    CHECK(yarr[i-start] == Approx(correct));
+  }
+}
+
+TEST_CASE( "progress thread" TYPE_STR, "" ) {
+
+  IDX_T M = 113, N = 97;
+
+  MAT_T<IDX_T, DATA_T> m(M, N);
+  Vec<IDX_T, DATA_T> x(N), y(M);
+  IDX_T start, end;
+  m.get_local_rows(start, end);
+
+  REQUIRE(!m.get_progress_thread());
+
+  for (IDX_T i = start; i < end; ++i) {
+    for (IDX_T j = 0; j < 5; ++j) {
+      m.set_value(i, (i*7 + j*13) % N, j+1);
+    }
+  }
+  m.setup();
+
+  IDX_T xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+  for (IDX_T i = xstart; i < xend; ++i) {
+    xarr[i - xstart] = i+1;
+  }
+  upcxx::barrier();
+
+  /* small blocks, so the slots get reused */
+  m.set_block_size(4);
+  m.set_progress_thread(true);
+  REQUIRE(m.get_progress_thread());
+
+  for (int nthreads : {1, 3}) {
+    m.set_num_threads(nthreads);
+
+    y.set_all(1);
+    m.plusdot(x, y);
+
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = 1;
+      for (IDX_T j = 0; j < 5; ++j) {
+        correct += (j+1)*(((i*7 + j*13) % N)+1);
+      }
+      CHECK(yarr[i-start] == Approx(correct));
+    }
+  }
+
+  m.set_progress_thread(false);
+  REQUIRE(!m.get_progress_thread());
+}
+
+TEST_CASE( "transpose dot" TYPE_STR, "" ) {
+
+  /* taller than wide, and wider than tall */
+  for (auto dims : {std::make_pair(113, 97), std::make_pair(89, 131)}) {
+    IDX_T M = dims.first, N = dims.second;
+
+    MAT_T<IDX_T, DATA_T> m(M, N);
+    Vec<IDX_T, DATA_T> x(M), y(N);
+    IDX_T start, end;
+    m.get_local_rows(start, end);
+
+    for (IDX_T i = start; i < end; ++i) {
+      for (IDX_T j = 0; j < 5; ++j) {
+        m.set_value(i, (i*7 + j*13) % N, j + 1 + i%3);
+      }
+    }
+    m.setup();
+
+    IDX_T xstart, xend;
+    x.get_local_range(xstart, xend);
+    auto xarr = x.get_local_array();
+    for (IDX_T i = xstart; i < xend; ++i) {
+      xarr[i - xstart] = i+1;
+    }
+    upcxx::barrier();
+
+    /* every rank adds up the whole product */
+    std::vector<DATA_T> correct(N, 0);
+    for (IDX_T i = 0; i < M; ++i) {
+      for (IDX_T j = 0; j < 5; ++j) {
+        correct[(i*7 + j*13) % N] += (j + 1 + i%3) * (i+1);
+      }
+    }
+
+    IDX_T ystart, yend;
+    y.get_local_range(ystart, yend);
+    auto yarr = y.get_local_array();
+
+    /* more than once, since the buffers alternate between products */
+    for (int rep = 0; rep < 3; ++rep) {
+      y.set_all(1);
+      m.plusdot_transpose(x, y);
+      for (IDX_T i = ystart; i < yend; ++i) {
+        CHECK(yarr[i - ystart] == Approx(correct[i] + 1));
+      }
+
+      m.dot_transpose(x, y);
+      for (IDX_T i = ystart; i < yend; ++i) {
+        CHECK(yarr[i - ystart] == Approx(correct[i]));
+      }
+    }
+
+    REQUIRE_THROWS_AS( m.dot_transpose(y, x), std::invalid_argument );
+  }
+}
+
+TEST_CASE( "reordered dot" TYPE_STR, "" ) {
+
+  /*
+   * a path through the rows in a scrambled order: row i sits at position
+   * pos(i) = 37*i mod N, and the row at position p is 21*p mod N
+   */
+  IDX_T N = 97;
+  auto pos = [N](IDX_T i) { return (i*37) % N; };
+  auto at = [N](IDX_T p) { return (p*21) % N; };
+
+  MAT_T<IDX_T, DATA_T> m(N, N);
+  REQUIRE(!m.get_reordering());
+  m.set_reordering(true);
+
+  if (!can_reorder(m)) {
+    m.set_value(upcxx::rank_me(), upcxx::rank_me(), 1);
+    REQUIRE_THROWS_AS( m.setup(), std::logic_error );
+    return;
+  }
+
+  /* each rank sets some of everyone's rows, in the original numbering */
+  int rank = upcxx::rank_me(), nranks = upcxx::rank_n();
+  for (IDX_T i = 0; i < N; ++i) {
+    if (int(i) % nranks != rank) continue;
+    m.set_value(i, i, 2);
+    if (pos(i) > 0) m.set_value(i, at(pos(i) - 1), 3);
+    if (pos(i) < N-1) m.set_value(i, at(pos(i) + 1), -1);
+  }
+  m.setup();
+
+  /* each rank holds the new indices of its own rows */
+  const auto& perm = m.get_permutation();
+  IDX_T rstart, rend;
+  m.get_local_rows(rstart, rend);
+  REQUIRE(perm.size() == size_t(rend - rstart));
+
+  std::vector<IDX_T> mine(N, 0), full(N);
+  std::copy(perm.begin(), perm.end(), mine.begin() + rstart);
+  upcxx::reduce_all(mine.data(), full.data(), N, upcxx::op_fast_add).wait();
+
+  /* the reordering finds the path again, just as the serial ordering does */
+  std::vector<IDX_T> sorted(full);
+  std::sort(sorted.begin(), sorted.end());
+  for (IDX_T i = 0; i < N; ++i) {
+    REQUIRE(sorted[i] == i);
+  }
+  for (IDX_T p = 0; p < N-1; ++p) {
+    REQUIRE(std::abs(double(full[at(p)]) - double(full[at(p+1)])) == 1);
+  }
+
+  std::vector< std::pair<IDX_T, IDX_T> > edges;
+  for (IDX_T p = 0; p < N-1; ++p) {
+    edges.push_back(std::make_pair(at(p), at(p+1)));
+  }
+  REQUIRE(full == _rcm_ordering(N, edges));
+
+  REQUIRE_THROWS_AS( m.set_reordering(false), std::logic_error );
+
+  Vec<IDX_T, DATA_T> x(N), y(N), px(N), py(N);
+  IDX_T xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+  for (IDX_T i = xstart; i < xend; ++i) {
+    xarr[i - xstart] = i+1;
+  }
+  upcxx::barrier();
+
+  /* the products work in the new numbering */
+  x.permute(perm, px);
+  m.dot(px, py);
+  py.unpermute(perm, y);
+
+  m.dot_transpose(px, py);
+  py.unpermute(perm, x);
+
+  auto yarr = y.get_local_array();
+  for (IDX_T i = xstart; i < xend; ++i) {
+    DATA_T correct = 2*(i+1), correct_t = 2*(i+1);
+    if (pos(i) > 0) {
+      DATA_T prev = at(pos(i) - 1) + 1;
+      correct += 3*prev;
+      correct_t -= prev;
+    }
+    if (pos(i) < N-1) {
+      DATA_T next = at(pos(i) + 1) + 1;
+      correct -= next;
+      correct_t += 3*next;
+    }
+    CHECK(yarr[i - xstart] == Approx(correct));
+    CHECK(xarr[i - xstart] == Approx(correct_t));
+  }
+
+  /* only square matrices can be reordered */
+  MAT_T<IDX_T, DATA_T> rect(N, N+1);
+  rect.set_reordering(true);
+  REQUIRE_THROWS_AS( rect.setup(), std::logic_error );
+}
+
+TEST_CASE( "partitioned dot" TYPE_STR, "" ) {
+
+  /* the first rows are much fuller than the rest */
+  IDX_T N = 150;
+  auto nnz = [](IDX_T i) -> IDX_T { return i < 15 ? 40 : 2; };
+  auto col = [N](IDX_T i, IDX_T j) { return (i*7 + j*11) % N; };
+
+  auto even = partition_array<IDX_T>(N);
+  std::vector<IDX_T> weights;
+  for (IDX_T i = even[upcxx::rank_me()]; i < even[upcxx::rank_me() + 1]; ++i) {
+    weights.push_back(nnz(i));
+  }
+  auto p = Partitioner<IDX_T>::balanced(N, weights.data());
+
+  MAT_T<IDX_T, DATA_T> m;
+  m.set_dimensions(N, N, p, p);
+  REQUIRE(m.get_row_partitions() == p.partition(N));
+  REQUIRE(m.get_col_partitions() == p.partition(N));
+
+  IDX_T start, end;
+  m.get_local_rows(start, end);
+  for (IDX_T i = start; i < end; ++i) {
+    for (IDX_T j = 0; j < nnz(i); ++j) {
+      m.set_value(i, col(i, j), j%5 + 1);
+    }
+  }
+  m.setup();
+
+  Vec<IDX_T, DATA_T> x(N, p), y(N, p);
+  IDX_T xstart, xend;
+  x.get_local_range(xstart, xend);
+  auto xarr = x.get_local_array();
+  for (IDX_T i = xstart; i < xend; ++i) {
+    xarr[i - xstart] = i%9 + 1;
+  }
+  upcxx::barrier();
+
+  m.dot(x, y);
+
+  auto yarr = y.get_local_array();
+  for (IDX_T i = start; i < end; ++i) {
+    DATA_T correct = 0;
+    for (IDX_T j = 0; j < nnz(i); ++j) {
+      correct += (j%5 + 1) * (col(i, j)%9 + 1);
+    }
+    CHECK(yarr[i - start] == Approx(correct));
+  }
+
+  /* vectors split some other way don't fit */
+  if (upcxx::rank_n() > 1) {
+    Vec<IDX_T, DATA_T> x_even(N), y_even(N);
+    REQUIRE_THROWS_AS( m.dot(x_even, y_even), std::invalid_argument );
+  }
+}
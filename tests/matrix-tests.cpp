@@ -7,6 +7,76 @@
 #include "catch.hpp"
 #include <cmath>
 
+/* the block matrices, with the block dimensions fixed so the tests can use them */
+template <typename I, typename D>
+using BCSRMat_2x2 = BCSRMat<I, D, 2, 2>;
+
+template <typename I, typename D>
+using BCSRMat_3x2 = BCSRMat<I, D, 3, 2>;
+
+/* delta-encoded columns with 16-bit local indices, so the escapes are short */
+template <typename I, typename D>
+using DeltaCSRMat_16 = DeltaCSRMat<I, D, uint16_t>;
+
+/* float values, with the ghost values of x fetched as floats too */
+template <typename I, typename D>
+using MixedCSRMat_ff = MixedCSRMat<I, D, float, float>;
+
+/* preallocate the matrices that support it, and return whether it did */
+template <typename M, typename I>
+auto preallocate_if_csr(M& m, const I* dnnz, const I* onnz, int)
+  -> decltype(m.preallocate(dnnz, onnz), bool())
+{
+  m.preallocate(dnnz, onnz);
+  return true;
+}
+
+template <typename M, typename I>
+bool preallocate_if_csr(M&, const I*, const I*, long)
+{
+  return false;
+}
+
+/* whether a matrix type can be reordered: the block matrices can't */
+template <typename M>
+bool can_reorder(const M&)
+{
+  return true;
+}
+
+template <typename I, typename D, int R, int C>
+bool can_reorder(const BCSRMat<I, D, R, C>&)
+{
+  return false;
+}
+
+/* an entry of a Hermitian test matrix: symmetric for real types */
+template <typename D>
+D sym_test_value(long i, long j)
+{
+  return 1 + std::sin(std::min(i, j) + 2*std::max(i, j));
+}
+
+template <>
+std::complex<double> sym_test_value<std::complex<double>>(long i, long j)
+{
+  double re = 1 + std::sin(std::min(i, j) + 2*std::max(i, j));
+  double im = (i < j) - (j < i);
+  return std::complex<double>(re, im * std::cos(i + j));
+}
+
+template <typename D>
+bool sym_test_close(D a, D b)
+{
+  return a == Approx(b);
+}
+
+template <typename T>
+bool sym_test_close(std::complex<T> a, std::complex<T> b)
+{
+  return a.real() == Approx(b.real()) && a.imag() == Approx(b.imag());
+}
+
 #define IDX_T int
 #define DATA_T float
 
@@ -22,6 +92,38 @@
 #include "matrix-tests-template.cpp"
 #undef MAT_T
 
+#define MAT_T GhostCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T PushCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T SELLMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T BCSRMat_2x2
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T BCSRMat_3x2
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T DeltaCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T DeltaCSRMat_16
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T MixedCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
 #define MAT_T RCMat
 #include "matrix-tests-template.cpp"
 #undef MAT_T
@@ -46,9 +148,222 @@
 #include "matrix-tests-template.cpp"
 #undef MAT_T
 
+#define MAT_T GhostCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T PushCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T SELLMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T BCSRMat_2x2
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T BCSRMat_3x2
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T DeltaCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T DeltaCSRMat_16
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T MixedCSRMat
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
+#define MAT_T MixedCSRMat_ff
+#include "matrix-tests-template.cpp"
+#undef MAT_T
+
 #define MAT_T RCMat
 #include "matrix-tests-template.cpp"
 #undef MAT_T
 
 #undef IDX_T
 #undef DATA_T
+
+/******/
+
+#define IDX_T int
+#define DATA_T float
+#include "symmetric-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T unsigned long
+#define DATA_T double
+#include "symmetric-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T int
+#define DATA_T std::complex<double>
+#include "symmetric-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+/******/
+
+#define IDX_T int
+#define DATA_T double
+#include "spgemm-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+#define IDX_T unsigned long
+#define DATA_T std::complex<double>
+#include "spgemm-tests-template.cpp"
+#undef IDX_T
+#undef DATA_T
+
+/******/
+
+TEST_CASE( "sell padding with inf in x", "" ) {
+
+  /*
+   * row i has columns i and i+1, except that every third row is long and
+   * every fifth one is empty, so most chunks are padded. x is inf in one
+   * column, which only the two rows that use it may see
+   */
+  long N = 120, bad = 61;
+  SELLMat<long, double> m(N, N);
+  Vec<long, double> x(N), y(N), z(N);
+  long start, end;
+  m.get_local_rows(start, end);
+
+  /* no sorting, so the short and empty rows share chunks with the long ones */
+  m.set_sigma(m.get_chunk_size());
+
+  auto row_cols = [N](long i) {
+    std::vector<long> c;
+    if (i % 5 == 4) return c;
+    c.push_back(i);
+    c.push_back((i+1) % N);
+    if (i % 3 == 0) {
+      for (long j = 2; j < 7; ++j) c.push_back((i + 7*j) % N);
+    }
+    return c;
+  };
+  for (long i = start; i < end; ++i) {
+    for (long j : row_cols(i)) {
+      m.set_value(i, j, 1);
+    }
+  }
+  m.setup();
+  REQUIRE(m.get_fill_ratio() > 1);
+
+  auto xarr = x.get_local_array();
+  for (long i = x.get_local_start(); i < x.get_local_end(); ++i) {
+    xarr[i - x.get_local_start()] = (i == bad) ? INFINITY : 1;
+  }
+  upcxx::barrier();
+
+  m.dot(x, y);
+  m.dot_transpose(x, z);
+
+  auto yarr = y.get_local_array();
+  for (long i = start; i < end; ++i) {
+    auto c = row_cols(i);
+    if (std::find(c.begin(), c.end(), bad) != c.end()) {
+      CHECK(yarr[i - start] == INFINITY);
+    }
+    else {
+      CHECK(yarr[i - start] == double(c.size()));
+    }
+  }
+
+  /* the transpose only spreads the inf along row bad */
+  auto zarr = z.get_local_array();
+  auto bad_cols = row_cols(bad);
+  for (long j = z.get_local_start(); j < z.get_local_end(); ++j) {
+    long count = 0;
+    for (long i = 0; i < N; ++i) {
+      auto c = row_cols(i);
+      count += std::count(c.begin(), c.end(), j);
+    }
+    if (std::find(bad_cols.begin(), bad_cols.end(), j) != bad_cols.end()) {
+      CHECK(zarr[j - z.get_local_start()] == INFINITY);
+    }
+    else {
+      CHECK(zarr[j - z.get_local_start()] == double(count));
+    }
+  }
+}
+
+TEST_CASE( "delta local index overflow", "" ) {
+
+  /* every rank's diagonal block is too wide for 16-bit local indices */
+  long N = 70000 * upcxx::rank_n();
+  DeltaCSRMat<long, double, uint16_t> m(N, N);
+  long start, end;
+  m.get_local_rows(start, end);
+  for (long i = start; i < end; ++i) {
+    m.set_value(i, i, 1);
+  }
+  REQUIRE_THROWS_AS( m.setup(), std::overflow_error );
+
+  /* with 32-bit local indices it fits, and the columns take 2 bytes each */
+  DeltaCSRMat<long, double> m32(N, N);
+  for (long i = start; i < end; ++i) {
+    m32.set_value(i, i, 1);
+  }
+  m32.setup();
+  REQUIRE(m32.get_index_bytes() == Approx(2));
+
+  /* only rank 0's block is too wide, and everyone throws with it */
+  int nranks = upcxx::rank_n();
+  std::vector<long> offsets(nranks + 1, 0);
+  for (int r = 0; r < nranks; ++r) {
+    offsets[r+1] = offsets[r] + (r == 0 ? 70000 : 10);
+  }
+  auto p = Partitioner<long>::offsets(offsets);
+  DeltaCSRMat<long, double, uint16_t> one;
+  one.set_dimensions(offsets.back(), offsets.back(), p, p);
+  one.get_local_rows(start, end);
+  for (long i = start; i < end; ++i) {
+    one.set_value(i, i, 1);
+  }
+  REQUIRE_THROWS_AS( one.setup(), std::overflow_error );
+}
+
+TEST_CASE( "bfloat16 matrix", "" ) {
+
+  /* small integers are exact in bfloat16, so the product is too */
+  long N = 200;
+  MixedCSRMat<long, double, bfloat16, float> m(N, N);
+  Vec<long, double> x(N), y(N);
+  long start, end;
+  m.get_local_rows(start, end);
+  for (long i = start; i < end; ++i) {
+    for (long j = 0; j < 4; ++j) {
+      m.set_value(i, (i*31 + j*17) % N, j - 2);
+    }
+  }
+  m.setup();
+
+  auto xarr = x.get_local_array();
+  for (long i = start; i < end; ++i) {
+    xarr[i - start] = i % 13;
+  }
+  upcxx::barrier();
+
+  m.dot(x, y);
+
+  auto yarr = y.get_local_array();
+  for (long i = start; i < end; ++i) {
+    double correct = 0;
+    for (long j = 0; j < 4; ++j) {
+      correct += (j - 2) * (((i*31 + j*17) % N) % 13);
+    }
+    CHECK(yarr[i - start] == correct);
+  }
+}
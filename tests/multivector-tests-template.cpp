@@ -0,0 +1,130 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+/*
+ * This file gives a generic set of tests that is
+ * oblivious to the data types. The data types are #define'd
+ * and then this file is included in multivector-tests.cpp to generate
+ * the actual test cases.
+ */
+
+/* macros to turn the data types into strings for the test case name */
+#define _STR(x) #x
+#define TO_STR(x) _STR(x)
+#define TYPE_STR " idx_t=" TO_STR(IDX_T) " data_t=" TO_STR(DATA_T)
+
+TEST_CASE( "multivector constructor and destructor" TYPE_STR, "" ) {
+
+  SECTION( "default constructor" ) {
+    MultiVec<IDX_T, DATA_T> v;
+    REQUIRE(!v.allocated());
+  }
+
+  SECTION( "size constructor" ) {
+    MultiVec<IDX_T, DATA_T> v(10, 3);
+    REQUIRE(v.allocated());
+    REQUIRE(v.get_size() == 10);
+    REQUIRE(v.get_num_vecs() == 3);
+  }
+
+  SECTION( "bad sizes" ) {
+    MultiVec<IDX_T, DATA_T> v;
+    REQUIRE_THROWS_AS( v.allocate_elements(10, 0), std::length_error );
+    v.allocate_elements(10, 2);
+    REQUIRE_THROWS_AS( v.allocate_elements(10, 2), std::logic_error );
+  }
+
+}
+
+TEST_CASE( "multivector copy and move" TYPE_STR, "" ) {
+
+  MultiVec<IDX_T, DATA_T> v1(50, 4);
+  v1.set_all(2);
+
+  MultiVec<IDX_T, DATA_T> v2 = v1;
+  REQUIRE(v2.allocated());
+  for (IDX_T i = 0; i < v2.get_local_size()*4; ++i) {
+    REQUIRE(v2.get_local_array()[i] == 2);
+  }
+
+  MultiVec<IDX_T, DATA_T> v3 = std::move(v1);
+  REQUIRE(v3.allocated());
+  REQUIRE(!v1.allocated());
+  REQUIRE(v3.get_num_vecs() == 4);
+}
+
+TEST_CASE( "multivector columns" TYPE_STR, "" ) {
+
+  IDX_T size = 37;
+  int k = 3;
+
+  MultiVec<IDX_T, DATA_T> mv(size, k);
+  Vec<IDX_T, DATA_T> v(size), w(size);
+
+  IDX_T start, end;
+  v.get_local_range(start, end);
+
+  for (IDX_T i = start; i < end; ++i) {
+    v.get_local_array()[i - start] = i;
+  }
+
+  mv.set_all(-1);
+  mv.set_column(1, v);
+  mv.get_column(1, w);
+
+  for (IDX_T i = start; i < end; ++i) {
+    REQUIRE(w.get_local_array()[i - start] == i);
+    REQUIRE(mv.get_local_array()[(i - start)*k] == -1);
+    REQUIRE(mv.get_local_array()[(i - start)*k + 1] == i);
+    REQUIRE(mv.get_local_array()[(i - start)*k + 2] == -1);
+  }
+
+  REQUIRE_THROWS_AS( mv.set_column(3, v), std::out_of_range );
+
+  Vec<IDX_T, DATA_T> bad(size+1);
+  REQUIRE_THROWS_AS( mv.get_column(0, bad), std::invalid_argument );
+
+  /* the same size, split differently, would run past the vector's local array */
+  int nranks = upcxx::rank_n();
+  if (nranks > 1) {
+    std::vector<IDX_T> offsets(nranks + 1, 0);
+    offsets[nranks] = size;
+    Vec<IDX_T, DATA_T> other(size, Partitioner<IDX_T>::offsets(offsets));
+    REQUIRE_THROWS_AS( mv.get_column(0, other), std::invalid_argument );
+    REQUIRE_THROWS_AS( mv.set_column(0, other), std::invalid_argument );
+  }
+}
+
+TEST_CASE( "multivector read range" TYPE_STR, "" ) {
+
+  IDX_T size = 37;
+  int k = 2;
+
+  MultiVec<IDX_T, DATA_T> mv(size, k);
+
+  IDX_T start, end;
+  mv.get_local_range(start, end);
+  for (IDX_T i = start; i < end; ++i) {
+    mv.get_local_array()[(i - start)*k] = i;
+    mv.get_local_array()[(i - start)*k + 1] = -DATA_T(i);
+  }
+  upcxx::barrier();
+
+  /* the whole thing, across all the ranks */
+  std::vector<DATA_T> buf(size*k);
+  mv.read_range_async(0, size, buf.data()).wait();
+  for (IDX_T i = 0; i < size; ++i) {
+    REQUIRE(buf[i*k] == i);
+    REQUIRE(buf[i*k + 1] == -DATA_T(i));
+  }
+
+  /* a piece from the middle */
+  mv.read_range_async(5, 20, buf.data()).wait();
+  for (IDX_T i = 5; i < 20; ++i) {
+    REQUIRE(buf[(i-5)*k] == i);
+  }
+
+  REQUIRE_THROWS_AS( mv.read_range_async(5, size+1, buf.data()), std::out_of_range );
+}
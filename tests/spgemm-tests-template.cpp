@@ -0,0 +1,183 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+/*
+ * Tests for SpGEMM, which multiplies two matrices, so it doesn't fit the
+ * generic matrix tests. The data types are #define'd and then this file is
+ * included in matrix-tests.cpp.
+ */
+
+#define _STR(x) #x
+#define TO_STR(x) _STR(x)
+#define SPGEMM_TYPE_STR " \tidx_t=" TO_STR(IDX_T) " \tdata_t=" TO_STR(DATA_T)
+
+TEST_CASE( "spgemm" SPGEMM_TYPE_STR, "" ) {
+
+  /* A is M x K and B is K x N, with small integers so that the products are exact */
+  IDX_T M = 43, K = 37, N = 29;
+  int nranks = upcxx::rank_n();
+
+  auto a_nonzero = [](int i, int k) { return (i*3 + k) % 4 == 0 || (i + k*k) % 13 == 1; };
+  auto b_nonzero = [](int k, int j) { return (k + j*5) % 6 == 0 || k == j; };
+  auto a_value = [](int i, int k) { return DATA_T((i + 2*k) % 5 - 2); };
+  auto b_value = [](int k, int j, int round) { return DATA_T((k*j + round) % 3 + 1); };
+
+  /* the whole product, on every rank */
+  auto dense_product = [&] (int round) {
+    std::vector<DATA_T> c(size_t(M) * N, DATA_T(0));
+    for (int i = 0; i < int(M); ++i) {
+      for (int k = 0; k < int(K); ++k) {
+        if (!a_nonzero(i, k)) continue;
+        for (int j = 0; j < int(N); ++j) {
+          if (b_nonzero(k, j)) c[size_t(i)*N + j] += a_value(i, k) * b_value(k, j, round);
+        }
+      }
+    }
+    return c;
+  };
+
+  /* each of C's rows holds all of the product's nonzeros, in order, and the right values */
+  auto check = [&] (const CSRMat<IDX_T, DATA_T>& C, const std::vector<DATA_T>& full) -> IDX_T {
+    IDX_T start, end;
+    C.get_local_rows(start, end);
+    std::vector<IDX_T> row_ptr, cols;
+    std::vector<DATA_T> vals;
+    C.get_local_csr(row_ptr, cols, vals);
+    for (IDX_T i = start; i < end; ++i) {
+      IDX_T k = row_ptr[i - start];
+      for (IDX_T j = 0; j < N; ++j) {
+        DATA_T correct = full[size_t(i)*N + j];
+        if (k < row_ptr[i - start + 1] && cols[k] == j) {
+          REQUIRE(vals[k] == correct);
+          ++k;
+        }
+        else {
+          REQUIRE(correct == DATA_T(0));
+        }
+      }
+      REQUIRE(k == row_ptr[i - start + 1]);
+    }
+    return row_ptr.back();
+  };
+
+  /* evenly split, unevenly split, and on threads */
+  for (int mode : {0, 1, 2}) {
+
+    Partitioner<IDX_T> rows, inner, cols;
+    if (mode == 1) {
+      std::vector<IDX_T> row_offsets(nranks + 1), inner_offsets(nranks + 1), col_offsets(nranks + 1);
+      for (int r = 0; r <= nranks; ++r) {
+        row_offsets[r] = size_t(M) * r / nranks;
+        inner_offsets[r] = size_t(K) * r * r / (nranks * nranks);
+        col_offsets[r] = N - size_t(N) * (nranks - r) * (nranks - r) / (nranks * nranks);
+      }
+      rows = Partitioner<IDX_T>::offsets(row_offsets);
+      inner = Partitioner<IDX_T>::offsets(inner_offsets);
+      cols = Partitioner<IDX_T>::offsets(col_offsets);
+    }
+
+    NaiveCSRMat<IDX_T, DATA_T> A;
+    GhostCSRMat<IDX_T, DATA_T> B;
+    A.set_dimensions(M, K, rows, inner);
+    B.set_dimensions(K, N, inner, cols);
+
+    /* set from everywhere, so the assembly has work to do */
+    for (int i = upcxx::rank_me(); i < int(M); i += nranks) {
+      for (int k = 0; k < int(K); ++k) {
+        if (a_nonzero(i, k)) A.set_value(i, k, a_value(i, k));
+      }
+    }
+    for (int k = upcxx::rank_me(); k < int(K); k += nranks) {
+      for (int j = 0; j < int(N); ++j) {
+        if (b_nonzero(k, j)) B.set_value(k, j, b_value(k, j, 0));
+      }
+    }
+    A.setup();
+    B.setup();
+
+    SpGEMM<IDX_T, DATA_T> product;
+    if (mode == 2) {
+      product.set_num_threads(2);
+      REQUIRE(product.get_num_threads() == 2);
+    }
+    product.setup(A, B);
+
+    GhostCSRMat<IDX_T, DATA_T> C;
+    product.multiply(A, B, C);
+    C.setup();
+    REQUIRE(C.get_row_partitions() == A.get_row_partitions());
+    REQUIRE(C.get_col_partitions() == B.get_col_partitions());
+    REQUIRE(check(C, dense_product(0)) == product.get_local_nnz());
+
+    /* new values in the same pattern only need the numeric phase */
+    GhostCSRMat<IDX_T, DATA_T> B2;
+    B2.set_dimensions(K, N, inner, cols);
+    IDX_T kstart, kend;
+    B2.get_local_rows(kstart, kend);
+    for (IDX_T k = kstart; k < kend; ++k) {
+      for (IDX_T j = 0; j < N; ++j) {
+        if (b_nonzero(k, j)) B2.set_value(k, j, b_value(k, j, 1));
+      }
+    }
+    B2.setup();
+
+    NaiveCSRMat<IDX_T, DATA_T> C2;
+    product.multiply(A, B2, C2);
+    C2.setup();
+    check(C2, dense_product(1));
+
+    /* and the one-shot version gives the same */
+    NaiveCSRMat<IDX_T, DATA_T> C3;
+    spgemm(A, B, C3);
+    C3.setup();
+    check(C3, dense_product(0));
+  }
+}
+
+TEST_CASE( "spgemm errors" SPGEMM_TYPE_STR, "" ) {
+
+  NaiveCSRMat<IDX_T, DATA_T> A(10, 12), B(11, 10), D(12, 10);
+  A.set_value(0, 0, 1);
+  B.set_value(0, 0, 1);
+  D.set_value(0, 0, 1);
+  A.setup();
+  B.setup();
+  D.setup();
+
+  SpGEMM<IDX_T, DATA_T> product;
+  REQUIRE_THROWS_AS( product.setup(A, B), std::invalid_argument );
+
+  NaiveCSRMat<IDX_T, DATA_T> C;
+  REQUIRE_THROWS_AS( product.multiply(A, D, C), std::logic_error );
+
+  product.setup(A, D);
+
+  /* another pattern */
+  NaiveCSRMat<IDX_T, DATA_T> D2(12, 10);
+  D2.set_value(0, 0, 1);
+  D2.set_value(11, 9, 1);
+  D2.setup();
+  REQUIRE_THROWS_AS( product.multiply(A, D2, C), std::invalid_argument );
+
+  /* the same row lengths, but other columns */
+  NaiveCSRMat<IDX_T, DATA_T> D3(12, 10);
+  D3.set_value(0, 1, 1);
+  D3.setup();
+  REQUIRE_THROWS_AS( product.multiply(A, D3, C), std::invalid_argument );
+
+  /* and the same for A */
+  NaiveCSRMat<IDX_T, DATA_T> A2(10, 12);
+  A2.set_value(0, 1, 1);
+  A2.setup();
+  REQUIRE_THROWS_AS( product.multiply(A2, D, C), std::invalid_argument );
+
+  /* the formats that don't keep their CSR arrays can't be multiplied */
+  SELLMat<IDX_T, DATA_T> S(12, 10);
+  S.set_value(0, 0, 1);
+  S.setup();
+  REQUIRE_THROWS_AS( product.setup(A, S), std::logic_error );
+}
+
+#undef SPGEMM_TYPE_STR
@@ -0,0 +1,152 @@
+/*
+ *  This file is part of SLAPS
+ *  (C) Greg Meyer, 2018
+ */
+
+/*
+ * Tests for SymCSRMat, which only takes square symmetric (or Hermitian)
+ * matrices, so it doesn't fit the generic matrix tests. The data types are
+ * #define'd and then this file is included in matrix-tests.cpp.
+ */
+
+#define _STR(x) #x
+#define TO_STR(x) _STR(x)
+#define SYM_TYPE_STR " \tidx_t=" TO_STR(IDX_T) " \tdata_t=" TO_STR(DATA_T)
+
+TEST_CASE( "symmetric dot" SYM_TYPE_STR, "" ) {
+
+  /* setting the full matrix, or only the upper triangle, gives the same thing */
+  for (int mode : {0, 1, 2}) {
+  bool upper_only = (mode == 1), preallocated = (mode == 2);
+  for (IDX_T N : {1, 7, 61}) {
+
+    SymCSRMat<IDX_T, DATA_T> m(N, N);
+    Vec<IDX_T, DATA_T> x(N), y(N);
+    IDX_T start, end;
+    m.get_local_rows(start, end);
+
+    /* a pattern that reaches across the ranks in both directions */
+    auto nonzero = [](IDX_T i, IDX_T j) {
+      return i == j || (i + j) % 5 == 0 || (i*j) % 11 == 3;
+    };
+
+    if (preallocated) {
+      std::vector<IDX_T> dnnz(end - start, 0), onnz(end - start, 0);
+      for (IDX_T i = start; i < end; ++i) {
+        for (IDX_T j = 0; j < N; ++j) {
+          if (!nonzero(i, j)) continue;
+          if (j >= start && j < end) dnnz[i-start]++;
+          else onnz[i-start]++;
+        }
+      }
+      m.preallocate(dnnz.data(), onnz.data());
+    }
+
+    for (IDX_T i = start; i < end; ++i) {
+      for (IDX_T j = upper_only ? i : 0; j < N; ++j) {
+        if (nonzero(i, j)) m.set_value(i, j, sym_test_value<DATA_T>(i, j));
+      }
+    }
+
+    m.setup();
+
+    auto xarr = x.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      xarr[i - start] = DATA_T(i % 7) - DATA_T(2);
+    }
+    upcxx::barrier();
+
+    /* the full product, and A^T*x = conj(A)*x */
+    std::vector<DATA_T> correct(end - start, DATA_T(0)), correct_t(end - start, DATA_T(0));
+    for (IDX_T i = start; i < end; ++i) {
+      for (IDX_T j = 0; j < N; ++j) {
+        if (nonzero(i, j)) {
+          DATA_T a = sym_test_value<DATA_T>(i, j);
+          correct[i - start] += a * (DATA_T(j % 7) - DATA_T(2));
+          correct_t[i - start] += _conj(a) * (DATA_T(j % 7) - DATA_T(2));
+        }
+      }
+    }
+
+    auto yarr = y.get_local_array();
+
+    /* more than once, since the add buffers alternate between products */
+    for (int rep = 0; rep < 3; ++rep) {
+      m.dot(x, y);
+      for (IDX_T i = start; i < end; ++i) {
+        CHECK(sym_test_close(yarr[i - start], correct[i - start]));
+      }
+
+      y.set_all(1);
+      m.plusdot(x, y);
+      for (IDX_T i = start; i < end; ++i) {
+        CHECK(sym_test_close(yarr[i - start], correct[i - start] + DATA_T(1)));
+      }
+
+      m.dot_transpose(x, y);
+      for (IDX_T i = start; i < end; ++i) {
+        CHECK(sym_test_close(yarr[i - start], correct_t[i - start]));
+      }
+    }
+  }
+  }
+}
+
+TEST_CASE( "symmetric reordering" SYM_TYPE_STR, "" ) {
+
+  /* the stored entries stay above the new diagonal */
+  for (bool upper_only : {false, true}) {
+  for (IDX_T N : {1, 7, 61}) {
+
+    SymCSRMat<IDX_T, DATA_T> m(N, N);
+    m.set_reordering(true);
+    IDX_T start, end;
+    m.get_local_rows(start, end);
+
+    auto nonzero = [](IDX_T i, IDX_T j) {
+      return i == j || (i + j) % 5 == 0 || (i*j) % 11 == 3;
+    };
+
+    for (IDX_T i = start; i < end; ++i) {
+      for (IDX_T j = upper_only ? i : 0; j < N; ++j) {
+        if (nonzero(i, j)) m.set_value(i, j, sym_test_value<DATA_T>(i, j));
+      }
+    }
+
+    m.setup();
+    const auto& perm = m.get_permutation();
+
+    Vec<IDX_T, DATA_T> x(N), y(N), px(N), py(N);
+    auto xarr = x.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      xarr[i - start] = DATA_T(i % 7) - DATA_T(2);
+    }
+    upcxx::barrier();
+
+    x.permute(perm, px);
+    m.dot(px, py);
+    py.unpermute(perm, y);
+
+    auto yarr = y.get_local_array();
+    for (IDX_T i = start; i < end; ++i) {
+      DATA_T correct = 0;
+      for (IDX_T j = 0; j < N; ++j) {
+        if (nonzero(i, j)) correct += sym_test_value<DATA_T>(i, j) * (DATA_T(j % 7) - DATA_T(2));
+      }
+      CHECK(sym_test_close(yarr[i - start], correct));
+    }
+  }
+  }
+}
+
+TEST_CASE( "symmetric exceptions" SYM_TYPE_STR, "" ) {
+
+  SymCSRMat<IDX_T, DATA_T> m(10, 12);
+  REQUIRE_THROWS_AS( m.setup(), std::logic_error );
+
+  SymCSRMat<IDX_T, DATA_T> sq(10, 10);
+  Vec<IDX_T, DATA_T> x(10), y(10);
+  REQUIRE_THROWS_AS( sq.dot(x, y), std::logic_error );
+}
+
+#undef SYM_TYPE_STR
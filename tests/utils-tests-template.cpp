@@ -98,3 +98,165 @@ TEST_CASE( "idx_to_proc. n=size, r=ranks. " TYPE_STR, "" ) {
     REQUIRE(_idx_to_proc(1,2,3) == 1);
   }
 }
+
+TEST_CASE( "rcm ordering" TYPE_STR, "" ) {
+
+  /* a 10x12 grid, numbered in a scrambled order, and two lone vertices */
+  IDX_T nx = 10, ny = 12, n = nx*ny + 2;
+  auto label = [n](IDX_T v) { return (v*53) % n; };
+
+  std::vector< std::pair<IDX_T, IDX_T> > edges;
+  for (IDX_T i = 0; i < nx; ++i) {
+    for (IDX_T j = 0; j < ny; ++j) {
+      IDX_T v = i*ny + j;
+      if (i+1 < nx) edges.push_back(std::make_pair(label(v), label(v + ny)));
+      if (j+1 < ny) edges.push_back(std::make_pair(label(v + 1), label(v)));
+      /* repeats and self loops are ignored */
+      edges.push_back(std::make_pair(label(v), label(v)));
+    }
+  }
+  edges.push_back(edges[0]);
+
+  auto perm = _rcm_ordering(n, edges);
+
+  REQUIRE(perm.size() == size_t(n));
+  std::vector<IDX_T> sorted(perm);
+  std::sort(sorted.begin(), sorted.end());
+  for (IDX_T i = 0; i < n; ++i) {
+    REQUIRE(sorted[i] == i);
+  }
+
+  /* the bandwidth comes down to about twice the short side of the grid */
+  double bandwidth = 0, scrambled = 0;
+  for (const auto& e: edges) {
+    bandwidth = std::max(bandwidth, std::abs(double(perm[e.first]) - double(perm[e.second])));
+    scrambled = std::max(scrambled, std::abs(double(e.first) - double(e.second)));
+  }
+  INFO("bandwidth " << bandwidth);
+  REQUIRE(bandwidth < 2*nx);
+  REQUIRE(scrambled > 5*nx);
+
+  /* a path comes out as a path */
+  std::vector< std::pair<IDX_T, IDX_T> > path;
+  for (IDX_T v = 0; v + 1 < 50; ++v) {
+    path.push_back(std::make_pair((v*7) % 50, ((v+1)*7) % 50));
+  }
+  perm = _rcm_ordering<IDX_T>(50, path);
+  for (const auto& e: path) {
+    REQUIRE(std::abs(double(perm[e.first]) - double(perm[e.second])) == 1);
+  }
+
+  REQUIRE(_rcm_ordering<IDX_T>(0, std::vector< std::pair<IDX_T, IDX_T> >()).empty());
+
+  /*
+   * the distributed ordering gives the same, with the grid split between the
+   * ranks, the first of them empty, and each passing the edges from its part
+   */
+  int nranks = upcxx::rank_n();
+  std::vector<IDX_T> offsets(nranks + 1, 0);
+  for (int r = 1; r <= nranks; ++r) {
+    offsets[r] = (nranks == 1 || r == nranks) ? n : static_cast<IDX_T>((r-1) * n / (nranks-1) / 2);
+  }
+  IDX_T start = offsets[upcxx::rank_me()], end = offsets[upcxx::rank_me() + 1];
+
+  std::vector< std::pair<IDX_T, IDX_T> > mine;
+  for (const auto& e: edges) {
+    if (e.first >= start && e.first < end) {
+      mine.push_back(e);
+    }
+  }
+  auto serial = _rcm_ordering(n, edges);
+  auto distributed = _rcm_ordering_distributed(offsets, mine);
+  REQUIRE(distributed == std::vector<IDX_T>(serial.begin() + start, serial.begin() + end));
+}
+
+TEST_CASE( "weighted split" TYPE_STR, "" ) {
+
+  /* one heavy row among light ones, split over 4 ranks */
+  std::vector<IDX_T> w = {1, 1, 1, 1, 12, 1, 1, 1, 1};
+  auto firsts = _weighted_split<IDX_T>(w.data(), 0, w.size(), 0, 20, 4);
+
+  /* midpoints 0.5..3.5 go to rank 0, 10 to rank 2, and 16.5..19.5 to rank 3 */
+  REQUIRE(firsts[0] == 0);
+  REQUIRE(firsts[1] == 4);
+  REQUIRE(firsts[2] == 4);
+  REQUIRE(firsts[3] == 5);
+
+  /* the same rows, as the second of two pieces of a bigger split */
+  auto second = _weighted_split<IDX_T>(w.data() + 4, 4, 5, 4, 20, 4);
+  REQUIRE(second[0] == 4);
+  REQUIRE(second[2] == 4);
+  REQUIRE(second[3] == 5);
+  REQUIRE(second[4] == 9);
+}
+
+TEST_CASE( "owner lookup" TYPE_STR, "" ) {
+
+  /* even, uneven, and with empty ranks at the start, middle and end */
+  std::vector< std::vector<IDX_T> > partitions = {
+    {0, 25, 50, 75, 100},
+    {0, 1, 2, 3, 97, 100},
+    {0, 0, 0, 40, 40, 41, 100, 100},
+    {0, 7},
+    {0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 5},
+  };
+
+  for (const auto& offsets : partitions) {
+    OwnerLookup<IDX_T> owner(offsets);
+    for (IDX_T idx = 0; idx < offsets.back(); ++idx) {
+      int r = owner(idx);
+      REQUIRE(offsets[r] <= idx);
+      REQUIRE(idx < offsets[r+1]);
+    }
+  }
+}
+
+TEST_CASE( "partitioner" TYPE_STR, "" ) {
+
+  int nranks = upcxx::rank_n();
+
+  /* the default is the even split */
+  REQUIRE(Partitioner<IDX_T>().partition(100) == partition_array<IDX_T>(100));
+
+  /* given offsets, which only fit their own size */
+  std::vector<IDX_T> offsets(nranks + 1, 0);
+  for (int r = 0; r < nranks; ++r) {
+    offsets[r+1] = offsets[r] + 3*r + 1;
+  }
+  auto given = Partitioner<IDX_T>::offsets(offsets);
+  REQUIRE(given.partition(offsets.back()) == offsets);
+  REQUIRE_THROWS_AS( given.partition(offsets.back() + 1), std::invalid_argument );
+
+  REQUIRE_THROWS_AS( Partitioner<IDX_T>::offsets(std::vector<IDX_T>(nranks + 2, 0)), std::invalid_argument );
+  if (nranks > 1) {
+    std::vector<IDX_T> decreasing(nranks + 1, 5);
+    decreasing[0] = 0;
+    decreasing[1] = 6;
+    REQUIRE_THROWS_AS( Partitioner<IDX_T>::offsets(decreasing), std::invalid_argument );
+  }
+
+  /* balanced: the first tenth of the rows holds most of the weight */
+  IDX_T size = 200;
+  auto even = partition_array<IDX_T>(size);
+  IDX_T start = even[upcxx::rank_me()], end = even[upcxx::rank_me() + 1];
+  std::vector<IDX_T> weights;
+  for (IDX_T i = start; i < end; ++i) {
+    weights.push_back(i < 20 ? 50 : 1);
+  }
+
+  auto p = Partitioner<IDX_T>::balanced(size, weights.data()).partition(size);
+  REQUIRE(p.size() == size_t(nranks + 1));
+  REQUIRE(p.front() == 0);
+  REQUIRE(p.back() == size);
+
+  /* no rank gets much more than its share, beyond one row */
+  double total = 20*50 + 180;
+  for (int r = 0; r < nranks; ++r) {
+    REQUIRE(p[r] <= p[r+1]);
+    double w = 0;
+    for (IDX_T i = p[r]; i < p[r+1]; ++i) {
+      w += i < 20 ? 50 : 1;
+    }
+    REQUIRE(w <= total/nranks + 50);
+  }
+}
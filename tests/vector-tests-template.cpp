@@ -340,3 +340,90 @@ TEST_CASE( "dot method" TYPE_STR, "" ) {
     REQUIRE(v.dot(b) == Approx(122622.0703125));
   }
 }
+
+TEST_CASE( "permute and unpermute" TYPE_STR, "" ) {
+
+  /* new index 37*i mod 101, which is a permutation since 101 is prime */
+  IDX_T len = 101;
+  std::vector<IDX_T> perm(len);
+  for (IDX_T i = 0; i < len; ++i) {
+    perm[i] = (i*37) % len;
+  }
+
+  Vec<IDX_T, DATA_T> x(len), px(len), y(len);
+  IDX_T start, end;
+  x.get_local_range(start, end);
+  auto xarr = x.get_local_array();
+  for (IDX_T i = start; i < end; ++i) {
+    xarr[i - start] = i + 1;
+  }
+  upcxx::barrier();
+
+  /* each rank passes the new indices of its own part */
+  if (upcxx::rank_n() > 1) {
+    REQUIRE_THROWS_AS( x.permute(perm, px), std::invalid_argument );
+  }
+  perm = std::vector<IDX_T>(perm.begin() + start, perm.begin() + end);
+
+  x.permute(perm, px);
+
+  /* px[perm[i]] = x[i], so px[j] = inverse(j) + 1, where 37*71 = 1 mod 101 */
+  auto parr = px.get_local_array();
+  for (IDX_T j = start; j < end; ++j) {
+    REQUIRE(parr[j - start] == DATA_T((j*71) % len + 1));
+  }
+
+  px.unpermute(perm, y);
+
+  auto yarr = y.get_local_array();
+  for (IDX_T i = start; i < end; ++i) {
+    REQUIRE(yarr[i - start] == DATA_T(i + 1));
+  }
+
+  Vec<IDX_T, DATA_T> wrong(len - 1);
+  REQUIRE_THROWS_AS( x.permute(perm, wrong), std::invalid_argument );
+}
+
+TEST_CASE( "partitioned vector" TYPE_STR, "" ) {
+
+  /* rank 0 gets nothing and the last rank gets the most */
+  int nranks = upcxx::rank_n();
+  IDX_T len = 0;
+  std::vector<IDX_T> offsets(1, 0);
+  for (int r = 0; r < nranks; ++r) {
+    len += (r == 0 && nranks > 1) ? 0 : 10*r + 5;
+    offsets.push_back(len);
+  }
+
+  Vec<IDX_T, DATA_T> v(len, Partitioner<IDX_T>::offsets(offsets));
+  REQUIRE(v.get_partitions() == offsets);
+
+  IDX_T start, end;
+  v.get_local_range(start, end);
+  REQUIRE(start == offsets[upcxx::rank_me()]);
+  REQUIRE(end == offsets[upcxx::rank_me() + 1]);
+  REQUIRE(v.get_local_size() == end - start);
+
+  /* everyone sets some of everyone's values */
+  for (IDX_T i = upcxx::rank_me(); i < len; i += nranks) {
+    v[i] = i + 1;
+  }
+  v.set_wait();
+
+  std::vector<DATA_T> buf(len);
+  v.read_range(0, len, buf.data());
+  for (IDX_T i = 0; i < len; ++i) {
+    REQUIRE(buf[i] == DATA_T(i + 1));
+  }
+  upcxx::barrier();
+
+  /* copies keep the partition, and other partitions don't mix */
+  Vec<IDX_T, DATA_T> copy(v);
+  REQUIRE(copy.get_partitions() == offsets);
+  REQUIRE(copy.dot(v) == Approx(v.dot(v)));
+
+  if (nranks > 1) {
+    Vec<IDX_T, DATA_T> even(len);
+    REQUIRE_THROWS_AS( even.dot(v), std::invalid_argument );
+  }
+}